@@ -8,6 +8,19 @@ workers = 0
 -- log_buffer_size = 1024*8
 -- service_table_size = 10 -- 2^10
 -- thread_max_free_memory = 1024
+-- mailbox_depth = 1024 -- max messages in flight from a thread to a service by credited send
+-- inbox_control_weight = 32 -- control lane messages a worker handles before each data slice
+-- inbox_data_weight = 128 -- data lane messages in a slice
+-- message_tracing = 0 -- stamp messages and keep per msgid latency histograms
+-- io_budget = 256*1024 -- bytes a service can read or write for one socket event before it is requeued
+-- io_budget_calls = 64 -- io calls a service can make for one socket event before it is requeued
+-- pool_max_idle = 8 -- idle outbound connections a thread keeps for each address and socket options
+-- pool_max_conns = 0 -- outbound connections of a thread for each address and socket options, 0 is no limit
+-- pool_idle_timeout = 30000 -- ms an idle pooled connection can be reused in
+-- pool_lifetime = 0 -- ms a pooled connection can be reused in since connected, 0 is no limit
+-- rx_slab_size = 16*1024 -- receive slab size, connections read into the slabs of their thread and hold none while idle
+-- rx_slab_max_free = 64 -- free receive slabs a thread keeps
+-- loop_stats_interval = 0 -- ms between the snapshots of master and worker loop counters, 0 is off
 -- logfile_prefix = "stdout"
 
 http_default = {
@@ -15,7 +28,13 @@ http_default = {
   port = 80;
   backlog = 0;
   tx_init_size = 0;
-  rx_init_size = 0;
   rx_limit = 1024*8;
+  -- listen_shards = 0; -- reuseport listeners each accepts on its own worker, -1 is one per worker
+  -- steer_cpu = 0; -- pick the shard of a connection by the cpu it arrives on
+  -- sockopts = { -- only the options given are set, see L_SOCKOPT_* in core/socket.h
+  --   nodelay = true; defer_accept = 5; fastopen = 256; rcvbuf = 256*1024; sndbuf = 256*1024;
+  --   notsent_lowat = 16*1024; busy_poll = 50; keepalive = true; keepidle = 60; keepintvl = 10;
+  --   keepcnt = 5; user_timeout = 30000;
+  -- };
 }
 
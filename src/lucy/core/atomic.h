@@ -0,0 +1,138 @@
+#ifndef l_core_atomic_h
+#define l_core_atomic_h
+#include "core/base.h"
+
+/**
+ * atomic operations on 64-bit words - load is acquire, store is release, and the
+ * read-modify-write operations are sequentially consistent. the relaxed variants
+ * are for the counters and hints that do not order other memory.
+ */
+
+#define L_CACHE_LINE_SIZE 64
+
+#if defined(__GNUC__)
+
+L_INLINE l_ulong
+l_atomic_load(volatile l_ulong* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+L_INLINE l_ulong
+l_atomic_loadRelaxed(volatile l_ulong* p)
+{
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+L_INLINE void
+l_atomic_store(volatile l_ulong* p, l_ulong v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+L_INLINE void
+l_atomic_storeRelaxed(volatile l_ulong* p, l_ulong v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+/* return true and set *p to v if *p is expected, otherwise return false */
+L_INLINE int
+l_atomic_cas(volatile l_ulong* p, l_ulong expected, l_ulong v)
+{
+  return __atomic_compare_exchange_n(p, &expected, v, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/* return the value before the add */
+L_INLINE l_ulong
+l_atomic_add(volatile l_ulong* p, l_ulong v)
+{
+  return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+}
+
+L_INLINE l_ulong
+l_atomic_addRelaxed(volatile l_ulong* p, l_ulong v)
+{
+  return __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+}
+
+L_INLINE void
+l_atomic_fence()
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+L_INLINE void
+l_atomic_pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+#elif defined(l_cmpl_msc)
+#include <intrin.h>
+
+L_INLINE l_ulong
+l_atomic_load(volatile l_ulong* p)
+{
+  l_ulong v = *p;
+  _ReadWriteBarrier();
+  return v;
+}
+
+L_INLINE l_ulong
+l_atomic_loadRelaxed(volatile l_ulong* p)
+{
+  return *p;
+}
+
+L_INLINE void
+l_atomic_store(volatile l_ulong* p, l_ulong v)
+{
+  _ReadWriteBarrier();
+  *p = v;
+}
+
+L_INLINE void
+l_atomic_storeRelaxed(volatile l_ulong* p, l_ulong v)
+{
+  *p = v;
+}
+
+L_INLINE int
+l_atomic_cas(volatile l_ulong* p, l_ulong expected, l_ulong v)
+{
+  return (l_ulong)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)v, (__int64)expected) == expected;
+}
+
+L_INLINE l_ulong
+l_atomic_add(volatile l_ulong* p, l_ulong v)
+{
+  return (l_ulong)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)v);
+}
+
+L_INLINE l_ulong
+l_atomic_addRelaxed(volatile l_ulong* p, l_ulong v)
+{
+  return (l_ulong)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)v);
+}
+
+L_INLINE void
+l_atomic_fence()
+{
+  _mm_mfence();
+}
+
+L_INLINE void
+l_atomic_pause()
+{
+  _mm_pause();
+}
+
+#else
+#error "atomic operations are not supported by the compiler"
+#endif
+
+#endif /* l_core_atomic_h */
+
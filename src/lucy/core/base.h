@@ -72,6 +72,7 @@
 #define L_EMATCH (-6)
 #define L_EINVAL (-7)
 #define L_ENOMEM (-8)
+#define L_ETIMEOUT (-9)
 
 /**
  * memory operations
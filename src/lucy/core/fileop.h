@@ -91,6 +91,7 @@ L_EXTERN int l_file_getcwd(int (*write)(void* stream, const l_byte* dir), void*
 L_EXTERN int l_file_exec(const void* cmd, void (*func)(void* obj, l_strn result), void* obj);
 
 L_EXTERN l_filedesc l_filedesc_dirfd(const void* name);
+L_EXTERN l_filedesc l_filedesc_openRead(const void* name, l_long* size); /* size is -1 if it is not a regular file */
 L_EXTERN void l_filedesc_close(l_filedesc* fd);
 L_EXTERN l_filedesc l_filedesc_empty();
 L_EXTERN int l_filedesc_isEmpty(l_filedesc fd);
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#define L_LIBRARY_IMPL
+#include "core/hash.h"
+
+static const l_ulong l_hash_secret[4] = {
+  (l_ulong)0x2d358dccaa6c78a5, (l_ulong)0x8bb84b93962eacc9,
+  (l_ulong)0x4b33a62ed433d4a3, (l_ulong)0x4d5a2da51de1aa47
+};
+
+static l_ulong l_hash_process_seed;
+static int l_hash_seed_inited;
+
+/* 64x64 to 128-bit multiply, the low half is in *a and the high half is in *b */
+static void
+l_hash_mum(l_ulong* a, l_ulong* b)
+{
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 l_hash_u128;
+  l_hash_u128 r = (l_hash_u128)*a * *b;
+  *a = (l_ulong)r;
+  *b = (l_ulong)(r >> 64);
+#else
+  l_ulong ha = *a >> 32, hb = *b >> 32, la = (l_umedit)*a, lb = (l_umedit)*b;
+  l_ulong rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  l_ulong t = rl + (rm0 << 32), lo = 0, c = (t < rl);
+  lo = t + (rm1 << 32);
+  c += (lo < t);
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static l_ulong
+l_hash_mix(l_ulong a, l_ulong b)
+{
+  l_hash_mum(&a, &b);
+  return a ^ b;
+}
+
+/* the reads are in native byte order, so the hash values differ between little
+and big endian machines, they are never stored or sent out */
+
+static l_ulong
+l_hash_read8(const l_byte* p)
+{
+  l_ulong v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static l_ulong
+l_hash_read4(const l_byte* p)
+{
+  l_umedit v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+L_EXTERN l_ulong
+l_hash_bytes(const void* data, l_int len, l_ulong seed)
+{
+  const l_byte* p = (const l_byte*)data;
+  l_ulong a = 0, b = 0, see1 = 0, see2 = 0;
+  l_int i = len;
+
+  seed ^= l_hash_mix(seed ^ l_hash_secret[0], l_hash_secret[1]);
+
+  if (len <= 16) {
+    if (len >= 4) { /* the two reads of 4 bytes overlap for len less than 8 */
+      a = (l_hash_read4(p) << 32) | l_hash_read4(p + ((len >> 3) << 2));
+      b = (l_hash_read4(p + len - 4) << 32) | l_hash_read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = ((l_ulong)p[0] << 16) | ((l_ulong)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    }
+  } else {
+    if (i > 48) { /* three independent lanes */
+      see1 = see2 = seed;
+      do {
+        seed = l_hash_mix(l_hash_read8(p) ^ l_hash_secret[1], l_hash_read8(p + 8) ^ seed);
+        see1 = l_hash_mix(l_hash_read8(p + 16) ^ l_hash_secret[2], l_hash_read8(p + 24) ^ see1);
+        see2 = l_hash_mix(l_hash_read8(p + 32) ^ l_hash_secret[3], l_hash_read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = l_hash_mix(l_hash_read8(p) ^ l_hash_secret[1], l_hash_read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = l_hash_read8(p + i - 16); /* the last 16 bytes, may overlap the previous block */
+    b = l_hash_read8(p + i - 8);
+  }
+
+  a ^= l_hash_secret[1];
+  b ^= seed;
+  l_hash_mum(&a, &b);
+  return l_hash_mix(a ^ l_hash_secret[0] ^ (l_ulong)len, b ^ l_hash_secret[1]);
+}
+
+L_EXTERN l_ulong
+l_hash_int(l_ulong key, l_ulong seed)
+{
+  key ^= seed;
+  key ^= key >> 30;
+  key *= (l_ulong)0xbf58476d1ce4e5b9;
+  key ^= key >> 27;
+  key *= (l_ulong)0x94d049bb133111eb;
+  key ^= key >> 31;
+  return key;
+}
+
+/* it is called by the master before other threads start, l_hash_seed also calls
+it at the first time for the programs without a master */
+L_EXTERN void
+l_hash_initSeed()
+{
+  l_ulong seed = 0;
+  FILE* f = 0;
+
+  if (l_hash_seed_inited) return;
+
+  if ((f = fopen("/dev/urandom", "rb")) != 0) {
+    if (fread(&seed, sizeof(seed), 1, f) != 1) seed = 0;
+    fclose(f);
+  }
+
+  if (seed == 0) { /* the address is randomized by aslr on most systems */
+    seed = l_hash_int((l_ulong)time(0), (l_ulong)clock());
+    seed = l_hash_int(seed, (l_ulong)(size_t)&seed);
+  }
+
+  l_hash_process_seed = seed;
+  l_hash_seed_inited = true;
+}
+
+L_EXTERN l_ulong
+l_hash_seed()
+{
+  if (!l_hash_seed_inited) l_hash_initSeed();
+  return l_hash_process_seed;
+}
+
+L_EXTERN l_ulong
+l_hash_strn(l_strn s)
+{
+  return l_hash_bytes(s.start, s.len, l_hash_seed());
+}
+
+static l_int
+l_hash_testBits(l_ulong x)
+{
+  l_int n = 0;
+  for (; x; x &= x - 1) ++n;
+  return n;
+}
+
+#if defined(L_BUILD_BENCH)
+static l_umedit
+l_hash_testFnv(const l_byte* p, l_int len)
+{
+  l_umedit hash = 2166136261U;
+  l_int i = 0;
+  for (; i < len; ++i) {
+    hash = (hash ^ p[i]) * 16777619U;
+  }
+  return hash;
+}
+
+static void
+l_hash_bench(l_ulong seed)
+{
+  l_byte buf[256];
+  l_ulong x = 0;
+  l_int i = 0, n = 0;
+  clock_t t0, t1, t2;
+
+  /* speed compared to fnv-1a for url length keys and a long buffer */
+  for (i = 0; i < 256; ++i) buf[i] = (l_byte)(i * 13 + 5);
+  t0 = clock();
+  for (n = 0; n < 200000; ++n) for (i = 8; i < 64; i += 8) x += l_hash_bytes(buf, i, seed);
+  t1 = clock();
+  for (n = 0; n < 200000; ++n) for (i = 8; i < 64; i += 8) x += l_hash_testFnv(buf, i);
+  t2 = clock();
+  l_logd_3("short keys x %d: hash %d us, fnv %d us", ld(200000 * 7),
+      ld((l_long)(t1 - t0) * 1000000 / CLOCKS_PER_SEC), ld((l_long)(t2 - t1) * 1000000 / CLOCKS_PER_SEC));
+
+  t0 = clock();
+  for (n = 0; n < 40000; ++n) x += l_hash_bytes(buf, 256, seed + n);
+  t1 = clock();
+  for (n = 0; n < 40000; ++n) x += l_hash_testFnv(buf, 256) + n;
+  t2 = clock();
+  l_logd_3("256-byte keys x %d: hash %d us, fnv %d us", ld(40000),
+      ld((l_long)(t1 - t0) * 1000000 / CLOCKS_PER_SEC), ld((l_long)(t2 - t1) * 1000000 / CLOCKS_PER_SEC));
+  l_assert(x != 0);
+}
+#endif
+
+L_EXTERN void
+l_hash_test()
+{
+  l_byte buf[256];
+  l_ulong h[257];
+  l_ulong seed = l_hash_seed(), x = 0;
+  l_umedit bucket[256];
+  l_umedit maxn = 0;
+  l_long flips = 0, nflip = 0;
+  l_int i = 0, j = 0, k = 0, n = 0;
+
+  for (i = 0; i < 256; ++i) buf[i] = (l_byte)(i * 7 + 1);
+
+  /* every length and every prefix hashes differently, and the hash depends on the seed */
+  for (i = 0; i <= 256; ++i) {
+    h[i] = l_hash_bytes(buf, i, seed);
+    for (j = 0; j < i; ++j) l_assert(h[i] != h[j]);
+    l_assert(h[i] == l_hash_bytes(buf, i, seed));
+    l_assert(h[i] != l_hash_bytes(buf, i, seed + 1));
+  }
+
+  l_assert(l_hash_strn(l_strn_literal("/index.html")) == l_hash_bytes("/index.html", 11, seed));
+
+  /* avalanche, a flipped input bit changes half of the output bits on average */
+  for (n = 1; n <= 100; n += 9) {
+    for (i = 0; i < n * 8; ++i) {
+      buf[i / 8] ^= (l_byte)(1 << (i % 8));
+      flips += l_hash_testBits(l_hash_bytes(buf, n, seed) ^ h[n]);
+      buf[i / 8] ^= (l_byte)(1 << (i % 8));
+      ++nflip;
+    }
+  }
+  l_logd_1("bytes avalanche %d/100 output bits changed", ld(flips * 100 / nflip));
+  l_assert(flips * 100 / nflip > 3000 && flips * 100 / nflip < 3400);
+
+  flips = nflip = 0;
+  for (x = 1; x < 1000; x += 37) {
+    for (i = 0; i < 64; ++i) {
+      flips += l_hash_testBits(l_hash_int(x, seed) ^ l_hash_int(x ^ ((l_ulong)1 << i), seed));
+      ++nflip;
+    }
+  }
+  l_logd_1("int avalanche %d/100 output bits changed", ld(flips * 100 / nflip));
+  l_assert(flips * 100 / nflip > 3000 && flips * 100 / nflip < 3400);
+
+  /* sequential keys spread over the buckets by the low bits */
+  l_zero_n(bucket, sizeof(bucket));
+  for (i = 0; i < 256 * 64; ++i) {
+    k = 0;
+    buf[k++] = '/';
+    for (j = i; j; j /= 10) buf[k++] = (l_byte)('0' + j % 10);
+    bucket[l_hash_bytes(buf, k, seed) & 255] += 1;
+  }
+  for (i = 0; i < 256; ++i) if (bucket[i] > maxn) maxn = bucket[i];
+  l_assert(maxn < 64 * 2);
+
+  l_zero_n(bucket, sizeof(bucket));
+  for (i = 0; i < 256 * 64; ++i) bucket[l_hash_int((l_ulong)i, seed) & 255] += 1;
+  for (i = 0, maxn = 0; i < 256; ++i) if (bucket[i] > maxn) maxn = bucket[i];
+  l_assert(maxn < 64 * 2);
+
+#if defined(L_BUILD_BENCH)
+  l_hash_bench(seed);
+#endif
+}
+
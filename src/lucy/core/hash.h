@@ -0,0 +1,21 @@
+#ifndef l_core_hash_h
+#define l_core_hash_h
+#include "core/base.h"
+
+/**
+ * seeded hash functions - the byte hash is of the wyhash family, it reads 4 or 8
+ * bytes at a time for short keys and mixes three 16-byte lanes for long keys. the
+ * integer hash is a 64-bit finalizer for ids and file descriptors. the process
+ * seed is random, so the hash values of request strings are not predictable
+ * from outside.
+ */
+
+L_EXTERN void l_hash_initSeed();
+L_EXTERN l_ulong l_hash_seed(); /* random per-process seed */
+L_EXTERN l_ulong l_hash_bytes(const void* p, l_int len, l_ulong seed);
+L_EXTERN l_ulong l_hash_strn(l_strn s); /* hash with the process seed */
+L_EXTERN l_ulong l_hash_int(l_ulong key, l_ulong seed);
+L_EXTERN void l_hash_test();
+
+#endif /* l_core_hash_h */
+
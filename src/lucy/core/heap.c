@@ -0,0 +1,262 @@
+#include <stddef.h>
+#define L_LIBRARY_IMPL
+#include "core/heap.h"
+
+/* item i has children 4i+1 ~ 4i+4 and parent (i-1)/4, a node and its children
+share one or two cache lines, and the tree is half as deep as a binary heap */
+
+#define L_MMHEAP_ARITY 4
+
+static l_umedit*
+l_mmheap_pos(l_mmheap* self, void* elem)
+{
+  return (l_umedit*)((l_byte*)elem + self->posoffset);
+}
+
+static void
+l_mmheap_place(l_mmheap* self, l_umedit i, l_heapitem item)
+{
+  self->a[i] = item;
+  *l_mmheap_pos(self, item.elem) = i;
+}
+
+/* move the hole at i up until the item fits, then put the item in it */
+static void
+l_mmheap_siftUp(l_mmheap* self, l_umedit i, l_heapitem item)
+{
+  l_umedit parent = 0;
+
+  while (i > 0) {
+    parent = (i - 1) / L_MMHEAP_ARITY;
+    if (self->a[parent].key <= item.key) break;
+    l_mmheap_place(self, i, self->a[parent]);
+    i = parent;
+  }
+
+  l_mmheap_place(self, i, item);
+}
+
+/* move the hole at i down to the least child until the item fits */
+static void
+l_mmheap_siftDown(l_mmheap* self, l_umedit i, l_heapitem item)
+{
+  l_heapitem* a = self->a;
+  l_umedit child = 0, least = 0, end = 0;
+
+  for (;;) {
+    child = i * L_MMHEAP_ARITY + 1;
+    if (child >= self->size) break;
+    end = child + L_MMHEAP_ARITY;
+    if (end > self->size) end = self->size;
+    for (least = child++; child < end; ++child) {
+      if (a[child].key < a[least].key) least = child;
+    }
+    if (item.key <= a[least].key) break;
+    l_mmheap_place(self, i, a[least]);
+    i = least;
+  }
+
+  l_mmheap_place(self, i, item);
+}
+
+L_EXTERN int
+l_mmheap_init(l_mmheap* self, l_int posoffset, l_umedit initsize)
+{
+  self->size = 0;
+  self->posoffset = posoffset;
+
+  if (initsize > L_MAX_RWSIZE / sizeof(l_heapitem)) {
+    self->a = 0;
+    self->capacity = 0;
+    l_loge_1("large %d", ld(initsize));
+    return false;
+  }
+
+  if (initsize < 8) initsize = 8;
+  self->a = (l_heapitem*)l_raw_malloc(sizeof(l_heapitem) * initsize);
+  self->capacity = self->a ? initsize : 0;
+  return self->a != 0;
+}
+
+L_EXTERN void
+l_mmheap_free(l_mmheap* self)
+{
+  l_umedit i = 0;
+
+  if (self->a == 0) return;
+
+  for (; i < self->size; ++i) {
+    *l_mmheap_pos(self, self->a[i].elem) = L_MMHEAP_NPOS;
+  }
+
+  l_raw_mfree(self->a);
+  self->a = 0;
+  self->size = self->capacity = 0;
+}
+
+L_EXTERN int
+l_mmheap_add(l_mmheap* self, void* elem, l_ulong key)
+{
+  l_heapitem item;
+  l_heapitem* a = 0;
+
+  if (elem == 0 || self->a == 0) {
+    l_loge_s("mmheap_add invalid argument");
+    return false;
+  }
+
+  if (self->size >= self->capacity) {
+    if (self->capacity > L_MAX_RWSIZE / sizeof(l_heapitem) / 2) {
+      l_loge_1("large %d", ld(self->capacity));
+      return false;
+    }
+    a = (l_heapitem*)l_raw_ralloc(self->a, sizeof(l_heapitem) * self->capacity, sizeof(l_heapitem) * self->capacity * 2);
+    if (a == 0) return false;
+    self->a = a;
+    self->capacity *= 2;
+  }
+
+  item.key = key;
+  item.elem = elem;
+  l_mmheap_siftUp(self, self->size++, item);
+  return true;
+}
+
+L_EXTERN void*
+l_mmheap_top(l_mmheap* self)
+{
+  return self->size ? self->a[0].elem : 0;
+}
+
+L_EXTERN l_ulong
+l_mmheap_topKey(l_mmheap* self)
+{
+  return self->size ? self->a[0].key : L_MAX_ULONG;
+}
+
+static void*
+l_mmheap_delAt(l_mmheap* self, l_umedit i)
+{
+  void* elem = self->a[i].elem;
+  l_heapitem last = self->a[--self->size];
+
+  *l_mmheap_pos(self, elem) = L_MMHEAP_NPOS;
+
+  if (i < self->size) { /* the last item fills the hole, it may need to go either way */
+    if (i > 0 && last.key < self->a[(i - 1) / L_MMHEAP_ARITY].key) {
+      l_mmheap_siftUp(self, i, last);
+    } else {
+      l_mmheap_siftDown(self, i, last);
+    }
+  }
+
+  return elem;
+}
+
+L_EXTERN void*
+l_mmheap_pop(l_mmheap* self)
+{
+  return self->size ? l_mmheap_delAt(self, 0) : 0;
+}
+
+L_EXTERN int
+l_mmheap_contains(l_mmheap* self, void* elem)
+{
+  l_umedit i = *l_mmheap_pos(self, elem);
+  return i < self->size && self->a[i].elem == elem;
+}
+
+L_EXTERN void
+l_mmheap_update(l_mmheap* self, void* elem, l_ulong key)
+{
+  l_umedit i = *l_mmheap_pos(self, elem);
+  l_heapitem item;
+
+  if (!l_mmheap_contains(self, elem)) {
+    l_loge_s("mmheap_update elem not in heap");
+    return;
+  }
+
+  item.elem = elem;
+  item.key = key;
+  if (key < self->a[i].key) {
+    l_mmheap_siftUp(self, i, item);
+  } else {
+    l_mmheap_siftDown(self, i, item);
+  }
+}
+
+L_EXTERN void*
+l_mmheap_del(l_mmheap* self, void* elem)
+{
+  if (!l_mmheap_contains(self, elem)) return 0;
+  return l_mmheap_delAt(self, *l_mmheap_pos(self, elem));
+}
+
+L_EXTERN l_umedit
+l_mmheap_size(l_mmheap* self)
+{
+  return self->size;
+}
+
+typedef struct {
+  l_ulong key;
+  l_umedit pos;
+} l_mmheap_testelem;
+
+static int
+l_mmheap_testCheck(l_mmheap* self)
+{
+  l_umedit i = 1;
+  for (; i < self->size; ++i) {
+    if (self->a[(i - 1) / L_MMHEAP_ARITY].key > self->a[i].key) return false;
+  }
+  for (i = 0; i < self->size; ++i) {
+    if (((l_mmheap_testelem*)self->a[i].elem)->pos != i) return false;
+  }
+  return true;
+}
+
+L_EXTERN void
+l_mmheap_test()
+{
+  l_mmheap heap;
+  l_mmheap_testelem e[500];
+  l_mmheap_testelem* p = 0;
+  l_ulong x = 12345, prev = 0;
+  l_umedit i = 0, n = 0;
+
+  l_assert(l_mmheap_init(&heap, (l_int)offsetof(l_mmheap_testelem, pos), 0));
+  l_assert(l_mmheap_pop(&heap) == 0 && l_mmheap_topKey(&heap) == L_MAX_ULONG);
+
+  for (i = 0; i < 500; ++i) {
+    x = x * (l_ulong)0x5851f42d4c957f2d + (l_ulong)0x14057b7ef767814f;
+    e[i].key = (x >> 33) % 1000; /* duplicated keys */
+    l_assert(l_mmheap_add(&heap, e + i, e[i].key));
+  }
+  l_assert(l_mmheap_size(&heap) == 500 && l_mmheap_testCheck(&heap));
+
+  for (i = 0; i < 500; i += 3) { /* decrease and increase keys */
+    e[i].key = (i & 1) ? e[i].key / 2 : e[i].key + 500;
+    l_mmheap_update(&heap, e + i, e[i].key);
+  }
+  l_assert(l_mmheap_testCheck(&heap));
+
+  for (i = 0; i < 500; i += 7) { /* remove from the middle */
+    l_assert(l_mmheap_del(&heap, e + i) == e + i);
+    l_assert(e[i].pos == L_MMHEAP_NPOS && !l_mmheap_contains(&heap, e + i));
+    l_assert(l_mmheap_del(&heap, e + i) == 0);
+    ++n;
+  }
+  l_assert(l_mmheap_size(&heap) == 500 - n && l_mmheap_testCheck(&heap));
+
+  for (prev = 0, n = 0; (p = (l_mmheap_testelem*)l_mmheap_top(&heap)); ++n) {
+    l_assert(l_mmheap_topKey(&heap) == p->key);
+    l_assert(l_mmheap_pop(&heap) == p && p->key >= prev);
+    prev = p->key;
+  }
+  l_assert(n == 500 - 72 && l_mmheap_size(&heap) == 0);
+
+  l_mmheap_free(&heap);
+}
+
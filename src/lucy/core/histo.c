@@ -0,0 +1,160 @@
+#define L_LIBRARY_IMPL
+#include "core/histo.h"
+
+#define L_HISTO_SUB (1 << L_HISTO_SUBBITS)
+
+static int /* the index of the highest set bit, value is not 0 */
+l_histo_log2(l_ulong value)
+{
+  int n = 0;
+  if (value >> 32) { value >>= 32; n += 32; }
+  if (value >> 16) { value >>= 16; n += 16; }
+  if (value >> 8) { value >>= 8; n += 8; }
+  if (value >> 4) { value >>= 4; n += 4; }
+  if (value >> 2) { value >>= 2; n += 2; }
+  if (value >> 1) { n += 1; }
+  return n;
+}
+
+static l_umedit
+l_histo_index(l_ulong value)
+{
+  int mag = 0;
+
+  if (value < L_HISTO_SUB) {
+    return (l_umedit)value;
+  }
+
+  mag = l_histo_log2(value);
+  if (mag >= L_HISTO_MAXBITS) {
+    return L_HISTO_NBUCKET - 1;
+  }
+
+  /* the highest bit is at mag, the next L_HISTO_SUBBITS bits select the sub bucket */
+  return (l_umedit)(((mag - L_HISTO_SUBBITS + 1) << L_HISTO_SUBBITS) + ((value >> (mag - L_HISTO_SUBBITS)) & (L_HISTO_SUB - 1)));
+}
+
+static l_ulong /* the highest value counted in the bucket */
+l_histo_upper(l_umedit i)
+{
+  int mag = 0;
+  l_ulong sub = 0;
+
+  if (i < L_HISTO_SUB) {
+    return i;
+  }
+
+  mag = (int)(i >> L_HISTO_SUBBITS) + L_HISTO_SUBBITS - 1;
+  sub = i & (L_HISTO_SUB - 1);
+  return ((L_HISTO_SUB + sub + 1) << (mag - L_HISTO_SUBBITS)) - 1;
+}
+
+L_EXTERN void
+l_histo_init(l_histo* self)
+{
+  l_zero_n(self, sizeof(l_histo));
+  self->min = L_MAX_ULONG;
+}
+
+L_EXTERN void
+l_histo_record(l_histo* self, l_ulong value)
+{
+  self->bucket[l_histo_index(value)] += 1;
+  self->count += 1;
+  self->sum += value;
+  if (value < self->min) self->min = value;
+  if (value > self->max) self->max = value;
+}
+
+L_EXTERN void
+l_histo_merge(l_histo* self, const l_histo* other)
+{
+  l_umedit i = 0;
+
+  for (; i < L_HISTO_NBUCKET; ++i) {
+    self->bucket[i] += other->bucket[i];
+  }
+
+  self->count += other->count;
+  self->sum += other->sum;
+  if (other->min < self->min) self->min = other->min;
+  if (other->max > self->max) self->max = other->max;
+}
+
+L_EXTERN l_ulong
+l_histo_percentile(const l_histo* self, l_umedit permille)
+{
+  l_ulong rank = 0, n = 0, value = 0;
+  l_umedit i = 0;
+
+  if (self->count == 0) {
+    return 0;
+  }
+
+  if (permille >= 1000) {
+    return self->max;
+  }
+
+  rank = (self->count * permille + 999) / 1000; /* the rank of the value, from 1 */
+  if (rank == 0) rank = 1;
+
+  for (; i < L_HISTO_NBUCKET; ++i) {
+    if ((n += self->bucket[i]) >= rank) break;
+  }
+
+  value = l_histo_upper(i);
+  if (value > self->max) value = self->max;
+  if (value < self->min) value = self->min;
+  return value;
+}
+
+L_EXTERN l_ulong
+l_histo_mean(const l_histo* self)
+{
+  return self->count ? self->sum / self->count : 0;
+}
+
+L_EXTERN void
+l_histo_test()
+{
+  l_histo a, b;
+  l_ulong v = 0, p = 0;
+  l_umedit i = 0;
+
+  l_assert(L_HISTO_NBUCKET == 592);
+  for (v = 0; v < 32; ++v) { /* small values are exact */
+    l_assert(l_histo_upper(l_histo_index(v)) == v);
+  }
+  for (v = 32; v < 100000; v = v * 3 / 2 + 7) { /* a value is in its bucket and the bucket is in 1/16 */
+    i = l_histo_index(v);
+    l_assert(v <= l_histo_upper(i) && v > l_histo_upper(i - 1));
+    l_assert((l_histo_upper(i) - l_histo_upper(i - 1)) * 16 <= v);
+  }
+  l_assert(l_histo_index((l_ulong)1 << 40) == L_HISTO_NBUCKET - 1);
+  l_assert(l_histo_index(L_MAX_ULONG) == L_HISTO_NBUCKET - 1);
+  l_assert(l_histo_index(((l_ulong)1 << 40) - 1) == L_HISTO_NBUCKET - 1);
+
+  l_histo_init(&a);
+  l_histo_init(&b);
+  l_assert(l_histo_percentile(&a, 500) == 0 && l_histo_mean(&a) == 0);
+
+  for (v = 1; v <= 100000; ++v) {
+    l_histo_record((v & 1) ? &a : &b, v);
+  }
+
+  l_histo_merge(&a, &b);
+  l_assert(a.count == 100000 && a.min == 1 && a.max == 100000);
+  l_assert(l_histo_mean(&a) == 50000);
+
+  p = l_histo_percentile(&a, 500);
+  l_assert(p >= 50000 && p <= 50000 + 50000 / 16);
+  p = l_histo_percentile(&a, 990);
+  l_assert(p >= 99000 && p <= 100000);
+  l_assert(l_histo_percentile(&a, 0) == 1);
+  l_assert(l_histo_percentile(&a, 1000) == 100000);
+
+  l_histo_init(&b);
+  l_histo_record(&b, 7);
+  l_assert(l_histo_percentile(&b, 500) == 7 && l_histo_percentile(&b, 999) == 7);
+}
+
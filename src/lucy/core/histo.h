@@ -0,0 +1,33 @@
+#ifndef l_core_histo_h
+#define l_core_histo_h
+#include "core/base.h"
+
+/**
+ * latency histogram - log-linear buckets as HDR histograms do, each power of two
+ * range is split into 16 equal buckets, so a recorded value is kept with 1/16
+ * relative precision and values under 32 are exact. values from 2^40 up (about
+ * 18 minutes in nanoseconds) are counted in the last bucket. the buckets are
+ * plain counters, histograms of different threads are merged by adding them.
+ */
+
+#define L_HISTO_SUBBITS 4
+#define L_HISTO_MAXBITS 40
+#define L_HISTO_NBUCKET ((L_HISTO_MAXBITS - (L_HISTO_SUBBITS - 1)) << L_HISTO_SUBBITS)
+
+typedef struct {
+  l_ulong count;
+  l_ulong sum;
+  l_ulong min;
+  l_ulong max;
+  l_ulong bucket[L_HISTO_NBUCKET];
+} l_histo;
+
+L_EXTERN void l_histo_init(l_histo* self);
+L_EXTERN void l_histo_record(l_histo* self, l_ulong value);
+L_EXTERN void l_histo_merge(l_histo* self, const l_histo* other);
+L_EXTERN l_ulong l_histo_percentile(const l_histo* self, l_umedit permille); /* 500 is the median, 999 is p99.9 */
+L_EXTERN l_ulong l_histo_mean(const l_histo* self);
+L_EXTERN void l_histo_test();
+
+#endif /* l_core_histo_h */
+
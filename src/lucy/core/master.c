@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <errno.h>
 
 #define L_LIBRARY_IMPL
 #define l_buffer_ptr(b) ((L_BUFHEAD*)b->p)
@@ -25,6 +26,9 @@
 #include "core/state.h"
 #include "core/queue.h"
 #include "core/string.h"
+#include "core/hash.h"
+#include "core/table.h"
+#include "core/atomic.h"
 #include "core/fileop.h"
 #include "core/socket.h"
 #include "core/thread.h"
@@ -39,6 +43,19 @@ typedef struct {
   int service_table_size;
   l_int log_buffer_size;
   l_int thread_max_free_memory;
+  l_int mailbox_depth;
+  l_int inbox_control_weight;
+  l_int inbox_data_weight;
+  int message_tracing;
+  l_int loop_stats_interval;
+  l_int io_budget;
+  l_int io_budget_calls;
+  l_int pool_max_idle;
+  l_int pool_max_conns;
+  l_int pool_idle_timeout;
+  l_int pool_lifetime;
+  l_int rx_slab_size;
+  l_int rx_slab_max_free;
   l_byte logfile[FILENAME_MAX+1];
   l_byte* prefixend;
   lua_State* L;
@@ -87,6 +104,71 @@ l_config_create()
     conf->thread_max_free_memory = 1024;
   }
 
+  conf->mailbox_depth = l_luaconf_int(conf->L, "mailbox_depth");
+  if (conf->mailbox_depth <= 0) {
+    conf->mailbox_depth = 1024;
+  }
+  else if (conf->mailbox_depth > L_MAX_RWSIZE) {
+    conf->mailbox_depth = L_MAX_RWSIZE;
+  }
+
+  conf->inbox_control_weight = l_luaconf_int(conf->L, "inbox_control_weight");
+  if (conf->inbox_control_weight <= 0) {
+    conf->inbox_control_weight = 32;
+  }
+
+  conf->inbox_data_weight = l_luaconf_int(conf->L, "inbox_data_weight");
+  if (conf->inbox_data_weight <= 0) {
+    conf->inbox_data_weight = 128;
+  }
+
+  conf->message_tracing = l_luaconf_int(conf->L, "message_tracing") != 0;
+
+  conf->loop_stats_interval = l_luaconf_int(conf->L, "loop_stats_interval");
+  if (conf->loop_stats_interval < 0) {
+    conf->loop_stats_interval = 0;
+  }
+
+  conf->io_budget = l_luaconf_int(conf->L, "io_budget");
+  if (conf->io_budget <= 0) {
+    conf->io_budget = 256 * 1024;
+  }
+
+  conf->io_budget_calls = l_luaconf_int(conf->L, "io_budget_calls");
+  if (conf->io_budget_calls <= 0) {
+    conf->io_budget_calls = 64;
+  }
+
+  conf->pool_max_idle = l_luaconf_int(conf->L, "pool_max_idle");
+  if (conf->pool_max_idle <= 0) {
+    conf->pool_max_idle = 8;
+  }
+
+  conf->pool_max_conns = l_luaconf_int(conf->L, "pool_max_conns");
+  if (conf->pool_max_conns < 0) {
+    conf->pool_max_conns = 0;
+  }
+
+  conf->pool_idle_timeout = l_luaconf_int(conf->L, "pool_idle_timeout");
+  if (conf->pool_idle_timeout <= 0) {
+    conf->pool_idle_timeout = 30000;
+  }
+
+  conf->pool_lifetime = l_luaconf_int(conf->L, "pool_lifetime");
+  if (conf->pool_lifetime < 0) {
+    conf->pool_lifetime = 0;
+  }
+
+  conf->rx_slab_size = l_luaconf_int(conf->L, "rx_slab_size");
+  if (conf->rx_slab_size <= 0) {
+    conf->rx_slab_size = 16 * 1024;
+  }
+
+  conf->rx_slab_max_free = l_luaconf_int(conf->L, "rx_slab_max_free");
+  if (conf->rx_slab_max_free <= 0) {
+    conf->rx_slab_max_free = 64;
+  }
+
   if (!l_luaconf_str(conf->L, l_set_logfile_prefix, conf, "logfile_prefix")) {
     /* if get from config file failed, set the default name prefix */
     l_set_logfile_prefix(conf, l_strn_literal("logcat"));
@@ -128,18 +210,27 @@ typedef struct {
   l_squeue qa;
   l_squeue qb;
   l_squeue qc;
+  l_squeue qd;
   l_freebq frbq;
 } l_thrblock;
 
+#define L_THREAD_MAX_GRANT 16
+
+typedef struct {
+  l_ulong from; /* the l_message from field of the handled messages */
+  l_umedit n;
+} l_creditgrant;
+
 typedef struct l_thread {
-  l_linknode node;
+  l_umedit poolpos; /* position in the thread pool */
   l_umedit weight;
   l_ushort index;
   /* shared with master */
   l_mutex* svmtx;
   l_mutex* mutex;
   l_condv* condv;
-  l_squeue* rxmq;
+  l_squeue* rxmq; /* data lane */
+  l_squeue* rxcq; /* control lane */
   int msgwait;
   /* thread own use */
   lua_State* L;
@@ -151,8 +242,30 @@ typedef struct l_thread {
   l_thrid id;
   int (*start)();
   l_thrblock* block;
+  l_hashtable* credit; /* destinations this thread has sent credited messages to */
+  l_hashtable* topic; /* topics the services of this thread subscribed to */
+  l_hashtable* stats; /* message latency histograms by msgid, add is guarded by svmtx */
+  l_creditgrant grant[L_THREAD_MAX_GRANT]; /* credit to grant back for handled messages */
+  int ngrant;
+  l_loopstat loop; /* only written by the thread itself */
+  l_ulong lastwake;
+  l_int iobytes; /* io budget left for the message being handled */
+  l_int iocalls;
+  l_hashtable* pool; /* outbound connection pool by remote address and socket options */
+  l_poolconn* connecting; /* pool connects in progress */
+  l_poolconn* detaching; /* returned connections waiting master to take them out of the event manager */
+  l_rxslab* rxslab; /* free receive slabs */
+  l_umedit nrxslab;
+  l_message* dgmsg; /* the datagram receive message, reused for each read event */
+  l_int dgcap;
 } l_thread;
 
+typedef struct {
+  l_umedit svid; /* destination service */
+  l_umedit inflight; /* messages sent to the destination and not granted back yet */
+  l_squeue parked; /* messages waiting for credit, their from field is the waiting service id */
+} l_credit;
+
 L_GLOBAL l_thrkey l_thrkey_g;
 L_THREAD_LOCAL(l_thread* l_self_thread);
 
@@ -161,6 +274,23 @@ L_GLOBAL l_thread l_master_thread;
 L_GLOBAL int l_num_workers;
 L_GLOBAL l_thread* l_worker_thread;
 L_GLOBAL l_priorq l_thread_pool;
+L_GLOBAL l_umedit l_mailbox_depth = 1024;
+L_GLOBAL l_int l_inbox_control_weight = 32;
+L_GLOBAL l_int l_inbox_data_weight = 128;
+L_GLOBAL int l_msg_tracing;
+L_GLOBAL l_int l_io_budget = 256 * 1024; /* bytes and io calls a service can spend in one dispatch */
+L_GLOBAL l_int l_io_budget_calls = 64;
+L_GLOBAL l_umedit l_pool_max_idle = 8; /* idle connections kept for each pool key */
+L_GLOBAL l_umedit l_pool_max_conns; /* connections of each pool key, 0 is no limit */
+L_GLOBAL l_ulong l_pool_idle_timeout = 30000; /* ms an idle connection can be reused in */
+L_GLOBAL l_ulong l_pool_lifetime; /* ms a connection can be reused in since connected, 0 is no limit */
+L_GLOBAL l_int l_rx_slab_size = 16 * 1024; /* data size of a pooled receive slab */
+L_GLOBAL l_umedit l_rx_slab_max_free = 64; /* free receive slabs a thread keeps */
+L_GLOBAL l_ulong l_loop_interval; /* ms between loop snapshots, 0 is off */
+L_GLOBAL l_ulong l_loop_nextms; /* only accessed by master */
+L_GLOBAL l_ulong l_loop_snapms;
+L_GLOBAL l_loopstat* l_loop_snap; /* the snapshot of master and workers */
+L_GLOBAL l_mutex l_loop_mtx;
 
 static l_thread*
 l_thread_self()
@@ -178,6 +308,12 @@ l_thread_master()
   return &l_master_thread;
 }
 
+static void
+l_loopstat_add(l_ulong* counter, l_ulong n)
+{
+  l_atomic_storeRelaxed(counter, *counter + n); /* the owner thread is the only writer */
+}
+
 static void
 l_thread_lock(l_thread* self)
 {
@@ -191,6 +327,7 @@ l_thread_unlock(l_thread* self)
 }
 
 L_PRIVAT l_byte* l_string_print_ulong(l_ulong n, l_byte* p);
+L_PRIVAT l_time l_monotonic_time();
 L_PRIVAT void l_string_initLog(l_string* log, l_int limit, l_thread* hint);
 
 static void
@@ -282,6 +419,16 @@ l_thread_init(l_thread* t, l_config* conf)
 
   t->weight = 0;
   t->msgwait = 0;
+  t->credit = 0;
+  t->topic = 0;
+  t->stats = 0;
+  t->ngrant = 0;
+  l_zero_n(&t->loop, sizeof(l_loopstat));
+  t->lastwake = 0;
+  t->rxslab = 0;
+  t->nrxslab = 0;
+  t->dgmsg = 0;
+  t->dgcap = 0;
 
   t->block = l_raw_malloc(sizeof(l_thrblock));
   b = t->block;
@@ -296,7 +443,9 @@ l_thread_init(l_thread* t, l_config* conf)
   t->rxmq = &b->qa;
   t->txmq = &b->qb;
   t->txms = &b->qc;
+  t->rxcq = &b->qd;
   l_squeue_init(t->rxmq);
+  l_squeue_init(t->rxcq);
   l_squeue_init(t->txmq);
   l_squeue_init(t->txms);
 
@@ -308,9 +457,62 @@ l_thread_init(l_thread* t, l_config* conf)
   l_thread_initLog(t, conf);
 }
 
+static void
+l_thread_freeParked(void* obj, void* elem)
+{
+  l_smplnode* node = 0;
+  (void)obj;
+  while ((node = l_squeue_pop(&((l_credit*)elem)->parked))) {
+    l_raw_mfree(node);
+  }
+}
+
+typedef struct {
+  l_umedit topic;
+  l_umedit n; /* number of subscribers */
+  l_umedit cap;
+  l_umedit holes; /* unsubscribed while delivering, compacted after that */
+  int busy; /* delivering a publish to the subscribers */
+  l_service** srvc;
+} l_topicsub;
+
+static void
+l_thread_freeSubs(void* obj, void* elem)
+{
+  l_topicsub* sub = (l_topicsub*)elem;
+  (void)obj;
+  if (sub->srvc) {
+    l_raw_mfree(sub->srvc);
+    sub->srvc = 0;
+  }
+}
+
+struct l_poolhost {
+  l_sockaddr addr;
+  l_sockopts opts;
+  l_umedit nconn; /* idle, checked out, connecting and detaching */
+  l_umedit nidle;
+  l_poolconn* idle; /* the most recently returned first */
+};
+
+static void
+l_thread_freePool(void* obj, void* elem)
+{
+  l_poolhost* host = (l_poolhost*)elem;
+  l_poolconn* conn = 0;
+  (void)obj;
+  while ((conn = host->idle)) {
+    host->idle = conn->next;
+    l_socket_close(&conn->sock);
+    l_raw_mfree(conn);
+  }
+}
+
 static void
 l_thread_free(l_thread* t)
 {
+  l_poolconn* conn = 0;
+  l_rxslab* slab = 0;
   l_smplnode* node = 0;
   l_squeue* frbq = 0;
   l_squeue msgq;
@@ -323,6 +525,7 @@ l_thread_free(l_thread* t)
 
   l_thread_lock(t);
   l_squeue_pushQueue(&msgq, t->rxmq);
+  l_squeue_pushQueue(&msgq, t->rxcq);
   l_thread_unlock(t);
 
   l_squeue_pushQueue(&msgq, t->txmq);
@@ -332,6 +535,59 @@ l_thread_free(l_thread* t)
     l_raw_mfree(node);
   }
 
+  /* free credit ledger and its parked messages */
+
+  if (t->credit) {
+    l_hashtable_foreach(t->credit, l_thread_freeParked, 0);
+    l_hashtable_free(&t->credit, l_raw_alloc_func);
+  }
+
+  /* free topic subscriptions */
+
+  if (t->topic) {
+    l_hashtable_foreach(t->topic, l_thread_freeSubs, 0);
+    l_hashtable_free(&t->topic, l_raw_alloc_func);
+  }
+
+  /* free message stats */
+
+  l_hashtable_free(&t->stats, l_raw_alloc_func);
+
+  /* free connection pool, the connections checked out are owned by the services */
+
+  if (t->pool) {
+    l_hashtable_foreach(t->pool, l_thread_freePool, 0);
+    l_hashtable_free(&t->pool, l_raw_alloc_func);
+  }
+
+  while ((conn = t->connecting)) {
+    t->connecting = conn->next;
+    l_socket_close(&conn->sock);
+    l_raw_mfree(conn);
+  }
+
+  while ((conn = t->detaching)) {
+    t->detaching = conn->next;
+    l_socket_close(&conn->sock);
+    l_raw_mfree(conn);
+  }
+
+  /* free receive slabs, the slabs in use are owned by the services */
+
+  while ((slab = t->rxslab)) {
+    t->rxslab = slab->next;
+    l_raw_mfree(slab);
+  }
+  t->nrxslab = 0;
+
+  /* free datagram receive message */
+
+  if (t->dgmsg) {
+    l_raw_mfree(t->dgmsg);
+    t->dgmsg = 0;
+  }
+  t->dgcap = 0;
+
   /* free all buffers */
 
   frbq = &t->freebq->queue;
@@ -489,13 +745,13 @@ l_thread_acquire()
 {
   l_thread* thread = 0;
 
-  thread = (l_thread*)l_priorq_pop(&l_thread_pool);
+  thread = (l_thread*)l_priorq_top(&l_thread_pool);
   if (!thread) {
     return 0;
   }
 
   thread->weight += 1;
-  l_priorq_push(&l_thread_pool, &thread->node);
+  l_priorq_update(&l_thread_pool, thread, thread->weight);
   return thread;
 }
 
@@ -507,8 +763,7 @@ l_thread_acquireSpecific(l_thread* thread)
   }
 
   thread->weight += 1;
-  l_priorq_remove(&l_thread_pool, &thread->node);
-  l_priorq_push(&l_thread_pool, &thread->node);
+  l_priorq_update(&l_thread_pool, thread, thread->weight);
 }
 
 static void
@@ -519,8 +774,7 @@ l_thread_release(l_thread* thread)
   }
 
   thread->weight -= 1;
-  l_priorq_remove(&l_thread_pool, &thread->node);
-  l_priorq_push(&l_thread_pool, &thread->node);
+  l_priorq_update(&l_thread_pool, thread, thread->weight);
 }
 
 /**
@@ -535,6 +789,9 @@ l_thread_release(l_thread* thread)
 #define L_MSGID_SRVC_CLOSE_REQ  0x12
 #define L_MSGID_SRVC_DEL_EVENT  0x13
 #define L_MSGID_SRVC_ADD_EVENT  0x14
+#define L_MSGID_SRVC_ADD_TIMER  0x15
+#define L_MSGID_SRVC_DETACH_EVENT 0x16
+#define L_MSGID_SRVC_DEL_TIMER  0x17
 #define L_MSGID_MAX_MASTER_MSG  0x80
 #define L_MSGID_START_BOOTSTRAP 0x81
 #define L_MSGID_MASTER_EXIT_REQ 0x08
@@ -543,12 +800,21 @@ l_thread_release(l_thread* thread)
 #define L_MSGID_SOCK_EVENT_IND  0x84
 #define L_MSGID_SOCK_CONN_RSP   0x85
 #define L_MSGID_SOCK_CONN_IND   0x86
+#define L_MSGID_CREDIT_GRANT    0x87
+#define L_MSGID_TOPIC_PUBLISH   0x88
+#define L_MSGID_CALL_REPLY      0x89
+#define L_MSGID_CALL_TIMEOUT    0x8a
+#define L_MSGID_ACCEPT_CONN     0x8b
+#define L_MSGID_ACCEPT_READY    0x8c
+#define L_MSGID_POOL_CONN_RSP   0x8d
+#define L_MSGID_POOL_DETACH_RSP 0x8e
 #define L_MESSAGE_START_ID      0xffff+1
 
 #define L_SERVICE_MASTER    0x00
 #define L_SERVICE_WORKER    0x01
 #define L_SERVICE_BOOTSTRAP 0x02
 #define L_SERVICE_START_ID  0xffff+1
+#define L_SERVICE_POOL      0x8000 /* event udata of a pool connect, or'ed with the thread index */
 
 L_GLOBAL l_squeue l_msg_rxq;
 L_GLOBAL l_mutex l_msg_mtx;
@@ -557,8 +823,12 @@ L_GLOBAL l_eventmgr l_eventmgr_g;
 static void
 l_master_wakeup()
 {
+  l_thread* thread = 0;
+
   /* wakeup master to handle the message */
-  l_eventmgr_wakeup(&l_eventmgr_g);
+  if (l_eventmgr_wakeup(&l_eventmgr_g) == -3 && (thread = l_thread_self())) {
+    l_loopstat_add(&thread->loop.coalesced, 1);
+  }
 }
 
 L_EXTERN l_message*
@@ -594,28 +864,237 @@ l_message_freeQueue(l_squeue* mq, l_thread* hint)
   }
 }
 
-static void /* send message to dest service from current thread */
-l_message_send_impl(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg)
+static void
+l_message_fill(l_message* msg, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64)
 {
   msg->dest = destid;
   msg->msgid = msgid;
   msg->data = u32;
   msg->extra = u64;
+  msg->lane = msgid < L_MESSAGE_START_ID ? L_MSGLANE_CONTROL : L_MSGLANE_DATA; /* internal messages are control */
+  msg->call = 0;
+}
+
+/**
+ * message tracing
+ */
+
+typedef struct {
+  l_umedit msgid;
+  l_histo h[3]; /* L_MSGSTAT_ROUTE, L_MSGSTAT_INBOX and L_MSGSTAT_HANDLE */
+} l_msgstat;
+
+static l_ulong
+l_message_nowns()
+{
+  l_time t = l_monotonic_time();
+  return (l_ulong)t.sec * 1000000000 + t.nsec;
+}
+
+L_EXTERN void
+l_message_setTracing(int enable)
+{
+  l_msg_tracing = enable;
+}
+
+static int
+l_msgstat_check(void* obj, void* elem)
+{
+  return ((l_msgstat*)elem)->msgid == *(l_umedit*)obj;
+}
+
+static l_msgstat*
+l_msgstat_find(l_thread* thread, l_umedit msgid)
+{
+  if (!thread->stats) return 0;
+  return (l_msgstat*)l_hashtable_find(thread->stats, (l_umedit)l_hash_int(msgid, l_hash_seed()), l_msgstat_check, &msgid);
+}
+
+static void /* record the latencies of the message handled by current thread */
+l_thread_traceMessage(l_thread* thread, l_message* msg, l_ulong start, l_ulong end)
+{
+  l_msgstat* stat = 0;
+  int i = 0;
+
+  if (!(stat = l_msgstat_find(thread, msg->msgid))) {
+    if (!(stat = (l_msgstat*)l_raw_malloc(sizeof(l_msgstat)))) {
+      return;
+    }
+    stat->msgid = msg->msgid;
+    for (; i < 3; ++i) {
+      l_histo_init(stat->h + i);
+    }
+    l_mutex_lock(thread->svmtx);
+    if (!thread->stats) thread->stats = l_hashtable_create(4);
+    if (!thread->stats || !l_hashtable_add(thread->stats, stat, (l_umedit)l_hash_int(stat->msgid, l_hash_seed()))) {
+      l_raw_mfree(stat);
+      stat = 0;
+    }
+    l_mutex_unlock(thread->svmtx);
+    if (!stat) return;
+  }
+
+  l_histo_record(stat->h + L_MSGSTAT_ROUTE, msg->troute > msg->tsend ? msg->troute - msg->tsend : 0);
+  l_histo_record(stat->h + L_MSGSTAT_INBOX, start > msg->troute ? start - msg->troute : 0);
+  l_histo_record(stat->h + L_MSGSTAT_HANDLE, end - start);
+}
+
+static int
+l_thread_mergeStats(l_thread* thread, l_umedit msgid, int which, l_histo* out)
+{
+  l_msgstat* stat = 0;
+
+  if (!thread->block) return false;
+
+  l_mutex_lock(thread->svmtx);
+  if ((stat = l_msgstat_find(thread, msgid))) {
+    l_histo_merge(out, stat->h + which); /* the counters are approximate as the thread is running */
+  }
+  l_mutex_unlock(thread->svmtx);
+  return stat != 0;
+}
+
+L_EXTERN int
+l_message_stats(l_umedit msgid, int which, l_histo* out)
+{
+  int found = false;
+  int i = 0;
+
+  l_histo_init(out);
+  if (which < L_MSGSTAT_ROUTE || which > L_MSGSTAT_HANDLE) {
+    return false;
+  }
+
+  found = l_thread_mergeStats(l_thread_master(), msgid, which, out);
+  for (; i < l_num_workers; ++i) {
+    if (l_thread_mergeStats(l_worker_thread + i, msgid, which, out)) {
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+/**
+ * loop counters
+ */
+
+static l_ulong /* return the time the wait begins */
+l_thread_waitBegin(l_thread* thread)
+{
+  l_ulong now = l_message_nowns();
+  if (thread->lastwake) {
+    l_loopstat_add(&thread->loop.busyns, now - thread->lastwake);
+  }
+  return now;
+}
+
+static void
+l_thread_waitEnd(l_thread* thread, l_ulong start)
+{
+  l_ulong now = l_message_nowns();
+  l_loopstat_add(&thread->loop.waits, 1);
+  l_loopstat_add(&thread->loop.blockedns, now - start);
+  thread->lastwake = now;
+}
+
+static void
+l_thread_readLoop(l_thread* thread, l_loopstat* out)
+{
+  l_loopstat* loop = &thread->loop;
+  out->loops = l_atomic_loadRelaxed(&loop->loops);
+  out->waits = l_atomic_loadRelaxed(&loop->waits);
+  out->events = l_atomic_loadRelaxed(&loop->events);
+  out->messages = l_atomic_loadRelaxed(&loop->messages);
+  out->coalesced = l_atomic_loadRelaxed(&loop->coalesced);
+  out->signals = l_atomic_loadRelaxed(&loop->signals);
+  out->blockedns = l_atomic_loadRelaxed(&loop->blockedns);
+  out->busyns = l_atomic_loadRelaxed(&loop->busyns);
+}
+
+L_EXTERN int
+l_loopstat_threads()
+{
+  return 1 + l_num_workers;
+}
+
+L_EXTERN int
+l_loopstat_get(int index, l_loopstat* out)
+{
+  if (index < 0 || index > l_num_workers) {
+    l_zero_n(out, sizeof(l_loopstat));
+    return false;
+  }
+  l_thread_readLoop(index == 0 ? l_thread_master() : l_worker_thread + index - 1, out);
+  return true;
+}
+
+L_EXTERN l_ulong
+l_loopstat_snapshot(l_loopstat* out, int n)
+{
+  l_ulong ms = 0;
 
-  if (from->index != 0 && l_msg_dest_tidx(msg) == from->index) {
+  if (n > 1 + l_num_workers) {
+    n = 1 + l_num_workers;
+  }
+
+  l_mutex_lock(&l_loop_mtx);
+  if ((ms = l_loop_snapms)) {
+    l_copy_n(l_loop_snap, sizeof(l_loopstat) * n, out);
+  }
+  l_mutex_unlock(&l_loop_mtx);
+  return ms;
+}
+
+static void
+l_master_snapshotLoops(l_ulong nowms)
+{
+  l_loopstat* s = 0;
+  int i = 0;
+
+  l_mutex_lock(&l_loop_mtx);
+  for (; i <= l_num_workers; ++i) {
+    s = l_loop_snap + i;
+    l_loopstat_get(i, s);
+    l_logm_9("loop T%d loops %d waits %d events %d messages %d coalesced %d signals %d blocked %dms busy %dms",
+        ld(i), ld(s->loops), ld(s->waits), ld(s->events), ld(s->messages), ld(s->coalesced), ld(s->signals), ld(s->blockedns / 1000000), ld(s->busyns / 1000000));
+  }
+  l_loop_snapms = nowms;
+  l_mutex_unlock(&l_loop_mtx);
+}
+
+static void /* queue the filled message to its dest service from current thread */
+l_message_post(l_thread* from, l_message* msg)
+{
+  msg->tsend = l_msg_tracing ? l_message_nowns() : 0;
+  msg->troute = 0;
+
+  /* only the worker service of current thread can be resolved here, a custom
+  service has to be found in the service table by master even if it is on the
+  same thread */
+  if (from->index != 0 && l_msg_dest_tidx(msg) == from->index && l_msg_dest_svid(msg) == L_SERVICE_WORKER) {
+    msg->dest = L_SERVICE_WORKER; /* the same as master routes it */
     l_thread_lock(from);
-    l_squeue_push(from->rxmq, &msg->HEAD.node);
+    l_squeue_push(msg->lane == L_MSGLANE_CONTROL ? from->rxcq : from->rxmq, &msg->HEAD.node);
     l_thread_unlock(from);
     return;
   }
 
-  if ((msgid > L_MSGID_MIN_MASTER_MSG && msgid < L_MSGID_MAX_MASTER_MSG) || l_msg_dest_svid(msg) == 0) {
+  if ((msg->msgid > L_MSGID_MIN_MASTER_MSG && msg->msgid < L_MSGID_MAX_MASTER_MSG) || l_msg_dest_svid(msg) == 0) {
     l_squeue_push(from->txms, &msg->HEAD.node);
   } else {
     l_squeue_push(from->txmq, &msg->HEAD.node);
   }
 }
 
+static void /* send message to dest service from current thread */
+l_message_send_impl(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg)
+{
+  l_message_fill(msg, destid, msgid, u32, u64);
+  msg->from = 0;
+  l_message_post(from, msg);
+}
+
 static void /* worker flush messages to global in worker thread */
 l_worker_flushMessages(l_thread* self)
 {
@@ -660,6 +1139,15 @@ l_message_send(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_u
   l_message_send_impl(from, destid, msgid + L_MESSAGE_START_ID, u32, u64, msg);
 }
 
+L_EXTERN void
+l_message_sendLane(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg, l_umedit lane)
+{
+  l_message_fill(msg, destid, msgid + L_MESSAGE_START_ID, u32, u64);
+  msg->from = 0;
+  msg->lane = lane == L_MSGLANE_CONTROL ? L_MSGLANE_CONTROL : L_MSGLANE_DATA;
+  l_message_post(from, msg);
+}
+
 static void
 l_message_senddata_impl(l_thread* thread, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64)
 {
@@ -673,66 +1161,241 @@ l_message_sendData(l_thread* thread, l_ulong destid, l_umedit msgid, l_umedit u3
   l_message_senddata_impl(thread, destid, msgid + L_MESSAGE_START_ID, u32, u64);
 }
 
-static void
-l_message_sendtomaster_impl(l_thread* thread, l_umedit msgid, l_umedit u32, l_ulong u64)
+/**
+ * message credit
+ *
+ * the sender thread counts the messages in flight to each destination service
+ * in its credit ledger, and stamps each credited message with its index and the
+ * destination. the receiver thread adds up the stamps of the messages it handled
+ * and sends them back in one L_MSGID_CREDIT_GRANT per sender and destination
+ * after each batch. a message master cannot deliver is granted back by master.
+ */
+
+static int
+l_credit_check(void* obj, void* elem)
 {
-  l_message_senddata_impl(thread, L_SERVICE_MASTER, msgid, u32, u64);
+  return ((l_credit*)elem)->svid == *(l_umedit*)obj;
 }
 
-static void
-l_message_startService(l_thread* thread, l_service* srvc)
+static l_umedit
+l_credit_hash(l_umedit svid)
 {
-  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_START_REQ, 0, l_msg_castptr(srvc));
+  return (l_umedit)l_hash_int(svid, l_hash_seed());
 }
 
-static void
-l_message_closeService(l_thread* thread, l_umedit svid)
+static l_credit*
+l_credit_find(l_thread* thread, l_umedit svid)
 {
-  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_CLOSE_REQ, svid, 0);
+  if (!thread->credit) return 0;
+  return (l_credit*)l_hashtable_find(thread->credit, l_credit_hash(svid), l_credit_check, &svid);
 }
 
-static void
-l_message_delServiceEvent(l_thread* thread, l_filedesc fd)
+static l_credit*
+l_credit_get(l_thread* thread, l_umedit svid)
 {
-  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_DEL_EVENT, 0, l_msg_castfd(fd));
+  l_credit* credit = 0;
+
+  if ((credit = l_credit_find(thread, svid))) {
+    return credit;
+  }
+
+  if (!thread->credit && !(thread->credit = l_hashtable_create(4))) {
+    return 0;
+  }
+
+  if (!(credit = (l_credit*)l_raw_malloc(sizeof(l_credit)))) {
+    return 0;
+  }
+
+  credit->svid = svid;
+  credit->inflight = 0;
+  l_squeue_init(&credit->parked);
+
+  if (!l_hashtable_add(thread->credit, credit, l_credit_hash(svid))) {
+    l_raw_mfree(credit);
+    return 0;
+  }
+
+  return credit;
 }
 
 static void
-l_message_addServiceEvent(l_thread* thread, l_filedesc fd, l_umedit svid, l_ushort masks)
+l_credit_send(l_thread* thread, l_credit* credit, l_message* msg)
 {
-  l_message_senddata_impl(thread, masks, L_MSGID_SRVC_ADD_EVENT, svid, l_msg_castfd(fd));
+  credit->inflight += 1;
+  msg->from = (((l_ulong)thread->index) << 48) | credit->svid;
+  l_message_post(thread, msg);
 }
 
-static void
-l_message_masterExit(l_thread* thread)
+static void /* credit comes back from the receiver, send the parked messages as the window allows */
+l_credit_grant(l_thread* thread, l_umedit svid, l_umedit n)
 {
-  l_message_sendtomaster_impl(thread, L_MSGID_MASTER_EXIT_REQ, 0, 0);
+  l_credit* credit = 0;
+  l_message* msg = 0;
+  l_ulong waiter = 0;
+
+  if (!(credit = l_credit_find(thread, svid))) {
+    l_loge_1("no credit for service %d", ld(svid));
+    return;
+  }
+
+  credit->inflight = n < credit->inflight ? credit->inflight - n : 0;
+
+  while (credit->inflight < l_mailbox_depth && (msg = (l_message*)l_squeue_pop(&credit->parked))) {
+    waiter = msg->from;
+    l_credit_send(thread, credit, msg);
+    l_message_senddata_impl(thread, waiter, L_MSGID_SERVICE_CREDIT, 0, svid);
+  }
+
+  if (credit->inflight == 0 && l_squeue_isEmpty(&credit->parked)) {
+    l_hashtable_del(thread->credit, l_credit_hash(svid), l_credit_check, &svid);
+    l_raw_mfree(credit);
+  }
+}
+
+static void /* give n credit back to the sender of the messages stamped by from */
+l_message_grantCredit(l_thread* thread, l_ulong from, l_umedit n)
+{
+  l_ulong sender = ((from >> 48) << 48) | L_SERVICE_WORKER;
+  l_message_senddata_impl(thread, sender, L_MSGID_CREDIT_GRANT, n, from & 0xffffffff);
 }
 
 static void
-l_message_startBootstrap(l_thread* thread, int (*bootstrap)())
+l_thread_flushGrants(l_thread* thread)
 {
-  l_message_senddata_impl(thread, L_SERVICE_BOOTSTRAP, L_MSGID_START_BOOTSTRAP, 0, l_msg_castfunc(bootstrap));
+  int i = 0;
+  for (; i < thread->ngrant; ++i) {
+    l_message_grantCredit(thread, thread->grant[i].from, thread->grant[i].n);
+  }
+  thread->ngrant = 0;
 }
 
-/**
- * service
- *
- * service is single linked in the service hash table after it created.
- * service is freed as a free buffer after it is completed.
- */
+static void /* the receiver thread handled a credited message */
+l_thread_addGrant(l_thread* thread, l_ulong from)
+{
+  int i = 0;
 
-#define l_worker_svid(thread) ((((ulong)((thread)->index))<<48) | L_SERVICE_WORKER)
-#define L_SERVICE_STARTED   0x0100
-#define L_SERVICE_CLOSING   0x0200
-#define L_SERVICE_STOPRX    0x0400
-#define L_SERVICE_SOCKET    0x0800
+  for (; i < thread->ngrant; ++i) {
+    if (thread->grant[i].from == from) {
+      thread->grant[i].n += 1;
+      return;
+    }
+  }
+
+  if (thread->ngrant == L_THREAD_MAX_GRANT) {
+    l_thread_flushGrants(thread);
+  }
+
+  thread->grant[thread->ngrant].from = from;
+  thread->grant[thread->ngrant].n = 1;
+  thread->ngrant += 1;
+}
 
 L_EXTERN int
-l_service_initState(l_service* srvc)
+l_message_trySend(l_service* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg)
 {
-  lua_State* L = srvc->thread->L;
-  srvc->coref = LUA_NOREF;
+  l_thread* thread = from->thread;
+  l_umedit svid = (l_umedit)(destid & 0xffffffff);
+  l_credit* credit = 0;
+
+  if (svid < L_SERVICE_START_ID) { /* not a custom service, no credit needed */
+    l_message_send(thread, destid, msgid, u32, u64, msg);
+    return true;
+  }
+
+  if (!(credit = l_credit_get(thread, svid))) {
+    return false;
+  }
+
+  /* parked messages go first */
+  if (credit->inflight >= l_mailbox_depth || !l_squeue_isEmpty(&credit->parked)) {
+    return false;
+  }
+
+  l_message_fill(msg, destid, msgid + L_MESSAGE_START_ID, u32, u64);
+  l_credit_send(thread, credit, msg);
+  return true;
+}
+
+L_EXTERN int
+l_message_sendWait(l_service* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg, int (*kfunc)(l_service*))
+{
+  l_credit* credit = 0;
+
+  if (l_message_trySend(from, destid, msgid, u32, u64, msg)) {
+    return true;
+  }
+
+  if (!(credit = l_credit_find(from->thread, (l_umedit)(destid & 0xffffffff)))) {
+    return false;
+  }
+
+  l_message_fill(msg, destid, msgid + L_MESSAGE_START_ID, u32, u64);
+  msg->from = from->svid; /* the service to notify when the message is sent */
+  l_squeue_push(&credit->parked, &msg->HEAD.node);
+  return l_service_yield(from, kfunc);
+}
+
+static void
+l_message_sendtomaster_impl(l_thread* thread, l_umedit msgid, l_umedit u32, l_ulong u64)
+{
+  l_message_senddata_impl(thread, L_SERVICE_MASTER, msgid, u32, u64);
+}
+
+static void
+l_message_startService(l_thread* thread, l_service* srvc)
+{
+  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_START_REQ, 0, l_msg_castptr(srvc));
+}
+
+static void
+l_message_closeService(l_thread* thread, l_umedit svid)
+{
+  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_CLOSE_REQ, svid, 0);
+}
+
+static void
+l_message_delServiceEvent(l_thread* thread, l_filedesc fd)
+{
+  l_message_sendtomaster_impl(thread, L_MSGID_SRVC_DEL_EVENT, 0, l_msg_castfd(fd));
+}
+
+static void
+l_message_addServiceEvent(l_thread* thread, l_filedesc fd, l_umedit svid, l_ushort masks)
+{
+  l_message_senddata_impl(thread, masks, L_MSGID_SRVC_ADD_EVENT, svid, l_msg_castfd(fd));
+}
+
+static void
+l_message_masterExit(l_thread* thread)
+{
+  l_message_sendtomaster_impl(thread, L_MSGID_MASTER_EXIT_REQ, 0, 0);
+}
+
+static void
+l_message_startBootstrap(l_thread* thread, int (*bootstrap)())
+{
+  l_message_senddata_impl(thread, L_SERVICE_BOOTSTRAP, L_MSGID_START_BOOTSTRAP, 0, l_msg_castfunc(bootstrap));
+}
+
+/**
+ * service
+ *
+ * service is single linked in the service hash table after it created.
+ * service is freed as a free buffer after it is completed.
+ */
+
+#define l_worker_svid(thread) ((((ulong)((thread)->index))<<48) | L_SERVICE_WORKER)
+#define L_SERVICE_STARTED   0x0100
+#define L_SERVICE_CLOSING   0x0200
+#define L_SERVICE_STOPRX    0x0400
+#define L_SERVICE_SOCKET    0x0800
+
+L_EXTERN int
+l_service_initState(l_service* srvc)
+{
+  lua_State* L = srvc->thread->L;
+  srvc->coref = LUA_NOREF;
   /**
    * lua_State* lua_newthread(lua_State* L);
    *
@@ -1006,7 +1669,7 @@ l_srvctable_init(l_srvctable* self, l_byte sizebits)
 static l_smplnode*
 llheadnode(l_srvctable* self, l_umedit svid)
 {
-  return &(self->slot[svid & (self->nslot - 1)].node);
+  return &(self->slot[l_hash_int(svid, l_hash_seed()) & (self->nslot - 1)].node);
 }
 
 static void
@@ -1185,6 +1848,9 @@ l_service_createFrom(l_service* from, l_int size, int (*entry)(l_service*, l_mes
   l_service_ptr(&buffer)->svid = l_master_new_svid();
   l_service_ptr(&buffer)->thread = thread;
   l_service_ptr(&buffer)->entry = entry;
+  l_service_ptr(&buffer)->call = 0;
+  l_service_ptr(&buffer)->conn = 0;
+  l_service_ptr(&buffer)->dgsize = 0;
   return l_service_ptr(&buffer);
 }
 
@@ -1197,7 +1863,7 @@ l_service_create(l_int size, int (*entry)(l_service*, l_message*))
 L_EXTERN void
 l_service_close(l_service* srvc)
 {
-  if (srvc->flagw | L_SERVICE_STARTED) {
+  if (srvc->flagw & L_SERVICE_STARTED) {
     srvc->flagw |= L_SERVICE_CLOSING;
   } else {
     l_buffer buffer = {srvc};
@@ -1236,130 +1902,1386 @@ l_service_set_event_impl(l_service* srvc, l_filedesc fd, l_ushort masks, l_ushor
 static l_service*
 l_service_setEventImpl(l_service* srvc, l_filedesc fd, l_ushort masks, l_ushort flags)
 {
-  if (srvc->flagw | L_SERVICE_STARTED) {
-    l_loge_1("already started %d", ld(srvc->svid));
-    return srvc;
+  if (srvc->flagw & L_SERVICE_STARTED) {
+    l_loge_1("already started %d", ld(srvc->svid));
+    return srvc;
+  }
+
+  if (l_filedesc_isEmpty(fd)) {
+    return srvc;
+  }
+
+  return l_service_set_event_impl(srvc, fd, masks, flags);
+}
+
+L_EXTERN l_service*
+l_service_setEvent(l_service* srvc, l_filedesc fd, l_ushort masks)
+{
+  return l_service_setEventImpl(srvc, fd, masks, 0);
+}
+
+L_EXTERN l_service*
+l_service_setListen(l_service* srvc, l_filedesc fd)
+{
+  return l_service_setEventImpl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_LISTEN);
+}
+
+L_EXTERN l_service*
+l_service_setListenShard(l_service* srvc, l_filedesc fd)
+{
+  return l_service_setEventImpl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_LISTEN | L_SOCKET_FLAG_SHARD);
+}
+
+L_EXTERN l_service*
+l_service_setDgram(l_service* srvc, l_filedesc fd, l_int dgsize)
+{
+  if (srvc->flagw & L_SERVICE_STARTED) {
+    l_loge_1("already started %d", ld(srvc->svid));
+    return srvc;
+  }
+
+  if (dgsize <= 0) {
+    dgsize = L_DGRAM_DEFAULT_SIZE;
+  } else if (dgsize > 65535) {
+    dgsize = 65535;
+  }
+
+  srvc->dgsize = dgsize;
+  return l_service_setEventImpl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_DGRAM);
+}
+
+L_EXTERN l_service*
+l_service_setConnect(l_service* srvc, l_filedesc fd)
+{
+  return l_service_setEventImpl(srvc, fd, L_SOCKET_RDWR, L_SOCKET_FLAG_CONNECT);
+}
+
+L_EXTERN l_service*
+l_service_setAccept(l_service* srvc, int (*conn)(l_service* listen, l_sockconn* conn))
+{
+  if (srvc->flagw & L_SERVICE_STARTED) {
+    l_loge_1("already started %d", ld(srvc->svid));
+    return srvc;
+  }
+
+  srvc->conn = conn;
+  return srvc;
+}
+
+L_EXTERN int
+l_service_ioSpend(l_service* srvc, l_int bytes)
+{
+  l_thread* thread = srvc->thread;
+  thread->iobytes -= bytes;
+  thread->iocalls -= 1;
+  return thread->iobytes > 0 && thread->iocalls > 0;
+}
+
+L_EXTERN void
+l_service_requeueEvent(l_service* srvc, l_ushort masks)
+{
+  l_thread* thread = srvc->thread;
+  l_filedesc fd = l_filedesc_empty();
+  l_message* msg = 0;
+  int pending = false;
+
+  l_mutex_lock(thread->svmtx);
+  pending = (srvc->evmk != 0); /* an event message is on the way, it takes the masks */
+  srvc->evmk |= masks;
+  fd = srvc->evfd;
+  l_mutex_unlock(thread->svmtx);
+
+  if (!pending && !l_filedesc_isEmpty(fd) && (msg = l_message_create(sizeof(l_message), thread))) {
+    l_message_fill(msg, l_service_id(srvc), L_MSGID_SOCK_EVENT_IND, masks, l_msg_castfd(fd));
+    msg->from = 0;
+    msg->lane = L_MSGLANE_DATA; /* behind the data messages queued, not ahead of them on the control lane */
+    l_message_post(thread, msg);
+  }
+}
+
+L_EXTERN int
+l_service_workers()
+{
+  return l_num_workers;
+}
+
+L_EXTERN l_thread*
+l_service_workerThread(int i)
+{
+  if (i < 1 || i > l_num_workers) {
+    return 0;
+  }
+  return l_worker_thread + i - 1;
+}
+
+L_EXTERN void
+l_service_delEvent(l_service* srvc)
+{
+  l_thread* thread = srvc->thread;
+  l_filedesc fd = l_filedesc_empty();
+
+  if (!(srvc->flagw & L_SERVICE_STARTED)) {
+    l_loge_1("service not started %d", ld(srvc->svid));
+    return;
+  }
+
+  if (srvc->flagw & L_SERVICE_SOCKET) {
+    l_mutex* svmtx = thread->svmtx;
+
+    l_mutex_lock(svmtx);
+    fd = srvc->evfd;
+    srvc->evfd = l_filedesc_empty();
+    l_mutex_unlock(svmtx);
+
+    srvc->flagw &= (~L_SERVICE_SOCKET);
+  }
+
+  if (l_filedesc_isEmpty(fd)) {
+    return;
+  }
+
+  l_message_delServiceEvent(thread, fd);
+}
+
+L_EXTERN void
+l_service_mod_event_impl(l_service* srvc, l_filedesc fd, l_ushort masks, l_ushort flags)
+{
+  l_filedesc oldfd;
+  l_thread* thread = 0;
+  l_mutex* svmtx = 0;
+
+  if (!(srvc->flagw & L_SERVICE_STARTED)) {
+    l_loge_1("service not started %d", ld(srvc->svid));
+    return;
+  }
+
+  oldfd = l_filedesc_empty();
+  thread = srvc->thread;
+  svmtx = thread->svmtx;
+
+  l_mutex_lock(svmtx);
+  if (!l_filedesc_isEmpty(srvc->evfd)) {
+    oldfd = srvc->evfd;
+    srvc->evfd = l_filedesc_empty();
+  }
+  srvc->flagw &= (~L_SERVICE_SOCKET);
+  if (!l_filedesc_isEmpty(fd)) {
+    l_service_set_event_impl(srvc, fd, masks, flags);
+  }
+  srvc->evmk = 0; /* clear masks, prepare to receive */
+  l_mutex_unlock(svmtx);
+
+  if (!l_filedesc_isEmpty(oldfd)) {
+    l_message_delServiceEvent(thread, fd);
+  }
+
+  if (!l_filedesc_isEmpty(fd)) {
+    l_message_addServiceEvent(srvc->thread, fd, l_service_id_for_lookup(srvc), masks);
+  }
+}
+
+L_EXTERN void
+l_service_modEvent(l_service* srvc, l_filedesc fd, l_ushort masks)
+{
+  l_service_mod_event_impl(srvc, fd, masks, 0);
+}
+
+L_EXTERN void
+l_service_modListen(l_service* srvc, l_filedesc fd)
+{
+  l_service_mod_event_impl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_LISTEN);
+}
+
+L_EXTERN void
+l_service_modConnect(l_service* srvc, l_filedesc fd)
+{
+  l_service_mod_event_impl(srvc, fd, L_SOCKET_RDWR, L_SOCKET_FLAG_CONNECT);
+}
+
+/**
+ * topic
+ *
+ * a topic is registered once by name and then referred by its id. the registry
+ * only records which threads have subscribers of a topic, the subscribers are
+ * listed in their own thread. publishing copies the payload once into a ref
+ * counted buffer and sends one L_MSGID_TOPIC_PUBLISH to each of those threads,
+ * the thread delivers the same message to all its subscribers.
+ */
+
+struct l_payload {
+  volatile l_ulong nref;
+  l_umedit msgid;
+  l_int size; /* the payload bytes follow the header */
+};
+
+typedef struct {
+  l_umedit id;
+  l_byte* threads; /* threads[i] is true if thread of index i has subscribers */
+  /* the length prefixed name follows the header */
+} l_topic;
+
+L_GLOBAL l_mutex l_topic_mtx;
+L_GLOBAL l_hashtable* l_topic_table; /* topics by name */
+L_GLOBAL l_topic** l_topic_array; /* topics by id - 1 */
+L_GLOBAL l_umedit l_topic_count;
+L_GLOBAL l_umedit l_topic_capacity;
+
+L_EXTERN const l_byte*
+l_payload_data(l_payload* payload)
+{
+  return (const l_byte*)(payload + 1);
+}
+
+L_EXTERN l_int
+l_payload_size(l_payload* payload)
+{
+  return payload->size;
+}
+
+L_EXTERN void
+l_payload_retain(l_payload* payload)
+{
+  l_atomic_addRelaxed(&payload->nref, 1);
+}
+
+L_EXTERN void
+l_payload_release(l_payload* payload)
+{
+  if (l_atomic_add(&payload->nref, (l_ulong)-1) == 1) {
+    l_raw_mfree(payload);
+  }
+}
+
+static l_payload*
+l_payload_create(l_umedit msgid, const void* data, l_int size)
+{
+  l_payload* payload = 0;
+
+  if (size < 0 || size > L_MAX_RWSIZE) {
+    l_loge_1("payload size %d", ld(size));
+    return 0;
+  }
+
+  if (!(payload = (l_payload*)l_raw_malloc(sizeof(l_payload) + size))) {
+    return 0;
+  }
+
+  payload->nref = 1;
+  payload->msgid = msgid;
+  payload->size = size;
+  if (size > 0) l_copy_n(data, size, (l_byte*)(payload + 1));
+  return payload;
+}
+
+static l_topic* /* the registry is locked */
+l_topic_get(l_umedit id)
+{
+  if (id == 0 || id > l_topic_count) return 0;
+  return l_topic_array[id - 1];
+}
+
+L_EXTERN l_umedit
+l_topic_register(l_strn name)
+{
+  l_umedit hash = 0;
+  l_topic* topic = 0;
+  l_topic** array = 0;
+  l_byte* p = 0;
+
+  if (name.len <= 0 || name.len > 255) {
+    l_loge_1("topic name length %d", ld(name.len));
+    return 0;
+  }
+
+  hash = (l_umedit)l_hash_strn(name);
+  l_mutex_lock(&l_topic_mtx);
+
+  if ((topic = (l_topic*)l_hashtable_findStr(l_topic_table, hash, name))) {
+    l_mutex_unlock(&l_topic_mtx);
+    return topic->id;
+  }
+
+  if (l_topic_count == l_topic_capacity) {
+    array = (l_topic**)l_raw_ralloc(l_topic_array, sizeof(l_topic*) * l_topic_capacity, sizeof(l_topic*) * (l_topic_capacity + 64));
+    if (!array) {
+      l_mutex_unlock(&l_topic_mtx);
+      return 0;
+    }
+    l_topic_array = array;
+    l_topic_capacity += 64;
+  }
+
+  if (!(topic = (l_topic*)l_raw_calloc(sizeof(l_topic) + 1 + name.len + l_num_workers + 1))) {
+    l_mutex_unlock(&l_topic_mtx);
+    return 0;
+  }
+
+  p = (l_byte*)(topic + 1);
+  p[0] = (l_byte)name.len;
+  l_copy_n(name.start, name.len, p + 1);
+  topic->threads = p + 1 + name.len;
+
+  if (!l_hashtable_add(l_topic_table, topic, hash)) {
+    l_mutex_unlock(&l_topic_mtx);
+    l_raw_mfree(topic);
+    return 0;
+  }
+
+  l_topic_array[l_topic_count++] = topic;
+  topic->id = l_topic_count;
+  l_mutex_unlock(&l_topic_mtx);
+  return topic->id;
+}
+
+static void
+l_topic_setThread(l_umedit id, l_thread* thread, l_byte hassub)
+{
+  l_topic* topic = 0;
+  l_mutex_lock(&l_topic_mtx);
+  if ((topic = l_topic_get(id))) {
+    topic->threads[thread->index] = hassub;
+  }
+  l_mutex_unlock(&l_topic_mtx);
+}
+
+static int
+l_topicsub_check(void* obj, void* elem)
+{
+  return ((l_topicsub*)elem)->topic == *(l_umedit*)obj;
+}
+
+static l_umedit
+l_topicsub_hash(l_umedit topic)
+{
+  return (l_umedit)l_hash_int(topic, l_hash_seed());
+}
+
+static l_topicsub*
+l_topicsub_find(l_thread* thread, l_umedit topic)
+{
+  if (!thread->topic) return 0;
+  return (l_topicsub*)l_hashtable_find(thread->topic, l_topicsub_hash(topic), l_topicsub_check, &topic);
+}
+
+static void /* remove the subscription of the thread if it has no subscriber */
+l_topicsub_shrink(l_thread* thread, l_topicsub* sub)
+{
+  l_umedit i = 0, n = 0;
+
+  if (sub->busy) return;
+
+  if (sub->holes) {
+    for (; i < sub->n; ++i) {
+      if (sub->srvc[i]) sub->srvc[n++] = sub->srvc[i];
+    }
+    sub->n = n;
+    sub->holes = 0;
+  }
+
+  if (sub->n == 0) {
+    l_topic_setThread(sub->topic, thread, false);
+    l_hashtable_del(thread->topic, l_topicsub_hash(sub->topic), l_topicsub_check, &sub->topic);
+    l_thread_freeSubs(0, sub);
+    l_raw_mfree(sub);
+  }
+}
+
+L_EXTERN int
+l_topic_subscribe(l_service* srvc, l_umedit topic)
+{
+  l_thread* thread = srvc->thread;
+  l_topicsub* sub = 0;
+  l_service** a = 0;
+  l_umedit i = 0;
+
+  if (!(sub = l_topicsub_find(thread, topic))) {
+    l_mutex_lock(&l_topic_mtx);
+    i = l_topic_get(topic) != 0;
+    l_mutex_unlock(&l_topic_mtx);
+    if (!i) {
+      l_loge_1("topic %d not registered", ld(topic));
+      return false;
+    }
+    if (!thread->topic && !(thread->topic = l_hashtable_create(4))) {
+      return false;
+    }
+    if (!(sub = (l_topicsub*)l_raw_calloc(sizeof(l_topicsub)))) {
+      return false;
+    }
+    sub->topic = topic;
+    if (!l_hashtable_add(thread->topic, sub, l_topicsub_hash(topic))) {
+      l_raw_mfree(sub);
+      return false;
+    }
+    l_topic_setThread(topic, thread, true);
+  }
+
+  for (i = 0; i < sub->n; ++i) {
+    if (sub->srvc[i] == srvc) return true; /* already subscribed */
+  }
+
+  if (sub->n == sub->cap) {
+    a = (l_service**)l_raw_ralloc(sub->srvc, sizeof(l_service*) * sub->cap, sizeof(l_service*) * (sub->cap * 2 + 4));
+    if (!a) {
+      l_topicsub_shrink(thread, sub);
+      return false;
+    }
+    sub->srvc = a;
+    sub->cap = sub->cap * 2 + 4;
+  }
+
+  sub->srvc[sub->n++] = srvc;
+  return true;
+}
+
+L_EXTERN int
+l_topic_subscribeName(l_service* srvc, l_strn name)
+{
+  l_umedit topic = l_topic_register(name);
+  return topic && l_topic_subscribe(srvc, topic);
+}
+
+L_EXTERN void
+l_topic_unsubscribe(l_service* srvc, l_umedit topic)
+{
+  l_thread* thread = srvc->thread;
+  l_topicsub* sub = 0;
+  l_umedit i = 0;
+
+  if (!(sub = l_topicsub_find(thread, topic))) {
+    return;
+  }
+
+  for (; i < sub->n; ++i) {
+    if (sub->srvc[i] != srvc) continue;
+    if (sub->busy) { /* keep the order for the delivering */
+      sub->srvc[i] = 0;
+      sub->holes += 1;
+    } else {
+      sub->srvc[i] = sub->srvc[--sub->n];
+    }
+    break;
+  }
+
+  l_topicsub_shrink(thread, sub);
+}
+
+static void
+l_topicsub_removeService(void* obj, void* elem)
+{
+  l_topicsub* sub = (l_topicsub*)elem;
+  l_umedit i = 0;
+
+  for (; i < sub->n; ++i) {
+    if (sub->srvc[i] == (l_service*)obj) {
+      sub->srvc[i] = sub->srvc[--sub->n];
+      break;
+    }
+  }
+}
+
+static void /* the service is closed, the emptied subscriptions are removed at next publish */
+l_topicsub_removeAll(l_thread* thread, l_service* srvc)
+{
+  if (thread->topic) {
+    l_hashtable_foreach(thread->topic, l_topicsub_removeService, srvc);
+  }
+}
+
+L_EXTERN l_int
+l_topic_publish(l_thread* from, l_umedit topic, l_umedit msgid, const void* data, l_int size)
+{
+  l_payload* payload = 0;
+  l_message* msg = 0;
+  l_topic* t = 0;
+  l_int i = 0, n = 0;
+
+  if (!(payload = l_payload_create(msgid + L_MESSAGE_START_ID, data, size))) {
+    return 0;
+  }
+
+  l_mutex_lock(&l_topic_mtx);
+  if ((t = l_topic_get(topic))) {
+    for (; i <= l_num_workers; ++i) {
+      if (!t->threads[i]) continue;
+      if (!(msg = l_message_create(sizeof(l_message), from))) break;
+      l_payload_retain(payload);
+      l_message_fill(msg, (((l_ulong)i) << 48) | L_SERVICE_WORKER, L_MSGID_TOPIC_PUBLISH, topic, l_msg_castptr(payload));
+      msg->from = 0;
+      msg->lane = L_MSGLANE_DATA; /* it is bulk data although it is an internal message */
+      l_message_post(from, msg);
+      ++n;
+    }
+  }
+  l_mutex_unlock(&l_topic_mtx);
+
+  l_payload_release(payload);
+  return n;
+}
+
+static void /* check if the service called l_service_close when handling a message */
+l_worker_handleClosing(l_thread* thread, l_service* srvc)
+{
+  if (srvc->flagw & L_SERVICE_CLOSING) {
+    l_service_freeState(srvc);
+
+    l_thread_lock(thread);
+    srvc->flags |= L_SERVICE_STOPRX;
+    l_thread_unlock(thread);
+
+    l_service_delEvent(srvc);
+    l_message_closeService(thread, l_service_id_for_lookup(srvc));
+  }
+}
+
+static void /* deliver the publish to the subscribers of current thread */
+l_worker_deliverTopic(l_thread* thread, l_message* msg)
+{
+  l_payload* payload = (l_payload*)l_msg_getptr(msg);
+  l_topicsub* sub = 0;
+  l_service* srvc = 0;
+  l_umedit i = 0, n = 0;
+
+  if ((sub = l_topicsub_find(thread, msg->data))) {
+    msg->msgid = payload->msgid;
+    sub->busy = true;
+    for (n = sub->n; i < n; ++i) { /* the services subscribed during the delivering are not included */
+      if (!(srvc = sub->srvc[i]) || (srvc->flagw & L_SERVICE_CLOSING)) continue;
+      msg->dest = (l_ulong)(l_uint)srvc;
+      srvc->entry(srvc, msg);
+      l_worker_handleClosing(thread, srvc);
+    }
+    sub->busy = false;
+    l_topicsub_shrink(thread, sub);
+  }
+
+  l_payload_release(payload);
+}
+
+/**
+ * request and response
+ *
+ * a request carries the caller svid and a sequence number in its call field and
+ * the reply carries it back. the calls of a batch have consecutive sequences, so
+ * the reply is matched by an index. master keeps the await timeouts in a heap
+ * and sends L_MSGID_CALL_TIMEOUT to the service when one expires, the timeout or
+ * reply of an old batch is ignored. a batch replied before its timeout deletes
+ * the timer by L_MSGID_SRVC_DEL_TIMER, master finds it by the svid in a table,
+ * a service awaits one batch at a time so it has one timer at most.
+ */
+
+typedef struct {
+  int status; /* L_WAITMORE, L_SUCCESS or L_ETIMEOUT */
+  l_umedit data;
+  l_ulong extra;
+} l_callresult;
+
+struct l_callstate {
+  l_umedit seq; /* sequence of the last request */
+  l_umedit first; /* sequence of the first request of the batch */
+  l_umedit n; /* requests of the batch */
+  l_umedit cap;
+  l_umedit nwait; /* requests of the batch not replied */
+  int waiting; /* the coroutine is waiting the batch */
+  int closed; /* the batch is finished, next request starts a new batch */
+  l_callresult* a;
+};
+
+typedef struct {
+  l_umedit pos;
+  l_umedit svid;
+  l_umedit tag; /* the batch the timer is for */
+} l_mstimer;
+
+L_GLOBAL l_mmheap l_timer_heap; /* only accessed by master */
+L_GLOBAL l_hashtable* l_timer_table; /* timers by svid, only accessed by master */
+
+static l_ulong
+l_master_nowms()
+{
+  return l_message_nowns() / 1000000;
+}
+
+static void
+l_callstate_free(l_service* srvc)
+{
+  if (srvc->call) {
+    if (srvc->call->a) l_raw_mfree(srvc->call->a);
+    l_raw_mfree(srvc->call);
+    srvc->call = 0;
+  }
+}
+
+static l_int /* add a request waiting the result to the batch, return its index */
+l_callstate_add(l_service* srvc)
+{
+  l_callstate* call = srvc->call;
+  l_callresult* a = 0;
+
+  if (!call) {
+    if (!(call = srvc->call = (l_callstate*)l_raw_calloc(sizeof(l_callstate)))) {
+      return L_ENOMEM;
+    }
+    call->closed = true;
+  }
+
+  if (call->waiting) {
+    l_loge_1("service %d is waiting replies", ld(srvc->svid));
+    return L_EINVAL;
+  }
+
+  if (call->closed) { /* start a new batch */
+    call->first = call->seq + 1;
+    call->n = call->nwait = 0;
+    call->closed = false;
+  }
+
+  if (call->n == call->cap) {
+    a = (l_callresult*)l_raw_ralloc(call->a, sizeof(l_callresult) * call->cap, sizeof(l_callresult) * (call->cap * 2 + 4));
+    if (!a) return L_ENOMEM;
+    call->a = a;
+    call->cap = call->cap * 2 + 4;
+  }
+
+  call->seq += 1;
+  call->a[call->n].status = L_WAITMORE;
+  call->nwait += 1;
+  return (l_int)(call->n++);
+}
+
+L_EXTERN l_int
+l_service_request(l_service* srvc, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64)
+{
+  l_message* msg = 0;
+  l_int i = 0;
+
+  if (!(msg = l_message_create(sizeof(l_message), srvc->thread))) {
+    return L_ENOMEM;
+  }
+
+  if ((i = l_callstate_add(srvc)) < 0) {
+    l_message_free(msg, srvc->thread);
+    return i;
+  }
+
+  l_message_fill(msg, destid, msgid + L_MESSAGE_START_ID, u32, u64);
+  msg->from = 0;
+  msg->call = (((l_ulong)l_service_id_for_lookup(srvc)) << 32) | srvc->call->seq;
+  l_message_post(srvc->thread, msg);
+  return i;
+}
+
+static int
+l_service_finishBatch(l_service* srvc)
+{
+  srvc->call->waiting = false;
+  srvc->call->closed = true;
+  return l_service_resume(srvc);
+}
+
+L_EXTERN int
+l_service_await(l_service* srvc, l_umedit ms, int (*kfunc)(l_service*))
+{
+  l_callstate* call = srvc->call;
+
+  if (!call || call->nwait == 0) {
+    if (call) call->closed = true;
+    return kfunc(srvc);
+  }
+
+  call->waiting = true;
+  l_message_senddata_impl(srvc->thread, L_SERVICE_MASTER, L_MSGID_SRVC_ADD_TIMER, ms, (((l_ulong)l_service_id_for_lookup(srvc)) << 32) | call->first);
+  return l_service_yield(srvc, kfunc);
+}
+
+L_EXTERN int
+l_service_call(l_service* srvc, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_umedit ms, int (*kfunc)(l_service*))
+{
+  l_int n = l_service_request(srvc, destid, msgid, u32, u64);
+  if (n < 0) return (int)n;
+  return l_service_await(srvc, ms, kfunc);
+}
+
+L_EXTERN int
+l_service_result(l_service* srvc, l_int i, l_umedit* u32, l_ulong* u64)
+{
+  l_callresult* r = 0;
+
+  if (!srvc->call || i < 0 || i >= (l_int)srvc->call->n) {
+    return L_EINVAL;
+  }
+
+  r = srvc->call->a + i;
+  if (r->status == L_SUCCESS) {
+    if (u32) *u32 = r->data;
+    if (u64) *u64 = r->extra;
+  }
+
+  return r->status;
+}
+
+L_EXTERN void
+l_service_reply(l_service* srvc, l_message* req, l_umedit u32, l_ulong u64)
+{
+  l_message* msg = 0;
+
+  if (!req->call) {
+    l_loge_1("message %d is not a request", ld(req->msgid));
+    return;
+  }
+
+  if (!(msg = l_message_create(sizeof(l_message), srvc->thread))) {
+    return;
+  }
+
+  l_message_fill(msg, req->call >> 32, L_MSGID_CALL_REPLY, u32, u64);
+  msg->from = 0;
+  msg->call = req->call;
+  l_message_post(srvc->thread, msg);
+}
+
+static int /* set the result of request seq, return false if it is not waited any more */
+l_callstate_done(l_thread* thread, l_service* srvc, l_umedit seq, int status, l_umedit data, l_ulong extra)
+{
+  l_callstate* call = srvc->call;
+  l_callresult* r = 0;
+  l_umedit i = 0;
+
+  if (!call || call->closed) {
+    return false; /* too late */
+  }
+
+  i = seq - call->first;
+  if (i >= call->n || call->a[i].status != L_WAITMORE) {
+    return false; /* not of this batch */
+  }
+
+  r = call->a + i;
+  r->status = status;
+  r->data = data;
+  r->extra = extra;
+
+  if (--call->nwait == 0 && call->waiting) {
+    /* the timer is not fired yet, delete it */
+    l_message_senddata_impl(thread, L_SERVICE_MASTER, L_MSGID_SRVC_DEL_TIMER, 0, (((l_ulong)l_service_id_for_lookup(srvc)) << 32) | call->first);
+    l_service_finishBatch(srvc);
+    l_worker_handleClosing(thread, srvc);
+  }
+
+  return true;
+}
+
+static void /* a reply or timeout arrives at the caller's thread */
+l_worker_handleCall(l_thread* thread, l_service* srvc, l_message* msg)
+{
+  l_callstate* call = srvc->call;
+  l_umedit i = 0;
+
+  if (!call || call->closed) {
+    return; /* too late */
+  }
+
+  if (msg->msgid == L_MSGID_CALL_TIMEOUT) {
+    if (msg->data != call->first || !call->waiting) return;
+    for (; i < call->n; ++i) {
+      if (call->a[i].status == L_WAITMORE) call->a[i].status = L_ETIMEOUT;
+    }
+    call->nwait = 0;
+    l_service_finishBatch(srvc);
+    l_worker_handleClosing(thread, srvc);
+    return;
+  }
+
+  l_callstate_done(thread, srvc, (l_umedit)(msg->call & 0xffffffff), L_SUCCESS, msg->data, msg->extra);
+}
+
+static l_umedit
+l_mstimer_hash(l_umedit svid)
+{
+  return (l_umedit)l_hash_int(svid, l_hash_seed());
+}
+
+static int
+l_mstimer_check(void* obj, void* elem)
+{
+  return ((l_mstimer*)elem)->svid == *(l_umedit*)obj;
+}
+
+static void
+l_master_addTimer(l_message* msg)
+{
+  l_mstimer* timer = 0;
+
+  if (!(timer = (l_mstimer*)l_raw_malloc(sizeof(l_mstimer)))) {
+    return;
+  }
+
+  timer->svid = (l_umedit)(msg->extra >> 32);
+  timer->tag = (l_umedit)(msg->extra & 0xffffffff);
+
+  if (!l_mmheap_add(&l_timer_heap, timer, l_master_nowms() + msg->data)) {
+    l_raw_mfree(timer);
+    return;
+  }
+
+  if (l_timer_table) { /* the timer of an older batch is left in the heap only */
+    l_hashtable_del(l_timer_table, l_mstimer_hash(timer->svid), l_mstimer_check, &timer->svid);
+  }
+
+  if (!l_timer_table || !l_hashtable_add(l_timer_table, timer, l_mstimer_hash(timer->svid))) {
+    l_logw_1("timer of service %d cannot be deleted", ld(timer->svid)); /* it fires and is ignored */
+  }
+}
+
+static void
+l_master_delTimer(l_message* msg)
+{
+  l_mstimer* timer = 0;
+  l_umedit svid = (l_umedit)(msg->extra >> 32);
+
+  if (!l_timer_table || !(timer = (l_mstimer*)l_hashtable_find(l_timer_table, l_mstimer_hash(svid), l_mstimer_check, &svid))) {
+    return; /* already fired */
+  }
+
+  if (timer->tag != (l_umedit)(msg->extra & 0xffffffff)) {
+    return; /* not the timer of this batch */
+  }
+
+  l_hashtable_del(l_timer_table, l_mstimer_hash(svid), l_mstimer_check, &svid);
+  l_mmheap_del(&l_timer_heap, timer);
+  l_raw_mfree(timer);
+}
+
+static int /* return milliseconds to the nearest timer, -1 if no timer */
+l_master_timerWait()
+{
+  l_ulong now = 0, key = 0;
+
+  key = l_mmheap_topKey(&l_timer_heap);
+  if (l_loop_interval && l_loop_nextms < key) {
+    key = l_loop_nextms; /* the loop snapshot is a timer too */
+  }
+
+  if (key == L_MAX_ULONG) {
+    return -1;
+  }
+
+  now = l_master_nowms();
+  if (key <= now) return 0;
+  return (key - now > 0x7fffffff) ? 0x7fffffff : (int)(key - now);
+}
+
+static void
+l_master_fireTimers(l_thread* master)
+{
+  l_mstimer* timer = 0;
+  l_ulong now = 0;
+
+  if (l_mmheap_size(&l_timer_heap) == 0 && !l_loop_interval) {
+    return;
+  }
+
+  now = l_master_nowms();
+  while (l_mmheap_topKey(&l_timer_heap) <= now) {
+    timer = (l_mstimer*)l_mmheap_pop(&l_timer_heap);
+    if (l_timer_table && l_hashtable_find(l_timer_table, l_mstimer_hash(timer->svid), l_mstimer_check, &timer->svid) == timer) {
+      l_hashtable_del(l_timer_table, l_mstimer_hash(timer->svid), l_mstimer_check, &timer->svid);
+    }
+    l_message_senddata_impl(master, timer->svid, L_MSGID_CALL_TIMEOUT, timer->tag, 0);
+    l_raw_mfree(timer);
+  }
+
+  if (l_loop_interval && l_loop_nextms <= now) {
+    l_master_snapshotLoops(now);
+    l_loop_nextms = now + l_loop_interval;
+  }
+}
+
+/**
+ * connection pool
+ *
+ * the pool of a thread is only accessed by the thread itself. a new connection
+ * is connected nonblocking and its socket is added to master with the udata
+ * L_SERVICE_POOL | thread index, master takes it out of the event manager at
+ * the first event and sends the masks to the thread with the SO_ERROR in the
+ * high 16 bits. the connecting socket is kept by the pool until then, so its fd
+ * cannot be reused by others while master still watches it. a returned socket
+ * still attached to the service is kept out of the idle list the same way until
+ * master acks the detach by L_MSGID_POOL_DETACH_RSP, one that is not kept is
+ * closed by master. the keys are never removed, there are as many as the
+ * upstreams the services talk to.
+ */
+
+typedef struct {
+  const l_sockaddr* addr;
+  const l_sockopts* opts;
+} l_poolkey;
+
+static int
+l_poolhost_check(void* obj, void* elem)
+{
+  l_poolkey* key = (l_poolkey*)obj;
+  l_poolhost* host = (l_poolhost*)elem;
+  return l_sockaddr_equal(&host->addr, key->addr) && memcmp(&host->opts, key->opts, sizeof(l_sockopts)) == 0;
+}
+
+static l_poolhost*
+l_connpool_host(l_thread* thread, const l_sockaddr* addr, const l_sockopts* opts)
+{
+  l_sockopts none;
+  l_poolkey key;
+  l_poolhost* host = 0;
+  l_umedit hash = 0;
+
+  if (!opts) {
+    l_sockopts_init(&none);
+    opts = &none;
+  }
+
+  key.addr = addr;
+  key.opts = opts;
+  hash = (l_umedit)l_sockaddr_hash(addr, l_hash_bytes(opts, sizeof(l_sockopts), l_hash_seed()));
+
+  if (thread->pool && (host = (l_poolhost*)l_hashtable_find(thread->pool, hash, l_poolhost_check, &key))) {
+    return host;
+  }
+
+  if (!thread->pool && !(thread->pool = l_hashtable_create(4))) {
+    return 0;
+  }
+
+  if (!(host = (l_poolhost*)l_raw_calloc(sizeof(l_poolhost)))) {
+    return 0;
+  }
+
+  host->addr = *addr;
+  host->opts = *opts;
+
+  if (!l_hashtable_add(thread->pool, host, hash)) {
+    l_raw_mfree(host);
+    return 0;
+  }
+
+  return host;
+}
+
+static void
+l_connpool_close(l_poolconn* conn)
+{
+  conn->host->nconn -= 1;
+  l_socket_close(&conn->sock);
+  l_raw_mfree(conn);
+}
+
+static int /* the connection can be kept as idle */
+l_connpool_keepable(l_poolconn* conn, l_ulong now)
+{
+  return conn->host->nidle < l_pool_max_idle && (!l_pool_lifetime || now - conn->born < l_pool_lifetime);
+}
+
+static void /* keep the connection as idle if it can be reused, otherwise close it */
+l_connpool_putIdle(l_poolconn* conn, l_ulong now)
+{
+  l_poolhost* host = conn->host;
+
+  if (!l_connpool_keepable(conn, now)) {
+    l_connpool_close(conn);
+    return;
+  }
+
+  conn->waiter = 0;
+  conn->idle = now;
+  conn->next = host->idle;
+  host->idle = conn;
+  host->nidle += 1;
+}
+
+static l_poolconn* /* take the most recently returned idle connection which is still good */
+l_connpool_takeIdle(l_poolhost* host, l_ulong now)
+{
+  l_poolconn** link = &host->idle;
+  l_poolconn* conn = 0;
+
+  /* the list is in the order of return, all after the first idle too long are too */
+  while (*link && now - (*link)->idle < l_pool_idle_timeout) {
+    link = &(*link)->next;
+  }
+
+  while ((conn = *link)) {
+    *link = conn->next;
+    host->nidle -= 1;
+    l_connpool_close(conn);
+  }
+
+  while ((conn = host->idle)) {
+    host->idle = conn->next;
+    host->nidle -= 1;
+    conn->next = 0;
+    if ((!l_pool_lifetime || now - conn->born < l_pool_lifetime) && l_socket_isAlive(conn->sock)) {
+      return conn;
+    }
+    l_connpool_close(conn);
+  }
+
+  return 0;
+}
+
+L_EXTERN l_int
+l_connpool_checkout(l_service* srvc, const l_sockaddr* addr, const l_sockopts* opts)
+{
+  l_thread* thread = srvc->thread;
+  l_poolhost* host = 0;
+  l_poolconn* conn = 0;
+  l_sockconn sc;
+  l_ulong now = l_master_nowms();
+  l_umedit seq = 0;
+  l_int i = 0;
+
+  if (!(host = l_connpool_host(thread, addr, opts))) {
+    return L_ENOMEM;
+  }
+
+  if ((i = l_callstate_add(srvc)) < 0) {
+    return i;
+  }
+
+  seq = srvc->call->seq;
+
+  if ((conn = l_connpool_takeIdle(host, now))) {
+    l_callstate_done(thread, srvc, seq, L_SUCCESS, 0, l_msg_castptr(conn));
+    return i;
+  }
+
+  if (l_pool_max_conns && host->nconn >= l_pool_max_conns) {
+    l_callstate_done(thread, srvc, seq, L_ELIMIT, 0, 0);
+    return i;
+  }
+
+  if (!(conn = (l_poolconn*)l_raw_calloc(sizeof(l_poolconn)))) {
+    l_callstate_done(thread, srvc, seq, L_ENOMEM, 0, 0);
+    return i;
+  }
+
+  conn->host = host;
+  host->nconn += 1;
+  sc.sock = l_filedesc_empty();
+  sc.remote = host->addr;
+
+  if (l_socket_connectEx(&sc, 0, &host->opts)) { /* a local connect can be done at once */
+    conn->sock = sc.sock;
+    conn->born = now;
+    l_callstate_done(thread, srvc, seq, L_SUCCESS, 0, l_msg_castptr(conn));
+    return i;
+  }
+
+  if (l_filedesc_isEmpty(sc.sock)) {
+    l_callstate_done(thread, srvc, seq, L_ERROR, (l_umedit)errno, 0);
+    l_connpool_close(conn);
+    return i;
+  }
+
+  conn->sock = sc.sock;
+  conn->waiter = srvc;
+  conn->seq = seq;
+  conn->next = thread->connecting;
+  thread->connecting = conn;
+  l_message_addServiceEvent(thread, conn->sock, L_SERVICE_POOL | thread->index, L_SOCKET_WRITE);
+  return i;
+}
+
+L_EXTERN int
+l_connpool_result(l_service* srvc, l_int i, l_poolconn** conn, int* err)
+{
+  l_callresult* r = 0;
+
+  if (!srvc->call || i < 0 || i >= (l_int)srvc->call->n) {
+    return L_EINVAL;
+  }
+
+  r = srvc->call->a + i;
+  if (conn) *conn = (r->status == L_SUCCESS ? (l_poolconn*)(l_uint)r->extra : 0);
+  if (err) *err = (r->status == L_ERROR ? (int)r->data : 0);
+  return r->status;
+}
+
+L_EXTERN void
+l_connpool_return(l_service* srvc, l_poolconn* conn, int reuse)
+{
+  l_thread* thread = srvc->thread;
+  l_ulong now = l_master_nowms();
+  int attached = false;
+
+  l_mutex_lock(thread->svmtx);
+  if (l_filedesc_equal(srvc->evfd, conn->sock)) {
+    srvc->evfd = l_filedesc_empty();
+    srvc->evmk = 0;
+    attached = true;
+  }
+  l_mutex_unlock(thread->svmtx);
+
+  reuse = reuse && l_connpool_keepable(conn, now); /* decided before master is told */
+
+  if (attached) {
+    srvc->flagw &= (~L_SERVICE_SOCKET);
+    if (reuse) { /* master only takes it out of the event manager, it is idle after the ack */
+      conn->waiter = 0;
+      conn->next = thread->detaching;
+      thread->detaching = conn;
+      l_message_sendtomaster_impl(thread, L_MSGID_SRVC_DETACH_EVENT, thread->index, l_msg_castfd(conn->sock));
+      return;
+    }
+    /* master closes it after taking it out */
+    l_message_delServiceEvent(thread, conn->sock);
+    conn->sock = l_filedesc_empty();
+  }
+
+  if (reuse) {
+    l_connpool_putIdle(conn, now);
+  } else {
+    l_connpool_close(conn);
+  }
+}
+
+static void /* a pool connect is done, msg->data is the masks with the SO_ERROR in the high 16 bits */
+l_worker_poolConnected(l_thread* thread, l_message* msg)
+{
+  l_filedesc fd = l_msg_getfd(msg);
+  l_poolconn** link = &thread->connecting;
+  l_poolconn* conn = 0;
+  l_service* waiter = 0;
+  l_umedit seq = 0;
+  int err = (int)(msg->data >> 16);
+
+  while ((conn = *link) && !l_filedesc_equal(conn->sock, fd)) {
+    link = &conn->next;
+  }
+
+  if (!conn) {
+    l_loge_1("pool connect %d not found", ld(msg->extra));
+    return;
+  }
+
+  *link = conn->next;
+  conn->next = 0;
+
+  if (err == 0 && (msg->data & (L_SOCKET_ERR | L_SOCKET_HUP))) {
+    err = ECONNRESET;
+  }
+
+  if (err) {
+    l_logw_1("pool connect %s", lserror(err));
+    waiter = conn->waiter;
+    seq = conn->seq;
+    l_connpool_close(conn);
+    if (waiter) {
+      l_callstate_done(thread, waiter, seq, L_ERROR, (l_umedit)err, 0);
+    }
+    return;
+  }
+
+  conn->born = l_master_nowms();
+  if (!conn->waiter || !l_callstate_done(thread, conn->waiter, conn->seq, L_SUCCESS, 0, l_msg_castptr(conn))) {
+    l_connpool_putIdle(conn, conn->born); /* the checkout timed out, keep it for the next */
+  }
+}
+
+static void /* master has taken a returned socket out of the event manager */
+l_worker_poolDetached(l_thread* thread, l_message* msg)
+{
+  l_filedesc fd = l_msg_getfd(msg);
+  l_poolconn** link = &thread->detaching;
+  l_poolconn* conn = 0;
+
+  while ((conn = *link) && !l_filedesc_equal(conn->sock, fd)) {
+    link = &conn->next;
+  }
+
+  if (!conn) {
+    l_loge_1("pool detach %d not found", ld(msg->extra));
+    return;
+  }
+
+  *link = conn->next;
+  conn->next = 0;
+  l_connpool_putIdle(conn, l_master_nowms());
+}
+
+static void /* the service is closed, its connects in progress are kept as idle when done */
+l_connpool_forget(l_thread* thread, l_service* srvc)
+{
+  l_poolconn* conn = thread->connecting;
+  for (; conn; conn = conn->next) {
+    if (conn->waiter == srvc) conn->waiter = 0;
+  }
+}
+
+static l_umedit /* the masks of a connect event with the SO_ERROR in the high 16 bits */
+l_master_connectResult(l_ioevent* rxev)
+{
+  l_umedit err = (l_umedit)l_socket_connectError(rxev->fd);
+  return ((err & 0xffff) << 16) | rxev->masks;
+}
+
+static l_thread* /* the thread of a pool index, 0 if it is a worker already exit */
+l_master_poolThread(l_thread* master, l_umedit index)
+{
+  l_thread* thread = 0;
+
+  if (index == 0) {
+    return master;
   }
 
-  if (l_filedesc_isEmpty(fd)) {
-    return srvc;
+  if (index > (l_umedit)l_num_workers) {
+    return 0;
   }
 
-  return l_service_set_event_impl(srvc, fd, masks, flags);
+  thread = l_worker_thread + index - 1;
+  return thread->index ? thread : 0; /* the sockets of an exit worker are closed when it is freed */
 }
 
-L_EXTERN l_service*
-l_service_setEvent(l_service* srvc, l_filedesc fd, l_ushort masks)
+static void
+l_master_poolConnected(l_thread* master, l_ioevent* rxev)
 {
-  return l_service_setEventImpl(srvc, fd, masks, 0);
-}
+  l_thread* thread = l_master_poolThread(master, rxev->udata & (L_SERVICE_POOL - 1));
 
-L_EXTERN l_service*
-l_service_setListen(l_service* srvc, l_filedesc fd)
-{
-  return l_service_setEventImpl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_LISTEN);
+  l_eventmgr_del(&l_eventmgr_g, rxev->fd); /* the socket goes back to the thread without the event */
+  if (thread) {
+    l_message_senddata_impl(master, l_worker_svid(thread), L_MSGID_POOL_CONN_RSP, l_master_connectResult(rxev), l_msg_castfd(rxev->fd));
+  }
 }
 
-L_EXTERN l_service*
-l_service_setConnect(l_service* srvc, l_filedesc fd)
+static void
+l_master_poolDetached(l_thread* master, l_message* msg)
 {
-  return l_service_setEventImpl(srvc, fd, L_SOCKET_RDWR, L_SOCKET_FLAG_CONNECT);
+  l_thread* thread = l_master_poolThread(master, msg->data);
+  l_filedesc fd = l_msg_getfd(msg);
+
+  l_eventmgr_del(&l_eventmgr_g, fd); /* the socket is kept open by the sender */
+  if (thread) {
+    l_message_senddata_impl(master, l_worker_svid(thread), L_MSGID_POOL_DETACH_RSP, 0, msg->extra);
+  }
 }
 
-L_EXTERN void
-l_service_delEvent(l_service* srvc)
+/**
+ * receive slabs
+ *
+ * the free list of a thread only holds rx_slab_size slabs and the slab released
+ * last is taken first, it is likely still in cache. a larger slab is a request
+ * that outgrew the pooled size, it is rare and freed as soon as released.
+ */
+
+L_EXTERN l_rxslab*
+l_rxslab_acquire(l_service* srvc, l_int minsize)
 {
   l_thread* thread = srvc->thread;
-  l_filedesc fd = l_filedesc_empty();
+  l_rxslab* slab = 0;
+  l_int cap = l_rx_slab_size;
 
-  if (!(srvc->flagw | L_SERVICE_STARTED)) {
-    l_loge_1("service not started %d", ld(srvc->svid));
-    return;
+  if (minsize <= cap && (slab = thread->rxslab)) {
+    thread->rxslab = slab->next;
+    thread->nrxslab -= 1;
+  } else {
+    if (minsize > cap) cap = minsize;
+    if (!(slab = (l_rxslab*)l_raw_malloc(sizeof(l_rxslab) + cap))) {
+      return 0;
+    }
+    slab->cap = cap;
   }
 
-  if (srvc->flagw & L_SERVICE_SOCKET) {
-    l_mutex* svmtx = thread->svmtx;
+  slab->next = 0;
+  slab->refs = 1;
+  slab->size = 0;
+  return slab;
+}
 
-    l_mutex_lock(svmtx);
-    fd = srvc->evfd;
-    srvc->evfd = l_filedesc_empty();
-    l_mutex_unlock(svmtx);
+L_EXTERN void
+l_rxslab_release(l_service* srvc, l_rxslab** slab)
+{
+  l_thread* thread = srvc->thread;
+  l_rxslab* p = *slab;
 
-    srvc->flagw &= (~L_SERVICE_SOCKET);
+  if (!p) return;
+  *slab = 0;
+
+  if (--p->refs > 0) {
+    return; /* still referenced by spans */
   }
 
-  if (l_filedesc_isEmpty(fd)) {
+  if (p->cap == l_rx_slab_size && thread->nrxslab < l_rx_slab_max_free) {
+    p->next = thread->rxslab;
+    thread->rxslab = p;
+    thread->nrxslab += 1;
     return;
   }
 
-  l_message_delServiceEvent(thread, fd);
+  l_raw_mfree(p);
 }
 
-L_EXTERN void
-l_service_mod_event_impl(l_service* srvc, l_filedesc fd, l_ushort masks, l_ushort flags)
+L_EXTERN int /* keep the data from start, release the slab if nothing is kept or wanted, false if no memory and the slab is unchanged */
+l_rxslab_ensure(l_service* srvc, l_rxslab** slab, l_int start, l_int remain)
 {
-  l_filedesc oldfd;
-  l_thread* thread = 0;
-  l_mutex* svmtx = 0;
+  l_rxslab* p = *slab;
+  l_rxslab* q = 0;
+  l_int n = 0;
 
-  if (!(srvc->flagw | L_SERVICE_STARTED)) {
-    l_loge_1("service not started %d", ld(srvc->svid));
-    return;
+  if (!p) {
+    if (remain <= 0) return true;
+    return (*slab = l_rxslab_acquire(srvc, remain)) != 0;
   }
 
-  oldfd = l_filedesc_empty();
-  thread = srvc->thread;
-  svmtx = thread->svmtx;
+  n = p->size - start;
+  if (n == 0 && remain <= 0) {
+    l_rxslab_release(srvc, slab);
+    return true;
+  }
 
-  l_mutex_lock(svmtx);
-  if (!l_filedesc_isEmpty(srvc->evfd)) {
-    oldfd = srvc->evfd;
-    srvc->evfd = l_filedesc_empty();
+  if (start == 0 && l_rxslab_remain(p) >= remain) {
+    return true; /* appending doesn't touch the data of the spans */
   }
-  srvc->flagw &= (~L_SERVICE_SOCKET);
-  if (!l_filedesc_isEmpty(fd)) {
-    l_service_set_event_impl(srvc, fd, masks, flags);
+
+  if (p->refs == 1 && p->cap - n >= remain) {
+    l_copy_n(l_rxslab_data(p) + start, n, l_rxslab_data(p));
+    p->size = n;
+    return true;
   }
-  srvc->evmk = 0; /* clear masks, prepare to receive */
-  l_mutex_unlock(svmtx);
 
-  if (!l_filedesc_isEmpty(oldfd)) {
-    l_message_delServiceEvent(thread, fd);
+  if (n + remain > p->cap && n + remain < p->cap * 2) {
+    remain = p->cap * 2 - n; /* grow by double, a large request is read in several times */
   }
 
-  if (!l_filedesc_isEmpty(fd)) {
-    l_message_addServiceEvent(srvc->thread, fd, l_service_id_for_lookup(srvc), masks);
+  if (!(q = l_rxslab_acquire(srvc, n + remain))) {
+    return false;
   }
-}
 
-L_EXTERN void
-l_service_modEvent(l_service* srvc, l_filedesc fd, l_ushort masks)
-{
-  l_service_mod_event_impl(srvc, fd, masks, 0);
+  l_copy_n(l_rxslab_data(p) + start, n, l_rxslab_data(q));
+  q->size = n;
+  l_rxslab_release(srvc, slab);
+  *slab = q;
+  return true;
 }
 
-L_EXTERN void
-l_service_modListen(l_service* srvc, l_filedesc fd)
+L_EXTERN l_rxspan
+l_rxslab_span(l_rxslab* slab, l_int start, l_int end)
 {
-  l_service_mod_event_impl(srvc, fd, L_SOCKET_READ, L_SOCKET_FLAG_LISTEN);
+  l_rxspan span;
+  slab->refs += 1;
+  span.slab = slab;
+  span.start = l_rxslab_data(slab) + start;
+  span.end = l_rxslab_data(slab) + end;
+  return span;
 }
 
 L_EXTERN void
-l_service_modConnect(l_service* srvc, l_filedesc fd)
+l_rxspan_release(l_service* srvc, l_rxspan* span)
 {
-  l_service_mod_event_impl(srvc, fd, L_SOCKET_RDWR, L_SOCKET_FLAG_CONNECT);
+  l_rxslab_release(srvc, &span->slab);
+  span->start = span->end = 0;
 }
 
 /**
  * task dispatch
  */
 
-static int
-l_thread_less(void* lhs, void* rhs)
-{
-  return ((l_thread*)lhs)->weight < ((l_thread*)rhs)->weight;
-}
-
 static void
 l_master_init()
 {
@@ -1395,7 +3317,7 @@ l_master_init()
 
   /* worker thread pool */
 
-  l_priorq_init(&l_thread_pool, l_thread_less);
+  l_priorq_init(&l_thread_pool, (l_int)offsetof(l_thread, poolpos));
 
   if (conf->workers > 0) {
     l_num_workers = conf->workers;
@@ -1406,7 +3328,7 @@ l_master_init()
       thread->index = i + 1; /* worker index should not 0 */
       l_thread_init(thread, conf);
       thread->L = l_luastate_new();
-      l_priorq_push(&l_thread_pool, &thread->node);
+      l_priorq_push(&l_thread_pool, thread, thread->weight);
     }
 
   } else {
@@ -1427,15 +3349,43 @@ l_master_init()
   /* service */
 
   l_mutex_init(&l_srvc_mtx);
+  l_mutex_init(&l_topic_mtx);
+  l_topic_table = l_hashtable_createKeyed(4, sizeof(l_topic));
+  l_mmheap_init(&l_timer_heap, (l_int)offsetof(l_mstimer, pos), 0);
+  l_timer_table = l_hashtable_create(4);
+  l_mutex_init(&l_loop_mtx);
+  l_loop_snap = (l_loopstat*)l_raw_calloc(sizeof(l_loopstat) * (1 + l_num_workers));
+  l_loop_snapms = 0;
+  l_loop_interval = l_loop_snap ? (l_ulong)conf->loop_stats_interval : 0;
+  l_loop_nextms = l_loop_interval ? l_master_nowms() + l_loop_interval : 0;
   l_svid_seed = L_SERVICE_START_ID;
+  l_mailbox_depth = (l_umedit)conf->mailbox_depth;
+  l_inbox_control_weight = conf->inbox_control_weight;
+  l_inbox_data_weight = conf->inbox_data_weight;
+  l_msg_tracing = conf->message_tracing;
+  l_io_budget = conf->io_budget;
+  l_io_budget_calls = conf->io_budget_calls;
+  l_pool_max_idle = (l_umedit)conf->pool_max_idle;
+  l_pool_max_conns = (l_umedit)conf->pool_max_conns;
+  l_pool_idle_timeout = (l_ulong)conf->pool_idle_timeout;
+  l_pool_lifetime = (l_ulong)conf->pool_lifetime;
+  l_rx_slab_size = conf->rx_slab_size;
+  l_rx_slab_max_free = (l_umedit)conf->rx_slab_max_free;
+  l_hash_initSeed(); /* before other threads start */
   l_srvctable_init(&l_srvc_table, conf->service_table_size);
 
   l_initialized = true;
 
   /* others */
 
-  l_logm_5("workers %d log_buffer_size %d service_table_size 2^%d thread_max_free_memory %d logfile_prefix %strt",
-      ld(conf->workers), ld(conf->log_buffer_size), ld(conf->service_table_size), ld(conf->thread_max_free_memory), lstrt(&prefix));
+  l_logm_6("workers %d log_buffer_size %d service_table_size 2^%d thread_max_free_memory %d mailbox_depth %d logfile_prefix %strt",
+      ld(conf->workers), ld(conf->log_buffer_size), ld(conf->service_table_size), ld(conf->thread_max_free_memory), ld(conf->mailbox_depth), lstrt(&prefix));
+  l_logm_6("inbox_control_weight %d inbox_data_weight %d message_tracing %d loop_stats_interval %d io_budget %d io_budget_calls %d",
+      ld(conf->inbox_control_weight), ld(conf->inbox_data_weight), ld(conf->message_tracing), ld(conf->loop_stats_interval),
+      ld(conf->io_budget), ld(conf->io_budget_calls));
+  l_logm_4("pool_max_idle %d pool_max_conns %d pool_idle_timeout %d pool_lifetime %d",
+      ld(conf->pool_max_idle), ld(conf->pool_max_conns), ld(conf->pool_idle_timeout), ld(conf->pool_lifetime));
+  l_logm_2("rx_slab_size %d rx_slab_max_free %d", ld(conf->rx_slab_size), ld(conf->rx_slab_max_free));
 
   l_config_free(conf);
 }
@@ -1444,6 +3394,7 @@ static void
 l_master_clean()
 {
   l_smplnode* node = 0;
+  void* timer = 0;
   l_thread* thread = 0;
   l_thread* master = l_thread_master();
 
@@ -1467,6 +3418,32 @@ l_master_clean()
   l_srvctable_free(&l_srvc_table, l_raw_alloc_func);
   l_mutex_free(&l_srvc_mtx);
 
+  /* clean topics */
+
+  l_hashtable_free(&l_topic_table, l_raw_alloc_func);
+  if (l_topic_array) {
+    l_raw_mfree(l_topic_array);
+    l_topic_array = 0;
+  }
+  l_topic_count = l_topic_capacity = 0;
+  l_mutex_free(&l_topic_mtx);
+
+  /* clean timers */
+
+  while ((timer = l_mmheap_pop(&l_timer_heap))) {
+    l_raw_mfree(timer);
+  }
+  l_mmheap_free(&l_timer_heap);
+  l_hashtable_free(&l_timer_table, 0); /* the timers are freed above */
+
+  /* clean loop snapshot */
+
+  if (l_loop_snap) {
+    l_raw_mfree(l_loop_snap);
+    l_loop_snap = 0;
+  }
+  l_mutex_free(&l_loop_mtx);
+
   /* clean threads */
 
   l_thread_free(master);
@@ -1475,6 +3452,8 @@ l_master_clean()
     l_thread_free(thread);
   }
 
+  l_priorq_free(&l_thread_pool);
+
   if (l_worker_thread) {
     l_raw_mfree(l_worker_thread);
     l_worker_thread = 0;
@@ -1505,6 +3484,150 @@ l_master_acceptConnection(void* ud, l_sockconn* conn)
   l_message_send_impl(master, l_service_id(srvc), L_MSGID_SOCK_CONN_IND, (family << 16) | l_sockaddr_port(rmt), l_msg_castfd(conn->sock), msg);
 }
 
+#define L_MASTER_ACCEPT_BATCH 32
+
+typedef struct {
+  l_message head;
+  l_sockconn conn[L_MASTER_ACCEPT_BATCH];
+} l_acceptmsg;
+
+L_GLOBAL l_umedit l_accept_next; /* the worker to hand off next, only accessed by master */
+
+static l_ulong
+l_master_acceptWorker()
+{
+  l_thread* thread = 0;
+  int i = 0;
+
+  for (; i < l_num_workers; ++i) {
+    thread = l_worker_thread + (l_accept_next++ % l_num_workers);
+    if (thread->index) return l_worker_svid(thread);
+  }
+
+  return L_SERVICE_WORKER; /* no worker, the master handles it */
+}
+
+static void /* accept in batches and spread each batch to the workers */
+l_master_handOffConnections(l_service* srvc, l_filedesc sock)
+{
+  l_thread* master = l_thread_master();
+  l_sockconn conn[L_MASTER_ACCEPT_BATCH];
+  l_message* msg = 0;
+  int nworker = l_num_workers > 0 ? l_num_workers : 1;
+  int n = 0, i = 0, j = 0, k = 0, per = 0;
+
+  do {
+    n = l_socket_acceptBatch(sock, conn, L_MASTER_ACCEPT_BATCH);
+    per = (n + nworker - 1) / nworker;
+    for (i = 0; i < n; i += k) {
+      k = (n - i < per) ? n - i : per;
+      msg = l_message_create((l_int)(offsetof(l_acceptmsg, conn) + sizeof(l_sockconn) * k), master);
+      if (!msg) { /* close the chunk and go on with the next one */
+        for (j = i; j < i + k; ++j) l_socket_close(&conn[j].sock);
+        continue;
+      }
+      l_copy_n(conn + i, sizeof(l_sockconn) * k, ((l_acceptmsg*)msg)->conn);
+      l_message_send_impl(master, l_master_acceptWorker(), L_MSGID_ACCEPT_CONN, (l_umedit)k, l_msg_castptr(srvc), msg);
+    }
+  } while (n == L_MASTER_ACCEPT_BATCH); /* the event is edge triggered, drain the queue */
+}
+
+static void
+l_worker_acceptConnections(l_message* msg)
+{
+  l_service* listen = (l_service*)l_msg_getptr(msg);
+  l_sockconn* conn = ((l_acceptmsg*)msg)->conn;
+  l_umedit i = 0;
+
+  for (; i < msg->data; ++i) {
+    if (!listen->conn(listen, conn + i)) {
+      l_socket_close(&conn[i].sock);
+    }
+  }
+}
+
+static void /* a listen shard accepts on its own worker until the queue is empty */
+l_worker_acceptShard(l_service* srvc, l_filedesc sock)
+{
+  l_sockconn conn[L_MASTER_ACCEPT_BATCH];
+  int n = 0, i = 0;
+
+  do {
+    n = l_socket_acceptBatch(sock, conn, L_MASTER_ACCEPT_BATCH);
+    for (i = 0; i < n; ++i) {
+      if (!srvc->conn(srvc, conn + i)) {
+        l_socket_close(&conn[i].sock);
+      }
+    }
+  } while (n == L_MASTER_ACCEPT_BATCH);
+}
+
+static l_message* /* the datagram message of the thread, grown to the largest dgsize */
+l_thread_dgramMessage(l_thread* thread, l_int dgsize)
+{
+  l_int size = (l_int)sizeof(l_dgram_message) + L_DGRAM_BATCH * dgsize;
+
+  if (thread->dgmsg && thread->dgcap >= size) {
+    return thread->dgmsg;
+  }
+
+  if (thread->dgmsg) {
+    l_raw_mfree(thread->dgmsg);
+  }
+
+  thread->dgcap = 0;
+  if (!(thread->dgmsg = (l_message*)l_raw_malloc(size))) {
+    return 0;
+  }
+
+  thread->dgcap = size;
+  return thread->dgmsg;
+}
+
+static void /* receive the datagrams into one message and call the service for each batch */
+l_worker_receiveDgrams(l_thread* thread, l_service* srvc, l_filedesc sock)
+{
+  l_message* msg = 0;
+  l_dgram* dgram = 0;
+  l_byte* data = 0;
+  l_int bytes = 0;
+  int n = 0, i = 0;
+
+  if (!(msg = l_thread_dgramMessage(thread, srvc->dgsize))) {
+    l_service_requeueEvent(srvc, L_SOCKET_READ);
+    return;
+  }
+
+  l_message_fill(msg, l_service_id(srvc), L_MSGID_DGRAM_IND, 0, 0);
+  msg->from = msg->tsend = msg->troute = 0;
+  dgram = l_msg_dgram(msg);
+  data = (l_byte*)msg + sizeof(l_dgram_message);
+  thread->iobytes = l_io_budget;
+  thread->iocalls = l_io_budget_calls;
+
+  for (;;) {
+    for (i = 0; i < L_DGRAM_BATCH; ++i) {
+      dgram[i].data = data + i * srvc->dgsize;
+      dgram[i].size = srvc->dgsize;
+    }
+    if ((n = l_socket_recvBatch(sock, dgram, L_DGRAM_BATCH)) <= 0) {
+      break;
+    }
+    msg->data = (l_umedit)n;
+    srvc->entry(srvc, msg);
+    if (n < L_DGRAM_BATCH || (srvc->flagw & L_SERVICE_CLOSING)) {
+      break;
+    }
+    for (bytes = 0, i = 0; i < n; ++i) {
+      bytes += dgram[i].len;
+    }
+    if (!l_service_ioSpend(srvc, bytes)) {
+      l_service_requeueEvent(srvc, L_SOCKET_READ);
+      break;
+    }
+  }
+}
+
 static void
 l_master_dispatchEvent(l_ioevent* rxev)
 {
@@ -1514,6 +3637,12 @@ l_master_dispatchEvent(l_ioevent* rxev)
   l_mutex* svmtx = 0;
 
   if (l_filedesc_isEmpty(rxev->fd) || rxev->masks == 0) return;
+
+  if ((rxev->udata & ~(l_umedit)(L_SERVICE_POOL - 1)) == L_SERVICE_POOL) {
+    l_master_poolConnected(master, rxev);
+    return;
+  }
+
   if (!(srvc = l_master_findService(rxev->udata))) return;
 
   thread = srvc->thread;
@@ -1525,18 +3654,33 @@ l_master_dispatchEvent(l_ioevent* rxev)
     return;
   }
 
+  if ((srvc->flags & L_SOCKET_FLAG_SHARD) && srvc->conn) {
+    if (srvc->evmk == 0) { /* the shard drains the queue after it clears evmk */
+      srvc->evmk = rxev->masks;
+      l_mutex_unlock(svmtx);
+      l_message_senddata_impl(master, l_service_id(srvc), L_MSGID_ACCEPT_READY, rxev->masks, l_msg_castfd(rxev->fd));
+      return;
+    }
+    l_mutex_unlock(svmtx);
+    return;
+  }
+
   if (srvc->flags & L_SOCKET_FLAG_LISTEN) {
     l_mutex_unlock(svmtx);
     /* TODO: error check */
-    l_socket_accept(rxev->fd, l_master_acceptConnection, srvc);
+    if (srvc->conn) {
+      l_master_handOffConnections(srvc, rxev->fd);
+    } else {
+      l_socket_accept(rxev->fd, l_master_acceptConnection, srvc);
+    }
     return;
   }
 
   if (srvc->flags & L_SOCKET_FLAG_CONNECT) {
     srvc->flags &= (~L_SOCKET_FLAG_CONNECT);
     l_mutex_unlock(svmtx);
-    /* TODO: error check and what if current the data from remote can be read */
-    l_message_senddata_impl(master, l_service_id(srvc), L_MSGID_SOCK_CONN_RSP, rxev->masks, l_msg_castfd(rxev->fd));
+    /* the SO_ERROR is in the high 16 bits of the masks, the data from remote can be read if L_SOCKET_READ is set */
+    l_message_senddata_impl(master, l_service_id(srvc), L_MSGID_SOCK_CONN_RSP, l_master_connectResult(rxev), l_msg_castfd(rxev->fd));
     return;
   }
 
@@ -1557,12 +3701,36 @@ l_worker_handleMessage(l_thread* thread, l_message* msg)
   l_buffer buffer;
   l_service* srvc = 0;
   l_mutex* mtx = 0;
+  l_ulong start = 0;
+  int dgram = false;
+
+  if (msg->from) {
+    l_thread_addGrant(thread, msg->from);
+  }
 
   if (msg->dest == L_SERVICE_WORKER) {
     switch (msg->msgid) {
+    case L_MSGID_CREDIT_GRANT:
+      l_credit_grant(thread, (l_umedit)msg->extra, msg->data);
+      return true;
+    case L_MSGID_TOPIC_PUBLISH:
+      l_worker_deliverTopic(thread, msg);
+      return true;
+    case L_MSGID_ACCEPT_CONN:
+      l_worker_acceptConnections(msg);
+      return true;
+    case L_MSGID_POOL_CONN_RSP:
+      l_worker_poolConnected(thread, msg);
+      return true;
+    case L_MSGID_POOL_DETACH_RSP:
+      l_worker_poolDetached(thread, msg);
+      return true;
     case L_MSGID_SRVC_CLOSE_RSP: /* master already remove the service out of the table */
       srvc = (l_service*)l_msg_getptr(msg);
       srvc->entry(srvc, msg); /* let service handle the last one msg L_MSGID_SRVC_CLOSE_RSP */
+      l_topicsub_removeAll(thread, srvc);
+      l_connpool_forget(thread, srvc);
+      l_callstate_free(srvc);
       l_logm_1("service %d closed", ld(srvc->svid));
       buffer.p = srvc;
       l_buffer_free(&buffer, thread);
@@ -1584,13 +3752,33 @@ l_worker_handleMessage(l_thread* thread, l_message* msg)
   }
 
   switch (msg->msgid) {
+  case L_MSGID_CALL_REPLY:
+  case L_MSGID_CALL_TIMEOUT:
+    l_worker_handleCall(thread, srvc, msg);
+    return true;
   case L_MSGID_SOCK_EVENT_IND:
     mtx = thread->svmtx;
     l_mutex_lock(mtx);
     msg->data = srvc->evmk;
+    dgram = (srvc->flags & L_SOCKET_FLAG_DGRAM);
     srvc->evmk = 0;
     l_mutex_unlock(mtx);
+    if ((msg->data & L_SOCKET_READ) && dgram) {
+      l_worker_receiveDgrams(thread, srvc, l_msg_getfd(msg));
+      msg->data &= ~L_SOCKET_READ;
+      if (msg->data == 0 || (srvc->flagw & L_SERVICE_CLOSING)) {
+        l_worker_handleClosing(thread, srvc);
+        return true;
+      }
+    }
     break;
+  case L_MSGID_ACCEPT_READY:
+    mtx = thread->svmtx;
+    l_mutex_lock(mtx);
+    srvc->evmk = 0;
+    l_mutex_unlock(mtx);
+    l_worker_acceptShard(srvc, l_msg_getfd(msg));
+    return true;
   case L_MSGID_SRVC_START_RSP:
     l_logm_1("service %d started", ld(srvc->svid));
     break;
@@ -1598,19 +3786,18 @@ l_worker_handleMessage(l_thread* thread, l_message* msg)
     break;
   }
 
-  srvc->entry(srvc, msg);
-
-  if (srvc->flagw & L_SERVICE_CLOSING) {
-    l_service_freeState(srvc);
-
-    l_thread_lock(thread);
-    srvc->flags |= L_SERVICE_STOPRX;
-    l_thread_unlock(thread);
+  thread->iobytes = l_io_budget;
+  thread->iocalls = l_io_budget_calls;
 
-    l_service_delEvent(srvc);
-    l_message_closeService(thread, l_service_id_for_lookup(srvc));
+  if (msg->tsend && msg->troute) {
+    start = l_message_nowns();
+    srvc->entry(srvc, msg);
+    l_thread_traceMessage(thread, msg, start, l_message_nowns());
+  } else {
+    srvc->entry(srvc, msg);
   }
 
+  l_worker_handleClosing(thread, srvc);
   return true;
 }
 
@@ -1675,6 +3862,15 @@ l_master_handleMessage(l_squeue* frmq)
         l_filedesc_close(&fd);
       }
       break;
+    case L_MSGID_SRVC_ADD_TIMER:
+      l_master_addTimer(msg);
+      break;
+    case L_MSGID_SRVC_DEL_TIMER:
+      l_master_delTimer(msg);
+      break;
+    case L_MSGID_SRVC_DETACH_EVENT:
+      l_master_poolDetached(master, msg);
+      break;
     case L_MSGID_SRVC_ADD_EVENT: {
         l_ioevent event;
         event.fd = l_msg_getfd(msg);
@@ -1737,9 +3933,9 @@ l_master_handleMessage(l_squeue* frmq)
       }
       break;
     default:
-      if (l_worker_thread) {
+      if (msg->dest == L_SERVICE_MASTER || (msg->msgid > L_MSGID_MIN_MASTER_MSG && msg->msgid < L_MSGID_MAX_MASTER_MSG)) {
         l_loge_1("unknow message %d", ld(msg->msgid));
-      } else {
+      } else { /* routed to the worker service of master or a service on master */
         l_worker_handleMessage(master, msg);
       }
       break;
@@ -1749,9 +3945,29 @@ l_master_handleMessage(l_squeue* frmq)
     if (masterExit) return false;
   }
 
+  l_thread_flushGrants(master);
   return true;
 }
 
+static void /* free the message cannot be delivered, and give back its credit or payload */
+l_master_dropMessage(l_thread* master, l_squeue* frmq, l_message* msg)
+{
+  if (msg->from) {
+    l_message_grantCredit(master, msg->from, 1);
+  }
+  if (msg->msgid == L_MSGID_TOPIC_PUBLISH) {
+    l_payload_release((l_payload*)l_msg_getptr(msg));
+  }
+  if (msg->msgid == L_MSGID_ACCEPT_CONN) { /* no one takes the accepted sockets */
+    l_sockconn* conn = ((l_acceptmsg*)msg)->conn;
+    l_umedit i = 0;
+    for (; i < msg->data; ++i) {
+      l_socket_close(&conn[i].sock);
+    }
+  }
+  l_squeue_push(frmq, &msg->HEAD.node);
+}
+
 static int
 l_bootstrap_service_proc(l_service* self, l_message* msg)
 {
@@ -1791,18 +4007,24 @@ l_master_loop(int (*start)())
   l_thread* master = l_thread_master();
   l_thread* worker = l_worker_thread;
   l_thread* thread = 0;
-  l_uint waitCount = 0;
-  l_squeue* mq = 0;
+  l_squeue* mq = 0; /* data lane queue for each worker */
+  l_squeue* mcq = 0; /* control lane queue for each worker */
   l_umedit destsvid = 0;
+  l_ulong troute = 0;
+  l_ulong twait = 0;
+  l_ulong nroute = 0;
+  int nevent = 0;
   int i = 0, n = 0;
   int exitCode = 0;
 
   l_logm_s("master run");
 
   if (l_num_workers > 0) {
-    mq = (l_squeue*)l_raw_calloc(sizeof(l_squeue) * l_num_workers);
-    for (n = 0; n < l_num_workers; ++n) { 
+    mq = (l_squeue*)l_raw_calloc(sizeof(l_squeue) * l_num_workers * 2);
+    mcq = mq + l_num_workers;
+    for (n = 0; n < l_num_workers; ++n) {
       l_squeue_init(mq + n);
+      l_squeue_init(mcq + n);
     }
     n = l_num_workers;
   }
@@ -1817,10 +4039,13 @@ l_master_loop(int (*start)())
   l_message_startBootstrap(master, start); /* send BOOTSTRAP message */
 
   for (; ;) {
+    l_loopstat_add(&master->loop.loops, 1);
+
     if (l_squeue_isEmpty(master->txms) && l_squeue_isEmpty(master->txmq)) {
-      l_logm_1("master T%d wait", ld(++waitCount));
-      l_eventmgr_wait(&l_eventmgr_g, l_master_dispatchEvent);
-      l_logm_1("master T%d wakeup", ld(waitCount));
+      twait = l_thread_waitBegin(master);
+      nevent = l_eventmgr_timedWait(&l_eventmgr_g, l_master_timerWait(), l_master_dispatchEvent);
+      l_thread_waitEnd(master, twait);
+      l_loopstat_add(&master->loop.events, nevent > 0 ? nevent : 0);
     }
 
     if (!l_master_handleMessage(&frmq)) {
@@ -1829,20 +4054,20 @@ l_master_loop(int (*start)())
       break;
     }
 
+    l_master_fireTimers(master);
+
     l_master_getMessages(master, &rxmq); /* messages need send to workers */
+    troute = l_msg_tracing ? l_message_nowns() : 0; /* one stamp for the routing pass */
+    nroute = 0;
 
     while ((msg = (l_message*)l_squeue_pop(&rxmq))) {
       destsvid = l_msg_dest_svid(msg);
+      ++nroute;
 
       if (destsvid == L_SERVICE_WORKER) {
         l_uint index = l_msg_dest_tidx(msg);
         srvc = (l_service*)(l_uint)L_SERVICE_WORKER;
-        if (index == 0) {
-          if (l_worker_thread) { /* already exit */
-            l_squeue_push(&frmq, &msg->HEAD.node);
-            l_loge_1("worker service message %d cannot handle", ld(msg->msgid));
-            continue;
-          }
+        if (index == 0) { /* the worker service of master, e.g. a credit grant to a service on master */
           thread = l_thread_master();
         } else {
           thread = worker + index - 1;
@@ -1850,20 +4075,21 @@ l_master_loop(int (*start)())
       } else {
         srvc = l_master_findService(destsvid);
         if (!srvc) {
-          l_squeue_push(&frmq, &msg->HEAD.node);
+          l_master_dropMessage(master, &frmq, msg);
           continue;
         }
         thread = srvc->thread;
         l_mutex_lock(thread->svmtx);
         if (srvc->flags & L_SERVICE_STOPRX) { /* if this service is stopped to receive message */
           l_mutex_unlock(thread->svmtx);
-          l_squeue_push(&frmq, &msg->HEAD.node);
+          l_master_dropMessage(master, &frmq, msg);
           continue;
         }
         l_mutex_unlock(thread->svmtx);
       }
 
       msg->dest = (l_ulong)(l_uint)srvc;
+      msg->troute = msg->tsend ? troute : 0;
 
       if (thread == l_thread_master()) {
         l_squeue_push(master->txms, &msg->HEAD.node);
@@ -1871,24 +4097,30 @@ l_master_loop(int (*start)())
       }
 
       if (thread->index == 0) { /* already exit */
-        l_squeue_pushQueue(&frmq, mq + i);
+        l_master_dropMessage(master, &frmq, msg);
         continue;
       }
 
-      l_squeue_push(mq + thread->index - 1, &msg->HEAD.node);
+      l_squeue_push((msg->lane == L_MSGLANE_CONTROL ? mcq : mq) + thread->index - 1, &msg->HEAD.node);
     }
 
     for (i = 0; i < n; ++i) {
-      if (l_squeue_isEmpty(mq + i)) continue;
+      if (l_squeue_isEmpty(mq + i) && l_squeue_isEmpty(mcq + i)) continue;
       thread = worker + i;
 
-      if (thread->index == 0) { /* already exit */
-        l_squeue_pushQueue(&frmq, mq + i);
+      if (thread->index == 0) { /* already exit, give back the credit and payload of each message */
+        while ((msg = (l_message*)l_squeue_pop(mq + i))) {
+          l_master_dropMessage(master, &frmq, msg);
+        }
+        while ((msg = (l_message*)l_squeue_pop(mcq + i))) {
+          l_master_dropMessage(master, &frmq, msg);
+        }
         continue;
       }
 
       l_thread_lock(thread);
       l_squeue_pushQueue(thread->rxmq, mq + i);
+      l_squeue_pushQueue(thread->rxcq, mcq + i);
       if (thread->msgwait) {
         l_thread_unlock(thread);
         continue;
@@ -1897,8 +4129,11 @@ l_master_loop(int (*start)())
       l_thread_unlock(thread);
 
       l_condv_signal(thread->condv);
+      l_loopstat_add(&master->loop.signals, 1);
     }
 
+    l_loopstat_add(&master->loop.messages, nroute);
+
     l_message_freeQueue(&frmq, master);
   }
 
@@ -1911,14 +4146,34 @@ l_master_loop(int (*start)())
   return exitCode;
 }
 
+static int /* handle at most n messages of the lane, return false if the worker need exit */
+l_worker_handleLane(l_thread* thread, l_squeue* lane, l_squeue* frmq, l_int n)
+{
+  l_message* msg = 0;
+  int alive = true;
+  l_ulong handled = 0;
+
+  for (; n > 0 && (msg = (l_message*)l_squeue_pop(lane)); --n) {
+    if (!l_worker_handleMessage(thread, msg)) {
+      alive = false;
+    }
+    l_squeue_push(frmq, &msg->HEAD.node);
+    ++handled;
+  }
+
+  l_loopstat_add(&thread->loop.messages, handled);
+  return alive;
+}
+
 static int
 l_worker_start()
 {
-  l_squeue msgq, frmq;
-  l_message* msg = 0;
+  l_squeue ctlq, msgq, frmq;
   l_thread* thread = 0;
   int threadExit = false;
+  l_ulong start = 0;
 
+  l_squeue_init(&ctlq);
   l_squeue_init(&msgq);
   l_squeue_init(&frmq);
   thread = l_thread_self();
@@ -1926,23 +4181,43 @@ l_worker_start()
   l_logm_1("worker %d run", ld(thread->index));
 
   for (; ;) {
+    l_loopstat_add(&thread->loop.loops, 1);
+
     l_thread_lock(thread);
-    while (l_squeue_isEmpty(thread->rxmq)) {
-      thread->msgwait = 0;
-      l_condv_wait(thread->condv, thread->mutex);
+    if (l_squeue_isEmpty(thread->rxcq) && l_squeue_isEmpty(thread->rxmq)) {
+      start = l_thread_waitBegin(thread);
+      while (l_squeue_isEmpty(thread->rxcq) && l_squeue_isEmpty(thread->rxmq)) {
+        thread->msgwait = 0;
+        l_condv_wait(thread->condv, thread->mutex);
+      }
+      l_thread_waitEnd(thread, start);
     }
+    l_squeue_pushQueue(&ctlq, thread->rxcq);
     l_squeue_pushQueue(&msgq, thread->rxmq);
     l_thread_unlock(thread);
 
-    while ((msg = (l_message*)l_squeue_pop(&msgq))) {
-      if (!l_worker_handleMessage(thread, msg)) {
+    /* drain the lanes by weight, the control lane is refilled after each data
+    slice, so a control message waits at most one slice of data messages */
+    for (; ;) {
+      if (!l_worker_handleLane(thread, &ctlq, &frmq, l_inbox_control_weight)) {
+        threadExit = true;
+      }
+      if (!l_worker_handleLane(thread, &msgq, &frmq, l_inbox_data_weight)) {
         threadExit = true;
       }
-      l_squeue_push(&frmq, &msg->HEAD.node);
-    }
 
-    l_message_freeQueue(&frmq, thread);
-    l_worker_flushMessages(thread);
+      l_thread_flushGrants(thread);
+      l_message_freeQueue(&frmq, thread);
+      l_worker_flushMessages(thread);
+
+      if (l_squeue_isEmpty(&ctlq) && l_squeue_isEmpty(&msgq)) {
+        break;
+      }
+
+      l_thread_lock(thread);
+      l_squeue_pushQueue(&ctlq, thread->rxcq);
+      l_thread_unlock(thread);
+    }
 
     if (threadExit) {
       break;
@@ -2084,6 +4359,145 @@ l_resume_test()
   l_service_freeState(&srvc);
 }
 
+static void
+l_rxslab_test()
+{
+  l_service srvc;
+  l_thread thread;
+  l_rxslab* slab = 0;
+  l_rxslab* p = 0;
+  l_rxspan span;
+  srvc.thread = &thread;
+  thread.rxslab = 0;
+  thread.nrxslab = 0;
+
+  l_assert(l_rxslab_ensure(&srvc, &slab, 0, 0) && slab == 0); /* nothing wanted, no slab */
+  l_assert(l_rxslab_ensure(&srvc, &slab, 0, 100) && slab && slab->cap == l_rx_slab_size);
+  l_copy_n("abcde", 5, l_rxslab_data(slab));
+  slab->size = 5;
+  p = slab;
+  l_assert(l_rxslab_ensure(&srvc, &slab, 2, 0) && slab == p && slab->size == 3); /* moved to front */
+  l_assert(l_rxslab_data(slab)[0] == 'c' && l_rxslab_data(slab)[2] == 'e');
+
+  span = l_rxslab_span(slab, 0, 2);
+  l_assert(slab->refs == 2);
+  l_assert(l_rxslab_ensure(&srvc, &slab, 2, 0) && slab != p && slab->size == 1); /* shared, copied out */
+  l_assert(l_rxslab_data(slab)[0] == 'e' && p->refs == 1);
+  l_assert(span.start[0] == 'c' && span.end[-1] == 'd');
+  l_rxspan_release(&srvc, &span);
+  l_assert(span.slab == 0 && thread.nrxslab == 1 && thread.rxslab == p);
+
+  l_assert(l_rxslab_ensure(&srvc, &slab, 1, 0) && slab == 0); /* all consumed, released */
+  l_assert(thread.nrxslab == 2);
+
+  l_assert(l_rxslab_ensure(&srvc, &slab, 0, 10) && thread.nrxslab == 1);
+  slab->size = 5;
+  l_assert(l_rxslab_ensure(&srvc, &slab, 0, l_rx_slab_size) && slab->cap == l_rx_slab_size * 2 && slab->size == 5);
+  l_assert(thread.nrxslab == 2);
+  l_rxslab_release(&srvc, &slab);
+  l_assert(slab == 0 && thread.nrxslab == 2); /* larger slab is freed */
+
+  while ((p = thread.rxslab)) {
+    thread.rxslab = p->next;
+    l_raw_mfree(p);
+  }
+}
+
+static l_poolconn* /* a connection of the host on one end of a socket pair */
+l_connpool_testConn(l_poolhost* host, l_filedesc* peer, l_ulong born)
+{
+  l_filedesc pair[2];
+  l_poolconn* conn = (l_poolconn*)l_raw_calloc(sizeof(l_poolconn));
+  l_assert(l_socket_pair(pair, 0));
+  conn->sock = pair[0];
+  conn->host = host;
+  conn->born = born;
+  host->nconn += 1;
+  *peer = pair[1];
+  return conn;
+}
+
+static void
+l_connpool_test()
+{
+  l_umedit max_idle = l_pool_max_idle, max_conns = l_pool_max_conns;
+  l_ulong idle_timeout = l_pool_idle_timeout, lifetime = l_pool_lifetime;
+  l_service srvc;
+  l_thread thread;
+  l_mutex svmtx;
+  l_sockaddr addr;
+  l_poolhost* host = 0;
+  l_poolconn* a = 0;
+  l_poolconn* b = 0;
+  l_poolconn* c = 0;
+  l_poolconn* conn = 0;
+  l_filedesc peer[3];
+  l_ulong now = l_master_nowms();
+  l_zero_n(&srvc, sizeof(l_service));
+  l_zero_n(&thread, sizeof(l_thread));
+  l_mutex_init(&svmtx);
+  srvc.thread = &thread;
+  srvc.evfd = l_filedesc_empty();
+  thread.svmtx = &svmtx;
+  l_pool_max_idle = 2;
+  l_pool_max_conns = 0;
+  l_pool_idle_timeout = 1000;
+  l_pool_lifetime = 10000;
+
+  l_sockaddr_init(&addr, l_strt_literal("127.0.0.1"), 9);
+  host = l_connpool_host(&thread, &addr, 0);
+  l_assert(host && l_connpool_host(&thread, &addr, 0) == host);
+
+  a = l_connpool_testConn(host, peer + 0, now);
+  b = l_connpool_testConn(host, peer + 1, now);
+  c = l_connpool_testConn(host, peer + 2, now);
+  l_connpool_putIdle(a, now);
+  l_connpool_putIdle(b, now);
+  l_assert(host->nidle == 2 && host->idle == b && host->nconn == 3);
+  l_connpool_putIdle(c, now); /* more than max_idle, closed */
+  l_assert(host->nidle == 2 && host->nconn == 2);
+  l_assert(l_connpool_takeIdle(host, now) == b && host->nidle == 1); /* the last returned first */
+
+  l_assert(l_connpool_checkout(&srvc, &addr, 0) == 0); /* the idle one */
+  l_assert(l_connpool_result(&srvc, 0, &conn, 0) == L_SUCCESS && conn == a && host->nidle == 0);
+  l_pool_max_conns = 2;
+  l_assert(l_connpool_checkout(&srvc, &addr, 0) == 1); /* a and b are checked out */
+  l_assert(l_connpool_result(&srvc, 1, &conn, 0) == L_ELIMIT && conn == 0 && host->nconn == 2);
+
+  l_connpool_return(&srvc, b, true);
+  l_connpool_return(&srvc, a, false);
+  l_assert(host->nidle == 1 && host->idle == b && host->nconn == 1);
+  l_assert(l_connpool_takeIdle(host, now + l_pool_idle_timeout * 2) == 0); /* idle too long */
+  l_assert(host->nidle == 0 && host->nconn == 0);
+  l_socket_close(peer + 0);
+  l_socket_close(peer + 1);
+  l_socket_close(peer + 2);
+
+  a = l_connpool_testConn(host, peer + 0, now - l_pool_lifetime);
+  l_connpool_putIdle(a, now); /* lived too long, closed */
+  l_assert(host->nidle == 0 && host->nconn == 0);
+  l_pool_lifetime = l_pool_idle_timeout / 2;
+  a = l_connpool_testConn(host, peer + 1, now);
+  l_connpool_putIdle(a, now);
+  l_assert(l_connpool_takeIdle(host, now + l_pool_lifetime) == 0 && host->nconn == 0); /* not idle too long but lived too long */
+
+  a = l_connpool_testConn(host, peer + 2, now);
+  l_connpool_putIdle(a, now);
+  l_socket_close(peer + 2);
+  l_assert(l_connpool_takeIdle(host, now) == 0 && host->nconn == 0); /* closed by the peer */
+
+  l_socket_close(peer + 0);
+  l_socket_close(peer + 1);
+  l_callstate_free(&srvc);
+  l_hashtable_foreach(thread.pool, l_thread_freePool, 0);
+  l_hashtable_free(&thread.pool, l_raw_alloc_func);
+  l_mutex_free(&svmtx);
+  l_pool_max_idle = max_idle;
+  l_pool_max_conns = max_conns;
+  l_pool_idle_timeout = idle_timeout;
+  l_pool_lifetime = lifetime;
+}
+
 L_EXTERN void
 l_master_test()
 {
@@ -2098,5 +4512,7 @@ l_master_test()
   l_assert(udata == ((l_ulong)-100));
   l_assert(((l_long)udata) == -100);
   l_resume_test();
+  l_rxslab_test();
+  l_connpool_test();
 }
 
@@ -1,3 +1,6 @@
+#include <string.h>
+#include <time.h>
+
 #define L_LIBRARY_IMPL
 #include "core/string.h"
 #include "core/match.h"
@@ -51,9 +54,15 @@ L_GLOBAL const l_strn l_blanks[] = {
   l_strn_literal("\xe2\x80\xa9")  /* paragraph separator 0x2029 00100000_00101001 */
 };
 
+L_GLOBAL const l_strn l_http_newlines[] = {
+  l_strn_literal("\x0d\x0a"), /* \r\n */
+  l_strn_literal("\x0a") /* \n, RFC 7230 3.5 allows a bare LF as line terminator */
+};
+
 L_GLOBAL l_stringmap l_space_map; /* used to match a space */
 L_GLOBAL l_stringmap l_newline_map; /* used to match a newline */
 L_GLOBAL l_stringmap l_blank_map; /* used to match a blank, blank is a space or a newline */
+L_GLOBAL l_stringmap l_http_newline_map; /* used to match a http line terminator */
 
 L_EXTERN const l_stringmap*
 l_stringmap_space()
@@ -82,6 +91,15 @@ l_stringmap_blank()
   return map;
 }
 
+L_EXTERN const l_stringmap*
+l_stringmap_httpNewline()
+{
+  l_stringmap* map = &l_http_newline_map;
+  if (map->t) return map;
+  *map = l_stringmap_new(2, l_http_newlines, 2, true);
+  return map;
+}
+
 /* char classes
 %a - all letters              %A - the complement of %a
 %d - all digits               %D
@@ -144,6 +162,18 @@ l_stringmap_set(l_stringmap* self, const l_strn* str, l_int numofstr, int casese
       else if (ch >= 'A' && ch <= 'Z') t[charidx].a[ch+32].e |= (1 << stridx);
     }
   }
+
+  self->nlead = 0;
+  for (stridx = 0; stridx < 256; ++stridx) {
+    if (!t[0].a[stridx].m) continue;
+    if (self->nlead < L_STRINGMAP_MAX_LEAD) {
+      self->lead[self->nlead] = (l_byte)stridx;
+    }
+    ++self->nlead;
+  }
+  if (self->nlead > L_STRINGMAP_MAX_LEAD) {
+    self->nlead = 0; /* too many first bytes, only skip by the rune table */
+  }
 }
 
 L_EXTERN l_stringmap
@@ -307,13 +337,62 @@ l_string_matchRepeat(const l_stringmap* map, l_strt s)
   return s.start;
 }
 
+/* return the first position of any of the n bytes in s, or s.end if not found */
+L_EXTERN const l_byte*
+l_string_findAnyOf(l_strt s, const l_byte* bytes, l_int n)
+{
+  l_ulong ones = (~(l_ulong)0) / 255; /* 0x0101...01 */
+  l_ulong highs = ones << 7; /* 0x8080...80 */
+  l_ulong w = 0, x = 0, hit = 0;
+  const l_byte* p = s.start;
+  l_int i = 0;
+
+  /* a byte of x is zero only if the byte of w equals to bytes[i],
+  (x - ones) & ~x & highs is nonzero if and only if x has a zero byte */
+  while (s.end - p >= (l_int)sizeof(l_ulong)) {
+    memcpy(&w, p, sizeof(l_ulong));
+    hit = 0;
+    for (i = 0; i < n; ++i) {
+      x = w ^ (ones * bytes[i]);
+      hit |= (x - ones) & ~x & highs;
+    }
+    if (hit) break;
+    p += sizeof(l_ulong);
+  }
+
+  for (; p < s.end; ++p) {
+    for (i = 0; i < n; ++i) {
+      if (*p == bytes[i]) return p;
+    }
+  }
+  return p;
+}
+
+/* return the first position in [p, end) that a string in the map can start with */
+static const l_byte*
+l_stringmap_skipToLead(const l_stringmap* map, const l_byte* p, const l_byte* end)
+{
+  const l_runeinfo* first = ((const l_runetable*)(map->t))->a;
+
+  if (map->nlead > 0) {
+    return l_string_findAnyOf(l_strt_from(p, end), map->lead, map->nlead);
+  }
+
+  while (p < end && !first[*p].m) {
+    ++p;
+  }
+  return p;
+}
+
 /* return 0 - too short to match, otherwise success */
 L_EXTERN const l_byte*
 l_string_matchUntil(const l_stringmap* map, l_strt s, l_byte** last_match_start)
 {
   const l_byte* e = 0;
-  while ((e = l_string_match(map, s)) == 0) { /* continue loop when unmatched */
-    ++s.start;
+  for (; ;) {
+    s.start = l_stringmap_skipToLead(map, s.start, s.end);
+    if ((e = l_string_match(map, s)) != 0) break;
+    ++s.start; /* continue loop when unmatched */
   }
   if (last_match_start) *last_match_start = (l_byte*)s.start;
   return (e == l_string_too_short ? 0 : e);
@@ -337,6 +416,247 @@ l_string_skipSpaceAndMatchUntil(const l_stringmap* map, l_strt s, l_byte** first
   return e;
 }
 
+#define L_KEYWORD_MAX_SLOTS (0x10000)
+#define L_KEYWORD_SEED_TRIES (256)
+#define L_KEYWORD_FOLD_SIZE (256)
+
+/* token chars in RFC 7230 3.2.6: "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA */
+L_GLOBAL const l_byte l_token_chars[32] = {
+  0x00, 0x00, 0x00, 0x00, 0xfa, 0x6c, 0xff, 0x03, 0xfe, 0xff, 0xff, 0xc7, 0xff, 0xff, 0xff, 0x57,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static l_umedit
+l_keyword_finish(l_umedit h, l_int len)
+{
+  h ^= (l_umedit)len * 0x9e3779b1u;
+  return h ^ (h >> 16);
+}
+
+static l_umedit /* FNV-1a over folded bytes */
+l_keyword_hash(const l_byte* fold, const l_byte* s, l_int len, l_umedit seed)
+{
+  const l_byte* e = s + len;
+  for (; s < e; ++s) {
+    seed = (seed ^ fold[*s]) * 0x01000193u;
+  }
+  return l_keyword_finish(seed, len);
+}
+
+static l_umedit /* only hash the length, the first, middle and last two chars */
+l_keyword_hashSampled(const l_byte* fold, const l_byte* s, l_int len, l_umedit seed)
+{
+  l_umedit h = fold[s[0]] | ((l_umedit)fold[s[len >> 1]] << 8) | ((l_umedit)fold[s[len-1]] << 16) |
+      ((l_umedit)fold[s[len > 1 ? len-2 : 0]] << 24);
+  h = (h ^ seed) * 0x9e3779b1u;
+  return l_keyword_finish(h ^ (h >> 15), len);
+}
+
+static l_umedit
+l_keywordmap_hash(const l_keywordmap* self, const l_byte* s, l_int len)
+{
+  if (self->sampled) {
+    return l_keyword_hashSampled((const l_byte*)self->t, s, len, self->seed);
+  }
+  return l_keyword_hash((const l_byte*)self->t, s, len, self->seed);
+}
+
+static l_ushort*
+l_keywordmap_slots(const l_keywordmap* self)
+{
+  return (l_ushort*)((l_byte*)self->t + L_KEYWORD_FOLD_SIZE);
+}
+
+static l_umedit* /* offsets of the folded keywords from the start of the block */
+l_keywordmap_offsets(const l_keywordmap* self)
+{
+  return (l_umedit*)(l_keywordmap_slots(self) + self->nslot);
+}
+
+static l_ulong /* lowercase the ascii letters in a word, other bytes are unchanged */
+l_keyword_lowerWord(l_ulong w)
+{
+  l_ulong ones = (~(l_ulong)0) / 255;
+  l_ulong heptets = w & (ones * 0x7f);
+  l_ulong above_z = heptets + ones * (0x7f - 'Z'); /* high bit is set if the byte > 'Z' */
+  l_ulong from_a = heptets + ones * (0x80 - 'A'); /* high bit is set if the byte >= 'A' */
+  l_ulong upper = ~w & (from_a ^ above_z) & (ones * 0x80);
+  return w | (upper >> 2);
+}
+
+static int
+l_keywordmap_tryBuild(l_keywordmap* self)
+{
+  l_ushort* slot = l_keywordmap_slots(self);
+  l_umedit mask = (l_umedit)self->nslot - 1, h = 0;
+  l_int i = 0;
+
+  l_zero_n(slot, sizeof(l_ushort) * self->nslot);
+  for (; i < self->numofstr; ++i) {
+    h = l_keywordmap_hash(self, self->str[i].start, self->str[i].len) & mask;
+    if (slot[h]) return false;
+    slot[h] = (l_ushort)(i + 1);
+  }
+  return true;
+}
+
+static void
+l_keywordmap_initFold(l_keywordmap* self)
+{
+  l_byte* fold = (l_byte*)self->t;
+  l_int ch = 0, i = 0, j = 0;
+
+  /* fold[ch] is 0 if ch cannot appear in a token, the token chars are the
+  RFC 7230 tchar set plus any byte that appears in a keyword */
+  l_zero_n(fold, L_KEYWORD_FOLD_SIZE);
+  for (i = 0; i < self->numofstr; ++i) {
+    for (j = 0; j < self->str[i].len; ++j) {
+      fold[self->str[i].start[j]] = 1;
+    }
+  }
+
+  for (ch = 1; ch < L_KEYWORD_FOLD_SIZE; ++ch) {
+    if (!fold[ch] && !((l_token_chars[ch >> 3] >> (ch & 7)) & 1)) continue;
+    fold[ch] = (!self->casesensitive && ch >= 'A' && ch <= 'Z') ? (l_byte)(ch + 32) : (l_byte)ch;
+    if (!self->casesensitive && ch >= 'a' && ch <= 'z') fold[ch - 32] = (l_byte)ch;
+  }
+}
+
+L_EXTERN l_keywordmap
+l_keywordmap_new(const l_strn* str, l_int numofstr, int casesensitive)
+{
+  l_keywordmap map = {0};
+  l_int i = 0, j = 0, keysize = 0, blksize = 0;
+  l_umedit* koff = 0;
+  l_byte* k = 0;
+
+  if (str == 0 || numofstr <= 0 || numofstr >= L_KEYWORD_MAX_SLOTS / 2) {
+    return map;
+  }
+
+  map.str = str;
+  map.numofstr = numofstr;
+  map.casesensitive = casesensitive;
+  for (i = 0; i < numofstr; ++i) {
+    if (str[i].len > map.maxlen) map.maxlen = str[i].len;
+    keysize += str[i].len;
+  }
+
+  /* sparse table of at least 2x slots, each slot is only 2 bytes. first try to
+  hash only a few sampled chars, if keywords cannot be distinguished by them
+  (or it needs too many slots) fall back to hash all chars */
+  for (map.sampled = 1; map.sampled >= 0; --map.sampled) {
+    for (map.nslot = 2; map.nslot < numofstr * 2; map.nslot <<= 1) {}
+    for (; map.nslot <= L_KEYWORD_MAX_SLOTS; map.nslot <<= 1) {
+      if (map.sampled && map.nslot > numofstr * 16) break;
+      if (map.t) l_raw_mfree(map.t);
+      blksize = L_KEYWORD_FOLD_SIZE + sizeof(l_ushort) * map.nslot + sizeof(l_umedit) * numofstr + keysize;
+      map.t = l_raw_malloc(blksize);
+      l_keywordmap_initFold(&map);
+      for (map.seed = 0; map.seed < L_KEYWORD_SEED_TRIES; ++map.seed) {
+        if (l_keywordmap_tryBuild(&map)) goto BuildSuccess;
+      }
+    }
+  }
+
+  l_loge_s("keyword map build failed, duplicated keywords");
+  l_keywordmap_free(&map);
+  return map;
+
+BuildSuccess:
+  /* keep a folded copy of the keywords, so the input is the only side need to fold */
+  koff = l_keywordmap_offsets(&map);
+  k = (l_byte*)(koff + numofstr);
+  for (i = 0; i < numofstr; ++i) {
+    koff[i] = (l_umedit)(k - (l_byte*)map.t);
+    for (j = 0; j < str[i].len; ++j) {
+      *k++ = ((l_byte*)map.t)[str[i].start[j]];
+    }
+  }
+  return map;
+}
+
+L_EXTERN void
+l_keywordmap_free(l_keywordmap* self)
+{
+  if (self->t == 0) return;
+  l_raw_mfree(self->t);
+  self->t = 0;
+  self->nslot = 0;
+}
+
+static l_int
+l_keywordmap_lookup(const l_keywordmap* self, const l_byte* s, l_int len, l_umedit h)
+{
+  const l_byte* fold = (const l_byte*)self->t;
+  const l_byte* k = 0;
+  l_int strid = l_keywordmap_slots(self)[h & ((l_umedit)self->nslot - 1)];
+  l_int i = 0;
+  l_ulong a = 0, b = 0;
+
+  if (strid-- == 0 || self->str[strid].len != len) return -1;
+  k = fold + l_keywordmap_offsets(self)[strid];
+
+  for (; len - i >= (l_int)sizeof(l_ulong); i += sizeof(l_ulong)) {
+    memcpy(&a, s + i, sizeof(l_ulong));
+    memcpy(&b, k + i, sizeof(l_ulong));
+    if (!self->casesensitive) a = l_keyword_lowerWord(a);
+    if (a != b) return -1;
+  }
+  for (; i < len; ++i) {
+    if (fold[s[i]] != k[i]) return -1;
+  }
+  return strid;
+}
+
+L_EXTERN l_int
+l_keywordmap_find(const l_keywordmap* self, l_strt word)
+{
+  l_int len = word.end - word.start;
+  if (!self->t || len <= 0 || len > self->maxlen) return -1;
+  return l_keywordmap_lookup(self, word.start, len, l_keywordmap_hash(self, word.start, len));
+}
+
+/* match a whole token at the start of s, unlike l_string_matchEx a keyword only
+matches if the token ends right after it. return 0 doesn't match, l_string_too_short
+the token is not complete, otherwise the end of the token */
+L_EXTERN const l_byte*
+l_string_matchKeyword(const l_keywordmap* map, l_strt s, l_int* strid, l_int* matched_len)
+{
+  const l_byte* fold = (const l_byte*)map->t;
+  const l_byte* p = s.start;
+  const l_byte* limit = s.end;
+  l_int id = 0;
+
+  if (s.start >= s.end) return l_string_too_short;
+  if (!fold) return 0;
+
+  if (limit - s.start > map->maxlen) limit = s.start + map->maxlen;
+  while (p < limit && fold[*p]) {
+    ++p;
+  }
+
+  if (p == s.end) return l_string_too_short;
+  if (fold[*p] || p == s.start) return 0; /* longer than any keyword or empty */
+
+  id = l_keywordmap_lookup(map, s.start, p - s.start, l_keywordmap_hash(map, s.start, p - s.start));
+  if (id < 0) return 0;
+  if (strid) *strid = id;
+  if (matched_len) *matched_len = p - s.start;
+  return p;
+}
+
+/* return 0 - match failed; otherwise success, strid and mlen are set */
+L_EXTERN const l_byte*
+l_string_skipSpaceAndMatchKeyword(const l_keywordmap* map, l_strt s, l_int* strid, l_int* matched_len)
+{
+  const l_byte* e = 0;
+  s.start = l_string_trimHead(s);
+  e = l_string_matchKeyword(map, s, strid, matched_len);
+  if (e == 0 || e == l_string_too_short) return 0;
+  return e;
+}
+
 /* return 0 - match failed; otherwise success, strid and mlen are set */
 L_EXTERN const l_byte*
 l_string_skipSpaceAndMatch(const l_stringmap* map, l_strt s, l_int* strid, l_int* matched_len)
@@ -376,6 +696,44 @@ l_string_skipSpaceAndMatchSub(l_strt sub, l_strt s)
   return s.start;
 }
 
+#if defined(L_BUILD_BENCH)
+static void /* a request worth of header lines, in a hot loop and once after the cache is flushed */
+l_string_match_bench(const l_stringmap* smap, const l_keywordmap* kmap, const l_strt* lines, l_int nline)
+{
+  l_int i = 0, n = 0, id = 0, hits = 0, flushsize = 16 * 1024 * 1024;
+  l_byte* flush = (l_byte*)l_raw_calloc(flushsize);
+  clock_t t0 = 0, t1 = 0, t2 = 0, cs = 0, ck = 0;
+
+  t0 = clock();
+  for (n = 0; n < 200000; ++n) {
+    for (i = 0; i < nline; ++i) hits += l_string_matchEx(smap, lines[i], &id, 0) != 0;
+  }
+  t1 = clock();
+  for (n = 0; n < 200000; ++n) {
+    for (i = 0; i < nline; ++i) hits += l_string_matchKeyword(kmap, lines[i], &id, 0) != 0;
+  }
+  t2 = clock();
+  l_logm_3("hot header lines %d x 200000: stringmap %d us, keywordmap %d us", ld(nline),
+      ld((l_long)(t1 - t0) * 1000000 / CLOCKS_PER_SEC), ld((l_long)(t2 - t1) * 1000000 / CLOCKS_PER_SEC));
+
+  for (n = 0; n < 1000; ++n) {
+    for (i = 0; i < flushsize; i += 64) flush[i] += 1;
+    t0 = clock();
+    for (i = 0; i < nline; ++i) hits += l_string_matchEx(smap, lines[i], &id, 0) != 0;
+    cs += clock() - t0;
+    for (i = 0; i < flushsize; i += 64) flush[i] += 1;
+    t0 = clock();
+    for (i = 0; i < nline; ++i) hits += l_string_matchKeyword(kmap, lines[i], &id, 0) != 0;
+    ck += clock() - t0;
+  }
+  l_logm_3("cold header lines %d x 1000: stringmap %d us, keywordmap %d us", ld(nline),
+      ld((l_long)cs * 1000000 / CLOCKS_PER_SEC), ld((l_long)ck * 1000000 / CLOCKS_PER_SEC));
+
+  l_raw_mfree(flush);
+  l_assert(hits > 0);
+}
+#endif
+
 L_EXTERN void
 l_string_match_test()
 {
@@ -442,5 +800,93 @@ l_string_match_test()
 
   l_stringmap_free(&map);
   l_string_free(&str, 0);
+
+  {
+    const l_byte line[] = "Host: example.com:8080 with a long value\r\nAccept: */*\r\n";
+    const l_byte utf8[] = "a line more than eight bytes\xe2\x80\xa8next\n";
+    l_byte* start = 0;
+
+    l_assert(l_stringmap_newline()->nlead == 3);
+    l_assert(l_stringmap_httpNewline()->nlead == 2);
+    l_assert(l_stringmap_space()->nlead == 0);
+
+    s = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_n(line, sizeof(line) - 1), &start);
+    l_assert(start == line + 40 && s == line + 42);
+    s = l_string_matchUntil(l_stringmap_newline(), l_strt_n(line, sizeof(line) - 1), &start);
+    l_assert(start == line + 40 && s == line + 42);
+    s = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_n(line, 41), &start);
+    l_assert(s == 0 && start == line + 40); /* CR at the end needs more data */
+    s = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_n(line, 39), &start);
+    l_assert(s == 0 && start == line + 39);
+
+    s = l_string_matchUntil(l_stringmap_newline(), l_strt_n(utf8, sizeof(utf8) - 1), &start);
+    l_assert(start == utf8 + 28 && s == utf8 + 31);
+    s = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_n(utf8, sizeof(utf8) - 1), &start);
+    l_assert(start == utf8 + 35 && s == utf8 + 36);
+    s = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_literal("a\rb\r\n"), &start);
+    l_assert(s && *start == '\r' && start[1] == '\n');
+
+    s = l_string_matchUntil(l_stringmap_space(), l_strt_literal("Accept:\xe3\x80\x80*/*"), &start);
+    l_assert(s && *start == 0xe3 && *s == '*');
+  }
+
+  {
+    const l_strn headers[] = {
+      l_strn_literal("accept"), l_strn_literal("accept-charset"), l_strn_literal("accept-encoding"),
+      l_strn_literal("accept-language"), l_strn_literal("authorization"), l_strn_literal("cache-control"),
+      l_strn_literal("connection"), l_strn_literal("content-length"), l_strn_literal("content-type"),
+      l_strn_literal("cookie"), l_strn_literal("dnt"), l_strn_literal("expect"), l_strn_literal("host"),
+      l_strn_literal("if-match"), l_strn_literal("if-modified-since"), l_strn_literal("if-none-match"),
+      l_strn_literal("if-range"), l_strn_literal("origin"), l_strn_literal("pragma"), l_strn_literal("range"),
+      l_strn_literal("referer"), l_strn_literal("sec-ch-ua"), l_strn_literal("sec-ch-ua-mobile"),
+      l_strn_literal("sec-ch-ua-platform"), l_strn_literal("sec-fetch-dest"), l_strn_literal("sec-fetch-mode"),
+      l_strn_literal("sec-fetch-site"), l_strn_literal("sec-fetch-user"), l_strn_literal("te"),
+      l_strn_literal("upgrade-insecure-requests"), l_strn_literal("user-agent")
+    };
+    const char* corpus[] = { /* request header lines sent by browsers */
+      "Host: localhost:8080", "Connection: keep-alive", "Cache-Control: max-age=0",
+      "sec-ch-ua: \"Chromium\";v=\"118\"", "sec-ch-ua-mobile: ?0", "sec-ch-ua-platform: \"Linux\"",
+      "Upgrade-Insecure-Requests: 1", "User-Agent: Mozilla/5.0 (X11; Linux x86_64)",
+      "Accept: text/html,application/xhtml+xml", "Sec-Fetch-Site: none", "Sec-Fetch-Mode: navigate",
+      "Sec-Fetch-User: ?1", "Sec-Fetch-Dest: document", "Accept-Encoding: gzip, deflate, br",
+      "Accept-Language: en-US,en;q=0.9", "Cookie: sid=31d4d96e407aad42", "If-None-Match: \"33a64df5\"",
+      "If-Modified-Since: Wed, 21 Oct 2015 07:28:00 GMT", "Referer: http://localhost/", "DNT: 1", "TE: trailers",
+      "X-Unknown-Header: 1", "Accept-Datetime: Thu, 31 May 2007 20:35:00 GMT"
+    };
+    l_strt lines[sizeof(corpus) / sizeof(corpus[0])];
+    l_int ncorpus = sizeof(corpus) / sizeof(corpus[0]), i = 0, n = 0, kid = 0, sid = 0, hits = 0;
+    l_stringmap smap = l_stringmap_new(32, headers, 31, false);
+    l_keywordmap kmap = l_keywordmap_new(headers, 31, false);
+
+    l_assert(kmap.t && kmap.maxlen == 25 && kmap.sampled);
+    l_assert(l_keywordmap_find(&kmap, l_strt_literal("Content-Type")) == 8);
+    l_assert(l_keywordmap_find(&kmap, l_strt_literal("content-typ")) == -1);
+    l_assert(l_keywordmap_find(&kmap, l_strt_literal("x-forwarded-for")) == -1);
+    l_assert(l_string_matchKeyword(&kmap, l_strt_literal("Host"), &kid, 0) == l_string_too_short);
+    l_assert(l_string_matchKeyword(&kmap, l_strt_literal("Hostname:"), &kid, 0) == 0);
+    s = l_string_skipSpaceAndMatchKeyword(&kmap, l_strt_literal("  HOST: a"), &kid, &n);
+    l_assert(s && *s == ':' && kid == 12 && n == 4);
+
+    for (i = 0; i < ncorpus; ++i) {
+      l_strt line = lines[i] = l_strt_c(corpus[i]);
+      const l_byte* e = l_string_matchKeyword(&kmap, line, &kid, 0);
+      if (e == 0) continue;
+      ++hits;
+      l_assert(e != l_string_too_short && *e == ':');
+      if (l_string_matchEx(&smap, line, &sid, 0) == e) {
+        l_assert(sid == kid);
+      } else { /* the rune table stopped at a shorter keyword, e.g. accept for accept-encoding */
+        l_assert(sid < kid);
+      }
+    }
+    l_assert(hits == ncorpus - 2);
+
+#if defined(L_BUILD_BENCH)
+    l_string_match_bench(&smap, &kmap, lines, ncorpus);
+#endif
+
+    l_stringmap_free(&smap);
+    l_keywordmap_free(&kmap);
+  }
 }
 
@@ -2,22 +2,48 @@
 #define l_core_match_h
 #include "core/base.h"
 
+#define L_STRINGMAP_MAX_LEAD (4)
+
 typedef struct {
   void* t; /* table array, 1 table contains 1 char, the array size is up to the length of the string */
   l_int size; /* a string map can store strings up to 'strlimit', the size is the length of the longest string */
   l_int strlimit;
+  l_int nlead; /* number of distinct first bytes of the strings, 0 if more than L_STRINGMAP_MAX_LEAD */
+  l_byte lead[L_STRINGMAP_MAX_LEAD]; /* the first bytes, l_string_matchUntil scans a word at a time for them */
 } l_stringmap;
 
+/* a keyword map is a perfect hash over whole tokens, strid is the index of the keyword in the array,
+the keyword array is referenced by the map and must outlive it */
+
+typedef struct {
+  void* t; /* byte set of the keywords followed by slot array, each slot is 0 or strid + 1 */
+  const l_strn* str;
+  l_int numofstr;
+  l_int nslot; /* power of two */
+  l_int maxlen;
+  l_umedit seed;
+  int casesensitive;
+  int sampled; /* only the length, the first, middle and last two chars are hashed */
+} l_keywordmap;
+
+L_EXTERN l_keywordmap l_keywordmap_new(const l_strn* str, l_int numofstr, int casesensitive);
+L_EXTERN void l_keywordmap_free(l_keywordmap* self);
+L_EXTERN l_int l_keywordmap_find(const l_keywordmap* self, l_strt word); /* return strid or -1 */
+L_EXTERN const l_byte* l_string_matchKeyword(const l_keywordmap* map, l_strt s, l_int* strid, l_int* mlen);
+L_EXTERN const l_byte* l_string_skipSpaceAndMatchKeyword(const l_keywordmap* map, l_strt s, l_int* strid, l_int* mlen);
+
 L_EXTERN l_stringmap l_stringmap_new(l_int maxstrlen, const l_strn* str, l_int numofstr, int casesensitive);
 L_EXTERN void l_stringmap_set(l_stringmap* self, const l_strn* str, l_int numofstr, int casesensitive);
 L_EXTERN void l_stringmap_free(l_stringmap* self);
 L_EXTERN const l_stringmap* l_stringmap_space();
 L_EXTERN const l_stringmap* l_stringmap_newline();
 L_EXTERN const l_stringmap* l_stringmap_blank();
+L_EXTERN const l_stringmap* l_stringmap_httpNewline(); /* only CRLF and LF */
 L_EXTERN const l_byte* l_string_match(const l_stringmap* map, l_strt s);
 L_EXTERN const l_byte* l_string_matchEx(const l_stringmap* map, l_strt s, l_int* strid, l_int* mlen);
 L_EXTERN const l_byte* l_string_matchTimes(const l_stringmap* map, l_int n, l_strt s);
 L_EXTERN const l_byte* l_string_matchRepeat(const l_stringmap* map, l_strt s);
+L_EXTERN const l_byte* l_string_findAnyOf(l_strt s, const l_byte* bytes, l_int n);
 L_EXTERN const l_byte* l_string_matchUntil(const l_stringmap* map, l_strt s, l_byte** last_match_start);
 L_EXTERN const l_byte* l_string_skipSpaceAndMatchUntil(const l_stringmap* map, l_strt s, l_byte** first_non_space_pos);
 L_EXTERN const l_byte* l_string_skipSpaceAndMatch(const l_stringmap* map, l_strt s, l_int* strid, l_int* mlen);
@@ -0,0 +1,268 @@
+#define L_LIBRARY_IMPL
+#include "core/string.h"
+#include "core/match.h"
+#include "core/multimatch.h"
+
+/* the automaton is a single block:
+   l_byte cls[256] - byte to class index, class 0 is for the bytes not in any pattern
+   l_umedit delta[nstate * (nclass + 1)] - one row per state, entry c is the next
+     state for class c (already multiplied by the row size), the last entry of the
+     row is the output index of the state or 0
+   l_umedit out[2 * (nout + 1)] - output entries {patid, next output index} */
+
+#define L_MULTIMATCH_CLS_SIZE (256)
+
+static l_umedit*
+l_multimatch_delta(const l_multimatch* self)
+{
+  return (l_umedit*)((l_byte*)self->t + L_MULTIMATCH_CLS_SIZE);
+}
+
+static l_umedit*
+l_multimatch_outputs(const l_multimatch* self)
+{
+  return l_multimatch_delta(self) + self->nstate * (self->nclass + 1);
+}
+
+static l_byte
+l_multimatch_fold(l_byte ch, int casesensitive)
+{
+  return (!casesensitive && ch >= 'A' && ch <= 'Z') ? (l_byte)(ch + 32) : ch;
+}
+
+L_EXTERN l_multimatch
+l_multimatch_new(const l_strn* pattern, l_int numofpattern, int casesensitive)
+{
+  l_multimatch mm = {0};
+  l_byte cls[L_MULTIMATCH_CLS_SIZE];
+  l_umedit* trie = 0; /* the goto table, rows are not multiplied */
+  l_umedit* fail = 0;
+  l_umedit* dict = 0;
+  l_umedit* queue = 0;
+  l_medit* outid = 0;
+  l_umedit* outidx = 0;
+  l_umedit* delta = 0;
+  l_umedit* out = 0;
+  l_int maxstate = 1, stride = 0, i = 0, j = 0, c = 0, nout = 0, head = 0, tail = 0;
+  l_umedit st = 0, u = 0, r = 0;
+  l_byte ch = 0;
+
+  if (pattern == 0 || numofpattern <= 0) {
+    return mm;
+  }
+
+  /* byte classes, each distinct (folded) byte in the patterns has its own class */
+  l_zero_n(cls, sizeof(cls));
+  mm.nclass = 1;
+  for (i = 0; i < numofpattern; ++i) {
+    maxstate += pattern[i].len;
+    for (j = 0; j < pattern[i].len; ++j) {
+      ch = l_multimatch_fold(pattern[i].start[j], casesensitive);
+      if (cls[ch] == 0) {
+        if (mm.nclass == L_MULTIMATCH_CLS_SIZE) continue; /* the last byte is alone in class 0 */
+        cls[ch] = (l_byte)(mm.nclass++);
+      }
+    }
+  }
+  if (!casesensitive) {
+    for (c = 'A'; c <= 'Z'; ++c) cls[c] = cls[c + 32];
+  }
+
+  stride = mm.nclass + 1;
+  trie = (l_umedit*)l_raw_calloc(sizeof(l_umedit) * maxstate * stride);
+  fail = (l_umedit*)l_raw_calloc(sizeof(l_umedit) * maxstate * 4);
+  dict = fail + maxstate;
+  queue = dict + maxstate;
+  outidx = queue + maxstate;
+  outid = (l_medit*)l_raw_malloc(sizeof(l_medit) * maxstate);
+  for (i = 0; i < maxstate; ++i) outid[i] = -1;
+
+  /* build the trie, state 0 is the root */
+  mm.nstate = 1;
+  for (i = 0; i < numofpattern; ++i) {
+    if (pattern[i].len <= 0) continue;
+    st = 0;
+    for (j = 0; j < pattern[i].len; ++j) {
+      c = cls[pattern[i].start[j]];
+      if (trie[st * stride + c] == 0) {
+        trie[st * stride + c] = (l_umedit)(mm.nstate++);
+      }
+      st = trie[st * stride + c];
+    }
+    if (outid[st] < 0) outid[st] = (l_medit)i; /* the same pattern appeared before */
+  }
+
+  /* breadth first to set the failure links and fill the missing transitions, the row of
+  the failure state is always completed before because it is shallower */
+  queue[tail++] = 0;
+  while (head < tail) {
+    r = queue[head++];
+    for (c = 0; c < mm.nclass; ++c) {
+      u = trie[r * stride + c];
+      if (u) { /* a trie edge */
+        fail[u] = (r == 0) ? 0 : trie[fail[r] * stride + c];
+        dict[u] = (outid[fail[u]] >= 0) ? fail[u] : dict[fail[u]];
+        queue[tail++] = u;
+      } else {
+        trie[r * stride + c] = (r == 0) ? 0 : trie[fail[r] * stride + c];
+      }
+    }
+  }
+
+  /* output entries in breadth first order, so the entry of the dictionary link exists already */
+  for (i = 0; i < tail; ++i) {
+    st = queue[i];
+    if (outid[st] >= 0) outidx[st] = (l_umedit)(++nout);
+  }
+
+  mm.t = l_raw_malloc(L_MULTIMATCH_CLS_SIZE + sizeof(l_umedit) * (mm.nstate * stride + 2 * (nout + 1)));
+  l_copy_n(cls, L_MULTIMATCH_CLS_SIZE, mm.t);
+  delta = l_multimatch_delta(&mm);
+  out = l_multimatch_outputs(&mm);
+  out[0] = out[1] = 0;
+
+  for (i = 0; i < mm.nstate; ++i) {
+    for (c = 0; c < mm.nclass; ++c) {
+      delta[i * stride + c] = trie[i * stride + c] * (l_umedit)stride;
+    }
+    st = (l_umedit)i;
+    delta[i * stride + mm.nclass] = outid[st] >= 0 ? outidx[st] : outidx[dict[st]];
+    if (outid[st] >= 0) {
+      out[outidx[st] * 2] = (l_umedit)outid[st];
+      out[outidx[st] * 2 + 1] = outidx[dict[st]];
+    }
+  }
+
+  mm.pattern = pattern;
+  mm.numofpattern = numofpattern;
+  for (c = 0; c < L_MULTIMATCH_CLS_SIZE; ++c) {
+    if (!delta[cls[c]]) continue; /* the root stays at the root on this byte */
+    if (mm.nlead < L_MULTIMATCH_MAX_LEAD) mm.lead[mm.nlead] = (l_byte)c;
+    ++mm.nlead;
+  }
+  if (mm.nlead > L_MULTIMATCH_MAX_LEAD) {
+    mm.nlead = 0;
+  }
+
+  l_raw_mfree(outid);
+  l_raw_mfree(fail);
+  l_raw_mfree(trie);
+  return mm;
+}
+
+L_EXTERN void
+l_multimatch_free(l_multimatch* self)
+{
+  if (self->t == 0) return;
+  l_raw_mfree(self->t);
+  self->t = 0;
+  self->nstate = 0;
+}
+
+L_EXTERN void
+l_multimatch_streamInit(l_multimatch_stream* stream)
+{
+  stream->state = 0;
+  stream->out = 0;
+  stream->offset = 0;
+}
+
+/* return the end of next match in s and set patid, or 0 if no more match in s. the
+scan state is kept in the stream, to find the next match call it again with s.start
+set to the returned position, or call it with the next buffer if 0 is returned */
+L_EXTERN const l_byte*
+l_multimatch_find(const l_multimatch* self, l_multimatch_stream* stream, l_strt s, l_int* patid)
+{
+  const l_byte* cls = (const l_byte*)self->t;
+  const l_umedit* delta = 0;
+  const l_umedit* out = 0;
+  const l_byte* p = s.start;
+  l_umedit st = stream->state, k = 0;
+  l_int nclass = self->nclass;
+
+  if (!cls) return 0;
+  delta = l_multimatch_delta(self);
+  out = l_multimatch_outputs(self);
+
+  if ((k = stream->out)) { /* more patterns end at current position */
+    stream->out = out[k * 2 + 1];
+    if (patid) *patid = (l_int)out[k * 2];
+    return s.start;
+  }
+
+  while (p < s.end) {
+    if (st == 0 && self->nlead) {
+      if ((p = l_string_findAnyOf(l_strt_from(p, s.end), self->lead, self->nlead)) == s.end) {
+        break;
+      }
+    }
+    st = delta[st + cls[*p++]];
+    if ((k = delta[st + nclass])) {
+      stream->state = st;
+      stream->out = out[k * 2 + 1];
+      stream->offset += p - s.start;
+      if (patid) *patid = (l_int)out[k * 2];
+      return p;
+    }
+  }
+
+  stream->state = st;
+  stream->offset += s.end - s.start;
+  return 0;
+}
+
+L_EXTERN l_long
+l_multimatch_matchStart(const l_multimatch* self, const l_multimatch_stream* stream, l_int patid)
+{
+  return stream->offset - self->pattern[patid].len;
+}
+
+L_EXTERN void
+l_multimatch_test()
+{
+  const l_strn patterns[] = {l_strn_literal("he"), l_strn_literal("she"), l_strn_literal("his"),
+      l_strn_literal("hers"), l_strn_literal("(@")};
+  const l_byte text[] = "ushers (@x) this";
+  l_multimatch mm = l_multimatch_new(patterns, 5, true);
+  l_multimatch_stream stream;
+  l_strt s = l_strt_n(text, sizeof(text) - 1);
+  const l_byte* e = 0;
+  l_int patid = 0, i = 0, n = 0;
+  l_int found[8];
+  l_long start[8];
+
+  l_assert(mm.t && mm.nlead == 3); /* h s ( */
+
+  l_multimatch_streamInit(&stream);
+  while ((e = l_multimatch_find(&mm, &stream, s, &patid)) && n < 8) {
+    found[n] = patid;
+    start[n++] = l_multimatch_matchStart(&mm, &stream, patid);
+    s.start = e;
+  }
+  l_assert(n == 5);
+  l_assert(found[0] == 1 && start[0] == 1); /* she */
+  l_assert(found[1] == 0 && start[1] == 2); /* he */
+  l_assert(found[2] == 3 && start[2] == 2); /* hers */
+  l_assert(found[3] == 4 && start[3] == 7); /* (@ */
+  l_assert(found[4] == 2 && start[4] == 13); /* his */
+
+  /* feed one byte at a time, the matches across buffers are the same */
+  l_multimatch_streamInit(&stream);
+  for (n = 0, i = 0; i < (l_int)sizeof(text) - 1; ++i) {
+    s = l_strt_n(text + i, 1);
+    while ((e = l_multimatch_find(&mm, &stream, s, &patid))) {
+      l_assert(found[n] == patid && start[n] == l_multimatch_matchStart(&mm, &stream, patid));
+      ++n;
+      s.start = e;
+    }
+  }
+  l_assert(n == 5);
+  l_multimatch_free(&mm);
+
+  mm = l_multimatch_new(patterns, 4, false);
+  l_multimatch_streamInit(&stream);
+  e = l_multimatch_find(&mm, &stream, l_strt_literal("aaaaaaaaaaaaaaaaaaHIS"), &patid);
+  l_assert(e && *e == 0 && patid == 2 && l_multimatch_matchStart(&mm, &stream, patid) == 18);
+  l_multimatch_free(&mm);
+}
+
@@ -0,0 +1,35 @@
+#ifndef l_core_multimatch_h
+#define l_core_multimatch_h
+#include "core/base.h"
+
+#define L_MULTIMATCH_MAX_LEAD (4)
+
+/**
+ * multiple pattern search (aho-corasick automaton)
+ */
+
+typedef struct {
+  void* t; /* the compiled automaton, see multimatch.c for the layout */
+  const l_strn* pattern; /* the pattern array is referenced and must outlive the automaton */
+  l_int numofpattern;
+  l_int nclass; /* number of byte classes, a state row has nclass + 1 entries */
+  l_int nstate;
+  l_int nlead; /* number of distinct first bytes of the patterns, 0 if more than L_MULTIMATCH_MAX_LEAD */
+  l_byte lead[L_MULTIMATCH_MAX_LEAD]; /* the scan skips to these bytes when it is at the root state */
+} l_multimatch;
+
+typedef struct { /* scan state that can be carried across buffers */
+  l_umedit state;
+  l_umedit out; /* pending match at current position */
+  l_long offset; /* stream offset of current position */
+} l_multimatch_stream;
+
+L_EXTERN l_multimatch l_multimatch_new(const l_strn* pattern, l_int numofpattern, int casesensitive);
+L_EXTERN void l_multimatch_free(l_multimatch* self);
+L_EXTERN void l_multimatch_streamInit(l_multimatch_stream* stream);
+L_EXTERN const l_byte* l_multimatch_find(const l_multimatch* self, l_multimatch_stream* stream, l_strt s, l_int* patid);
+L_EXTERN l_long l_multimatch_matchStart(const l_multimatch* self, const l_multimatch_stream* stream, l_int patid);
+L_EXTERN void l_multimatch_test();
+
+#endif /* l_core_multimatch_h */
+
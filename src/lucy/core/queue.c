@@ -88,52 +88,50 @@ l_dqueue_pop(l_dqueue* self)
 }
 
 L_EXTERN void
-l_priorq_init(l_priorq* self, int (*less)(void*, void*))
+l_priorq_init(l_priorq* self, l_int posoffset)
 {
-  l_linknode_init(&self->node);
-  self->less = less;
+  l_mmheap_init(&self->heap, posoffset, 0);
+}
+
+L_EXTERN void
+l_priorq_free(l_priorq* self)
+{
+  l_mmheap_free(&self->heap);
 }
 
 L_EXTERN int
 l_priorq_isEmpty(l_priorq* self)
 {
-  return l_linknode_isEmpty(&self->node);
+  return l_mmheap_size(&self->heap) == 0;
 }
 
 L_EXTERN void
-l_priorq_push(l_priorq* self, l_linknode* elem)
+l_priorq_push(l_priorq* self, void* elem, l_ulong prior)
 {
-  l_linknode* head = &(self->node);
-  l_linknode* cur = head->next;
-  while (cur != head && self->less(cur, elem)) {
-    cur = cur->next;
-  }
-  /* insert elem before current node  or the head node */
-  cur->prev->next = elem;
-  elem->prev = cur->prev;
-  cur->prev = elem;
-  elem->next = cur;
+  l_mmheap_add(&self->heap, elem, prior);
 }
 
 L_EXTERN void
-l_priorq_remove(l_priorq* self, l_linknode* elem)
+l_priorq_update(l_priorq* self, void* elem, l_ulong prior)
 {
-  if (elem == &(self->node)) return;
-  l_linknode_remove(elem);
+  l_mmheap_update(&self->heap, elem, prior);
 }
 
-L_EXTERN l_linknode*
+L_EXTERN void
+l_priorq_remove(l_priorq* self, void* elem)
+{
+  l_mmheap_del(&self->heap, elem);
+}
+
+L_EXTERN void*
+l_priorq_top(l_priorq* self)
+{
+  return l_mmheap_top(&self->heap);
+}
+
+L_EXTERN void*
 l_priorq_pop(l_priorq* self)
 {
-  l_linknode* head;
-  l_linknode* first;
-  if (l_priorq_isEmpty(self)) {
-    return 0;
-  }
-  head = &(self->node);
-  first = head->next;
-  head->next = first->next;
-  first->next->prev = head;
-  return first;
+  return l_mmheap_pop(&self->heap);
 }
 
@@ -1,6 +1,7 @@
 #ifndef l_core_queue_h
 #define l_core_queue_h
 #include "core/base.h"
+#include "core/heap.h"
 
 /**
  * simple linked queue
@@ -32,20 +33,22 @@ L_EXTERN int l_dqueue_isEmpty(l_dqueue* self);
 L_EXTERN l_linknode* l_dqueue_pop(l_dqueue* self);
 
 /**
- * priority queue
+ * priority queue - the element with less priority number is popped first, i.e.,
+ * 0 is the highest. the element has a l_umedit field for its queue position.
  */
 
 typedef struct l_priorq {
-  l_linknode node;
-  /* elem with less number has higher priority, i.e., 0 is the highest */
-  int (*less)(void* elem_is_less_than, void* this_one);
+  l_mmheap heap;
 } l_priorq;
 
-L_EXTERN void l_priorq_init(l_priorq* self, int (*less)(void*, void*));
-L_EXTERN void l_priorq_push(l_priorq* self, l_linknode* elem);
-L_EXTERN void l_priorq_remove(l_priorq* self, l_linknode* elem);
+L_EXTERN void l_priorq_init(l_priorq* self, l_int posoffset);
+L_EXTERN void l_priorq_free(l_priorq* self);
+L_EXTERN void l_priorq_push(l_priorq* self, void* elem, l_ulong prior);
+L_EXTERN void l_priorq_update(l_priorq* self, void* elem, l_ulong prior);
+L_EXTERN void l_priorq_remove(l_priorq* self, void* elem);
 L_EXTERN int l_priorq_isEmpty(l_priorq* self);
-L_EXTERN l_linknode* l_priorq_pop(l_priorq* self);
+L_EXTERN void* l_priorq_top(l_priorq* self);
+L_EXTERN void* l_priorq_pop(l_priorq* self);
 
 #endif /* l_core_queue_h */
 
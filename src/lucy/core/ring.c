@@ -0,0 +1,374 @@
+#include <string.h>
+#define L_LIBRARY_IMPL
+#include "core/ring.h"
+
+/* a cell at position pos is free for the push if its sequence is pos, and ready
+for the pop if its sequence is pos + 1. after the pop the sequence becomes
+pos + capacity, i.e., it is free for the push of next lap */
+
+#define L_RING_PUSH_LAG 0
+#define L_RING_POP_LAG 1
+#define L_RING_SPIN 64 /* retries before a blocking call waits on the condv */
+
+static volatile l_ulong*
+l_ring_seq(l_ring* self, l_ulong pos)
+{
+  return (volatile l_ulong*)(self->cell + (pos & self->mask) * self->cellsize);
+}
+
+static l_byte*
+l_ring_data(l_ring* self, l_ulong pos)
+{
+  return self->cell + (pos & self->mask) * self->cellsize + sizeof(l_ulong);
+}
+
+L_EXTERN int
+l_ring_init(l_ring* self, l_umedit capacity, l_umedit elemsize, l_umedit flags)
+{
+  l_ulong i = 0, n = 2;
+
+  l_zero_n(self, sizeof(l_ring));
+
+  if (capacity > (1U << 30) || elemsize == 0 || elemsize > L_CACHE_LINE_SIZE) {
+    l_loge_2("ring capacity %d elemsize %d", ld(capacity), ld(elemsize));
+    return false;
+  }
+
+  while (n < capacity) n *= 2;
+  self->mask = n - 1;
+  self->elemsize = elemsize;
+  self->cellsize = (l_umedit)((sizeof(l_ulong) + elemsize + sizeof(l_ulong) - 1) / sizeof(l_ulong) * sizeof(l_ulong));
+  self->flags = flags;
+
+  self->cell = (l_byte*)l_raw_malloc(self->cellsize * n);
+  if (self->cell == 0) return false;
+
+  for (; i < n; ++i) {
+    *l_ring_seq(self, i) = i;
+  }
+
+  l_mutex_init(&self->mutex);
+  l_condv_init(&self->notfull);
+  l_condv_init(&self->notempty);
+  return true;
+}
+
+L_EXTERN void
+l_ring_free(l_ring* self)
+{
+  if (self->cell == 0) return;
+  l_condv_free(&self->notempty);
+  l_condv_free(&self->notfull);
+  l_mutex_free(&self->mutex);
+  l_raw_mfree(self->cell);
+  self->cell = 0;
+}
+
+/* claim up to n consecutive cells on the cursor, the position of the first cell
+is returned in start. return 0 if the ring is full (empty) */
+static l_umedit
+l_ring_claim(l_ring* self, volatile l_ulong* cursor, l_ulong lag, l_umedit n, int single, l_ulong* start)
+{
+  l_ulong pos = l_atomic_loadRelaxed(cursor);
+  l_umedit k = 0;
+  l_long diff = 0;
+
+  for (;;) {
+    for (k = 0; k < n; ++k) {
+      diff = (l_long)(l_atomic_load(l_ring_seq(self, pos + k)) - (pos + k + lag));
+      if (diff != 0) break;
+    }
+
+    if (k == 0) {
+      if (diff < 0) return 0; /* the other side has not finished with the cell */
+      pos = l_atomic_loadRelaxed(cursor); /* another thread claimed it */
+      continue;
+    }
+
+    if (single) {
+      l_atomic_storeRelaxed(cursor, pos + k);
+      break;
+    }
+
+    if (l_atomic_cas(cursor, pos, pos + k)) break;
+    pos = l_atomic_loadRelaxed(cursor);
+  }
+
+  *start = pos;
+  return k;
+}
+
+static void
+l_ring_wake(l_ring* self, volatile l_ulong* nwait, l_condv* condv)
+{
+  l_atomic_fence(); /* the cell sequence store is visible before nwait is read */
+  if (l_atomic_loadRelaxed(nwait) == 0) return;
+  l_mutex_lock(&self->mutex);
+  l_condv_broadcast(condv);
+  l_mutex_unlock(&self->mutex);
+}
+
+/* the raw push and pop do not wake the waiters of the other side, so they can
+be called with the mutex held */
+
+static l_umedit
+l_ring_pushRaw(l_ring* self, const void* elems, l_umedit n)
+{
+  const l_byte* p = (const l_byte*)elems;
+  l_ulong pos = 0;
+  l_umedit k = 0, i = 0;
+
+  if (n == 0) return 0;
+  k = l_ring_claim(self, &self->tail, L_RING_PUSH_LAG, n, self->flags & L_RING_SINGLE_PRODUCER, &pos);
+
+  for (; i < k; ++i, p += self->elemsize) {
+    memcpy(l_ring_data(self, pos + i), p, self->elemsize);
+    l_atomic_store(l_ring_seq(self, pos + i), pos + i + 1);
+  }
+
+  return k;
+}
+
+static l_umedit
+l_ring_popRaw(l_ring* self, void* elems, l_umedit n)
+{
+  l_byte* p = (l_byte*)elems;
+  l_ulong pos = 0;
+  l_umedit k = 0, i = 0;
+
+  if (n == 0) return 0;
+  k = l_ring_claim(self, &self->head, L_RING_POP_LAG, n, self->flags & L_RING_SINGLE_CONSUMER, &pos);
+
+  for (; i < k; ++i, p += self->elemsize) {
+    memcpy(p, l_ring_data(self, pos + i), self->elemsize);
+    l_atomic_store(l_ring_seq(self, pos + i), pos + i + self->mask + 1);
+  }
+
+  return k;
+}
+
+static int
+l_ring_pushOne(l_ring* self, void* elem)
+{
+  return l_ring_pushRaw(self, elem, 1) == 1;
+}
+
+static int
+l_ring_popOne(l_ring* self, void* elem)
+{
+  return l_ring_popRaw(self, elem, 1) == 1;
+}
+
+L_EXTERN l_umedit
+l_ring_tryPushBatch(l_ring* self, const void* elems, l_umedit n)
+{
+  l_umedit k = l_ring_pushRaw(self, elems, n);
+  if (k) l_ring_wake(self, &self->nwaitpop, &self->notempty);
+  return k;
+}
+
+L_EXTERN l_umedit
+l_ring_tryPopBatch(l_ring* self, void* elems, l_umedit n)
+{
+  l_umedit k = l_ring_popRaw(self, elems, n);
+  if (k) l_ring_wake(self, &self->nwaitpush, &self->notfull);
+  return k;
+}
+
+L_EXTERN int
+l_ring_tryPush(l_ring* self, const void* elem)
+{
+  return l_ring_tryPushBatch(self, elem, 1) == 1;
+}
+
+L_EXTERN int
+l_ring_tryPop(l_ring* self, void* elem)
+{
+  return l_ring_tryPopBatch(self, elem, 1) == 1;
+}
+
+L_EXTERN int
+l_ring_tryPushPtr(l_ring* self, void* ptr)
+{
+  l_assert(self->elemsize == sizeof(void*));
+  return l_ring_tryPushBatch(self, &ptr, 1) == 1;
+}
+
+L_EXTERN void*
+l_ring_tryPopPtr(l_ring* self)
+{
+  void* ptr = 0;
+  l_assert(self->elemsize == sizeof(void*));
+  return l_ring_tryPopBatch(self, &ptr, 1) ? ptr : 0;
+}
+
+/* spin a while, then wait on the condv. the waiter count is raised before the
+last try under the mutex, so the other side either sees the count and wakes
+the waiter, or the last try sees its element */
+static void
+l_ring_wait(l_ring* self, int (*try)(l_ring*, void*), void* elem, volatile l_ulong* nwait, l_condv* condv)
+{
+  int spin = 0, done = false;
+
+  for (;;) {
+    if (try(self, elem)) return;
+    if (++spin < L_RING_SPIN) {
+      l_atomic_pause();
+      continue;
+    }
+
+    l_mutex_lock(&self->mutex);
+    l_atomic_add(nwait, 1);
+    if (!(done = try(self, elem))) {
+      l_condv_wait(condv, &self->mutex);
+    }
+    l_atomic_add(nwait, (l_ulong)-1);
+    l_mutex_unlock(&self->mutex);
+    if (done) return;
+    spin = 0;
+  }
+}
+
+L_EXTERN void
+l_ring_push(l_ring* self, const void* elem)
+{
+  l_ring_wait(self, l_ring_pushOne, (void*)elem, &self->nwaitpush, &self->notfull);
+  l_ring_wake(self, &self->nwaitpop, &self->notempty);
+}
+
+L_EXTERN void
+l_ring_pop(l_ring* self, void* elem)
+{
+  l_ring_wait(self, l_ring_popOne, elem, &self->nwaitpop, &self->notempty);
+  l_ring_wake(self, &self->nwaitpush, &self->notfull);
+}
+
+L_EXTERN l_umedit
+l_ring_size(l_ring* self)
+{
+  l_ulong head = l_atomic_loadRelaxed(&self->head);
+  l_ulong tail = l_atomic_loadRelaxed(&self->tail);
+  return tail > head ? (l_umedit)(tail - head) : 0;
+}
+
+L_EXTERN l_umedit
+l_ring_capacity(l_ring* self)
+{
+  return (l_umedit)(self->mask + 1);
+}
+
+#define L_RING_TEST_COUNT 100000
+
+typedef struct {
+  l_ring* ring;
+  l_ulong sum;
+  l_ulong n;
+  l_ulong first;
+} l_ring_testarg;
+
+static void*
+l_ring_testProducer(void* para)
+{
+  l_ring_testarg* arg = (l_ring_testarg*)para;
+  l_ulong i = arg->first;
+  for (; i < arg->first + arg->n; ++i) {
+    l_ring_push(arg->ring, &i);
+  }
+  return 0;
+}
+
+static void*
+l_ring_testConsumer(void* para)
+{
+  l_ring_testarg* arg = (l_ring_testarg*)para;
+  l_ulong i = 0, v = 0;
+  for (; i < arg->n; ++i) {
+    l_ring_pop(arg->ring, &v);
+    arg->sum += v;
+  }
+  return 0;
+}
+
+static void
+l_ring_testThreads(l_umedit flags, int nproducer, int nconsumer)
+{
+  l_ring ring;
+  l_ring_testarg prod[2], cons[2];
+  l_thrid pthr[2], cthr[2];
+  l_ulong total = (l_ulong)L_RING_TEST_COUNT * nproducer, sum = 0;
+  int i = 0;
+
+  l_assert(l_ring_init(&ring, 64, sizeof(l_ulong), flags));
+
+  for (i = 0; i < nconsumer; ++i) {
+    cons[i].ring = &ring;
+    cons[i].sum = 0;
+    cons[i].n = total / nconsumer;
+    l_assert(l_raw_thread_create(cthr + i, l_ring_testConsumer, cons + i));
+  }
+
+  for (i = 0; i < nproducer; ++i) {
+    prod[i].ring = &ring;
+    prod[i].n = L_RING_TEST_COUNT;
+    prod[i].first = (l_ulong)L_RING_TEST_COUNT * i + 1;
+    l_assert(l_raw_thread_create(pthr + i, l_ring_testProducer, prod + i));
+  }
+
+  for (i = 0; i < nproducer; ++i) l_raw_thread_join(pthr + i);
+  for (i = 0; i < nconsumer; ++i) {
+    l_raw_thread_join(cthr + i);
+    sum += cons[i].sum;
+  }
+
+  l_assert(sum == total * (total + 1) / 2);
+  l_assert(l_ring_size(&ring) == 0);
+  l_ring_free(&ring);
+}
+
+L_EXTERN void
+l_ring_test()
+{
+  l_ring ring;
+  l_ulong a[10], b[10];
+  l_umedit flags[3] = {L_RING_MPMC, L_RING_MPSC, L_RING_SPSC};
+  l_ulong i = 0, v = 0;
+  int f = 0;
+  void* p = 0;
+
+  for (f = 0; f < 3; ++f) {
+    l_assert(l_ring_init(&ring, 5, sizeof(l_ulong), flags[f]));
+    l_assert(l_ring_capacity(&ring) == 8);
+    l_assert(!l_ring_tryPop(&ring, &v));
+
+    for (i = 0; i < 8; ++i) l_assert(l_ring_tryPush(&ring, &i));
+    l_assert(!l_ring_tryPush(&ring, &i) && l_ring_size(&ring) == 8);
+
+    for (i = 0; i < 8; ++i) {
+      l_assert(l_ring_tryPop(&ring, &v) && v == i);
+    }
+    l_assert(!l_ring_tryPop(&ring, &v));
+
+    /* batches wrap around the end of the array and stop at full or empty */
+    for (i = 0; i < 10; ++i) a[i] = 100 + i;
+    l_assert(l_ring_tryPushBatch(&ring, a, 3) == 3);
+    l_assert(l_ring_tryPushBatch(&ring, a + 3, 7) == 5);
+    l_assert(l_ring_tryPopBatch(&ring, b, 10) == 8);
+    for (i = 0; i < 8; ++i) l_assert(b[i] == 100 + i);
+    l_assert(l_ring_tryPopBatch(&ring, b, 10) == 0);
+
+    l_ring_free(&ring);
+  }
+
+  l_assert(l_ring_init(&ring, 4, sizeof(void*), L_RING_SPSC));
+  l_assert(l_ring_tryPushPtr(&ring, &ring) && l_ring_tryPushPtr(&ring, a));
+  l_assert(l_ring_tryPopPtr(&ring) == &ring);
+  l_assert((p = l_ring_tryPopPtr(&ring)) == a && l_ring_tryPopPtr(&ring) == 0);
+  l_ring_free(&ring);
+
+  l_assert(!l_ring_init(&ring, 8, L_CACHE_LINE_SIZE + 1, L_RING_MPMC));
+
+  l_ring_testThreads(L_RING_MPMC, 2, 2);
+  l_ring_testThreads(L_RING_MPSC, 2, 1);
+  l_ring_testThreads(L_RING_SPSC, 1, 1);
+}
+
@@ -0,0 +1,55 @@
+#ifndef l_core_ring_h
+#define l_core_ring_h
+#include "core/base.h"
+#include "core/atomic.h"
+#include "core/thread.h"
+
+/**
+ * bounded ring - a power of two array of cells, each cell has a sequence number
+ * that tells whether the cell is free for the push of this lap or ready for the
+ * pop (the Vyukov bounded queue). the multiple producer (consumer) side claims
+ * cells by a cas on its cursor, the single producer (consumer) side just stores
+ * its cursor. the cursors are on separate cache lines. elements are copied in
+ * and out, they can be message pointers or small plain structs.
+ */
+
+#define L_RING_MPMC 0x00
+#define L_RING_SINGLE_PRODUCER 0x01
+#define L_RING_SINGLE_CONSUMER 0x02
+#define L_RING_MPSC L_RING_SINGLE_CONSUMER
+#define L_RING_SPSC (L_RING_SINGLE_PRODUCER | L_RING_SINGLE_CONSUMER)
+
+typedef struct {
+  l_byte* cell; /* each cell is a l_ulong sequence number and the element */
+  l_ulong mask;
+  l_umedit cellsize;
+  l_umedit elemsize;
+  l_umedit flags;
+  l_byte pad0[L_CACHE_LINE_SIZE];
+  volatile l_ulong tail; /* next push position */
+  l_byte pad1[L_CACHE_LINE_SIZE - sizeof(l_ulong)];
+  volatile l_ulong head; /* next pop position */
+  l_byte pad2[L_CACHE_LINE_SIZE - sizeof(l_ulong)];
+  volatile l_ulong nwaitpush; /* number of blocked pushers and poppers */
+  volatile l_ulong nwaitpop;
+  l_mutex mutex;
+  l_condv notfull;
+  l_condv notempty;
+} l_ring;
+
+L_EXTERN int l_ring_init(l_ring* self, l_umedit capacity, l_umedit elemsize, l_umedit flags);
+L_EXTERN void l_ring_free(l_ring* self);
+L_EXTERN int l_ring_tryPush(l_ring* self, const void* elem);
+L_EXTERN int l_ring_tryPop(l_ring* self, void* elem);
+L_EXTERN l_umedit l_ring_tryPushBatch(l_ring* self, const void* elems, l_umedit n);
+L_EXTERN l_umedit l_ring_tryPopBatch(l_ring* self, void* elems, l_umedit n);
+L_EXTERN void l_ring_push(l_ring* self, const void* elem);
+L_EXTERN void l_ring_pop(l_ring* self, void* elem);
+L_EXTERN int l_ring_tryPushPtr(l_ring* self, void* ptr);
+L_EXTERN void* l_ring_tryPopPtr(l_ring* self);
+L_EXTERN l_umedit l_ring_size(l_ring* self); /* approximate if other threads are pushing or popping */
+L_EXTERN l_umedit l_ring_capacity(l_ring* self);
+L_EXTERN void l_ring_test();
+
+#endif /* l_core_ring_h */
+
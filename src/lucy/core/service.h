@@ -2,13 +2,21 @@
 #define l_core_service_h
 #include "core/base.h"
 #include "core/queue.h"
+#include "core/histo.h"
+#include "core/socket.h"
 
 #define L_MSGID_SERVICE_START 0x01
 #define L_MSGID_SERVICE_CLOSE 0x02
+#define L_MSGID_SERVICE_CREDIT 0x03 /* a parked l_message_sendWait message is sent, resume the service */
+#define L_MSGID_DGRAM_IND 0x04 /* msg->data datagrams received by a dgram service, see l_msg_dgram */
+
+#define L_MSGLANE_DATA 0x00
+#define L_MSGLANE_CONTROL 0x01 /* drained ahead of the data lane by weight, see inbox_*_weight in config */
 
 typedef struct lua_State lua_State;
 typedef struct l_service l_service;
 typedef struct l_thread l_thread;
+typedef struct l_callstate l_callstate;
 
 typedef struct {
   l_smplnode node;
@@ -21,6 +29,11 @@ typedef struct {
   l_umedit msgid;
   l_umedit data;
   l_ulong extra;
+  l_ulong from; /* sender thread index << 48 | destination svid if sent with credit, otherwise 0 */
+  l_umedit lane;
+  l_ulong call; /* caller svid << 32 | call sequence if it is a l_service_request, otherwise 0 */
+  l_ulong tsend; /* monotonic nanoseconds stamped when sent and routed if message tracing is on */
+  l_ulong troute;
 } l_message;
 
 typedef struct {
@@ -127,6 +140,56 @@ L_EXTERN void l_message_free(l_message* msg, l_thread* thread);
 L_EXTERN void l_message_freeQueue(l_squeue* mq, l_thread* thread);
 L_EXTERN void l_message_send(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg);
 L_EXTERN void l_message_sendData(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64);
+/* message tracing - when it is on each thread records the latencies of the messages
+its services handled in histograms by msgid, the msgid is as the service receives.
+L_MSGSTAT_ROUTE is from the send to master routed it, L_MSGSTAT_INBOX is from the
+routing to the worker dispatched it, and L_MSGSTAT_HANDLE is the time the service
+entry function took, all in nanoseconds. l_message_stats merges the histograms of
+all threads into out, return false if there is no record. */
+
+#define L_MSGSTAT_ROUTE 0
+#define L_MSGSTAT_INBOX 1
+#define L_MSGSTAT_HANDLE 2
+
+L_EXTERN void l_message_setTracing(int enable);
+L_EXTERN int l_message_stats(l_umedit msgid, int which, l_histo* out);
+L_EXTERN void l_message_sendLane(l_thread* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg, l_umedit lane);
+
+/* credited send - each thread can have at most mailbox_depth (the config) messages
+not yet handled by a destination service, the receiver grants the credit back as it
+drains its messages. l_message_trySend returns false and the msg is still owned by
+the caller if there is no credit. l_message_sendWait parks the msg and yields the
+service coroutine instead, the msg is sent when credit comes back and then the
+service receives L_MSGID_SERVICE_CREDIT, it should resume the coroutine to let it
+continue in kfunc. */
+
+L_EXTERN int l_message_trySend(l_service* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg);
+L_EXTERN int l_message_sendWait(l_service* from, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_message* msg, int (*kfunc)(l_service*));
+
+/* topic - publish a payload to all the subscribed services. the payload is copied
+once into a ref counted buffer that is shared by all the subscribers, and only one
+message is sent to each thread which has subscribers. l_topic_subscribe should be
+called by the service itself after it is started. a subscriber receives the publish
+as a message of the msgid, msg->data is the topic id and l_msg_payload(msg) is the
+payload, it is only valid during the call unless the subscriber retains it. */
+
+typedef struct l_payload l_payload;
+
+L_EXTERN l_umedit l_topic_register(l_strn name); /* return the topic id, 0 if failed */
+L_EXTERN int l_topic_subscribe(l_service* srvc, l_umedit topic);
+L_EXTERN int l_topic_subscribeName(l_service* srvc, l_strn name);
+L_EXTERN void l_topic_unsubscribe(l_service* srvc, l_umedit topic);
+L_EXTERN l_int l_topic_publish(l_thread* from, l_umedit topic, l_umedit msgid, const void* data, l_int size); /* return the number of threads sent to */
+L_EXTERN const l_byte* l_payload_data(l_payload* payload);
+L_EXTERN l_int l_payload_size(l_payload* payload);
+L_EXTERN void l_payload_retain(l_payload* payload);
+L_EXTERN void l_payload_release(l_payload* payload);
+
+L_INLINE l_payload*
+l_msg_payload(l_message* msg)
+{
+  return (l_payload*)l_msg_getptr(msg);
+}
 
 /* if custom service has any extra resource need to free,
 the only chance is to handle L_MSGID_SERVICE_CLOSE message. */
@@ -146,6 +209,9 @@ typedef struct l_service {
   lua_State* co;
   int (*func)(l_service*);
   int (*kfunc)(l_service*);
+  l_callstate* call; /* outstanding requests, created at the first l_service_request */
+  int (*conn)(l_service*, l_sockconn*); /* per worker connection handler of a listen service */
+  l_int dgsize; /* buffer size of each datagram of a dgram service */
 } l_service;
 
 #define L_SERVICE_CREATE(name) (name*)l_service_create(sizeof(name), name##_proc)
@@ -154,7 +220,10 @@ typedef struct l_service {
 L_EXTERN l_service* l_service_create(l_int size, int (*entry)(l_service*, l_message*));
 L_EXTERN l_service* l_service_createFrom(l_service* from, l_int size, int (*entry)(l_service*, l_message*));
 L_EXTERN l_service* l_service_setListen(l_service* srvc, l_filedesc fd);
+L_EXTERN l_service* l_service_setListenShard(l_service* srvc, l_filedesc fd);
 L_EXTERN l_service* l_service_setConnect(l_service* srvc, l_filedesc fd);
+L_EXTERN l_service* l_service_setDgram(l_service* srvc, l_filedesc fd, l_int dgsize); /* dgsize <= 0 is L_DGRAM_DEFAULT_SIZE */
+L_EXTERN l_service* l_service_setAccept(l_service* srvc, int (*conn)(l_service* listen, l_sockconn* conn));
 L_EXTERN l_service* l_service_setEvent(l_service* srvc, l_filedesc fd, l_ushort masks);
 L_EXTERN l_ulong l_service_id(l_service* srvc);
 L_EXTERN void l_service_start(l_service* srvc);
@@ -171,6 +240,153 @@ L_EXTERN int l_service_setResume(l_service* srvc, int (*func)(l_service*));
 L_EXTERN int l_service_resume(l_service* srvc);
 L_EXTERN int l_service_yield(l_service* srvc, int (*kfunc)(l_service*));
 L_EXTERN int l_service_yieldWith(l_service* srvc, int (*kfunc)(l_service*), int code);
+L_EXTERN int l_service_ioSpend(l_service* srvc, l_int bytes);
+L_EXTERN void l_service_requeueEvent(l_service* srvc, l_ushort masks);
+L_EXTERN int l_service_workers();
+L_EXTERN l_thread* l_service_workerThread(int i); /* 1 <= i <= l_service_workers() */
+
+/* accept hand-off - a listen service with a connection handler set by
+l_service_setAccept does not receive L_MSGID_SOCK_CONN_IND. master accepts the
+connections in batches and hands them to the workers in turn, and the handler
+is called on the worker for each connection. the handlers run concurrently so
+they should only read the listen service, and the listen service should not be
+closed before its socket. the handler returns false to let the socket closed.
+a listen shard is set by l_service_setListenShard with its own reuseport socket
+(l_socket_listenEx) and started on a worker by l_service_startEx. master only
+tells the shard the socket is readable, the shard accepts the connections on
+its worker and calls the handler there, so each worker accepts in parallel. */
+
+/* io budget - the sockets are edge triggered so a service reads until EAGAIN,
+a busy peer can then keep the worker to itself. each dispatch of a message has
+a budget of io_budget bytes and io_budget_calls io calls (config), the service
+calls l_service_ioSpend after each read or write that may have more to do. when
+it returns false the service stops and calls l_service_requeueEvent with the
+masks not finished, the masks are kept in srvc->evmk and a socket event is sent
+to the service again on the data lane, behind the data messages already queued
+on the worker. */
+
+/* dgram service - a service set by l_service_setDgram with a l_socket_dgram
+socket gets L_MSGID_DGRAM_IND instead of the read event. the worker receives the
+datagrams in batches of L_DGRAM_BATCH into the buffers of one message kept by the
+thread and calls the service for each batch until the socket is drained or the
+io budget is used up. msg->data is the number of datagrams and the buffers are reused after the
+service returns, so the data should be copied if it is kept. use dgsize 65535
+with l_socket_setGro. the service can answer with l_socket_sendBatch. */
+
+#define L_DGRAM_BATCH 32
+#define L_DGRAM_DEFAULT_SIZE 2048
+
+typedef struct {
+  l_message head;
+  l_dgram dgram[L_DGRAM_BATCH];
+} l_dgram_message;
+
+L_INLINE l_dgram*
+l_msg_dgram(l_message* msg)
+{
+  return ((l_dgram_message*)msg)->dgram;
+}
+
+/* request/response - l_service_request sends a request and returns its index in
+the batch, the batch is the requests sent since last l_service_await finished.
+l_service_await yields the service coroutine until all the requests of the batch
+are replied or timeout after ms, and then the coroutine continues in kfunc (kfunc
+is called directly if there is no request to wait). the result of request i is
+got by l_service_result, it returns L_SUCCESS, L_WAITMORE, L_ETIMEOUT or L_EINVAL.
+the receiver replies by l_service_reply with the request message. */
+
+L_EXTERN l_int l_service_request(l_service* srvc, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64);
+L_EXTERN int l_service_await(l_service* srvc, l_umedit ms, int (*kfunc)(l_service*));
+L_EXTERN int l_service_call(l_service* srvc, l_ulong destid, l_umedit msgid, l_umedit u32, l_ulong u64, l_umedit ms, int (*kfunc)(l_service*));
+L_EXTERN int l_service_result(l_service* srvc, l_int i, l_umedit* u32, l_ulong* u64);
+L_EXTERN void l_service_reply(l_service* srvc, l_message* req, l_umedit u32, l_ulong u64);
+
+/* connection pool - each thread keeps the outbound connections of its services
+keyed by the remote address and the socket options (opts can be null). a checkout
+is a request of the batch, l_connpool_checkout returns its index and l_service_await
+waits it together with the other requests. l_connpool_result returns L_SUCCESS with
+the connection, L_ETIMEOUT, L_ELIMIT if pool_max_conns (config) connections of the
+key are in use, or L_ERROR with the connect errno (SO_ERROR). an idle connection is
+reused if it is idle shorter than pool_idle_timeout, connected shorter than
+pool_lifetime, and still alive. a connect goes on after the await timed out, the
+connection is kept as idle if it succeeds. the service which checked out the
+connection returns it with reuse false if its protocol state is unknown, e.g. a
+response not fully read. if the socket is the event of the service (l_service_modEvent)
+it is taken off the service when returned, and it is not reused until master has
+taken it out of the event manager. */
+
+typedef struct l_poolhost l_poolhost;
+
+typedef struct l_poolconn {
+  l_filedesc sock;
+  /* the fields below are used by the pool */
+  l_poolhost* host;
+  struct l_poolconn* next;
+  l_service* waiter; /* the service waiting the connect */
+  l_umedit seq; /* the request of the waiter */
+  l_ulong born; /* ms connected */
+  l_ulong idle; /* ms returned to the pool */
+} l_poolconn;
+
+L_EXTERN l_int l_connpool_checkout(l_service* srvc, const l_sockaddr* addr, const l_sockopts* opts);
+L_EXTERN int l_connpool_result(l_service* srvc, l_int i, l_poolconn** conn, int* err);
+L_EXTERN void l_connpool_return(l_service* srvc, l_poolconn* conn, int reuse);
+
+/* receive slabs - each thread keeps a free list of rx_slab_size (config) slabs
+for the connections of its services. a connection takes a slab only when it has
+data to read and releases it when all the data is consumed, so an idle connection
+holds no receive memory. the socket reads straight into the slab and the data is
+handed out as read-only spans of it without a copy. a slab is reference counted,
+each span holds a reference until l_rxspan_release, so a span stays valid after
+the connection moved on to another slab. l_rxslab_ensure makes room for more data
+in the slab of a connection: it keeps the data from start and moves it to the
+front, it is only copied to another slab if the slab is too small or still shared
+by spans. a slab larger than rx_slab_size is allocated for the exact size and
+freed when released. slabs and spans are only used by the thread of the service. */
+
+typedef struct l_rxslab {
+  struct l_rxslab* next; /* in the free list */
+  l_int refs;
+  l_int cap; /* size of the data area */
+  l_int size; /* bytes of data */
+} l_rxslab;
+
+typedef struct {
+  const l_byte* start;
+  const l_byte* end;
+  l_rxslab* slab;
+} l_rxspan;
+
+#define l_rxslab_data(slab) ((l_byte*)((slab) + 1))
+#define l_rxslab_remain(slab) ((slab)->cap - (slab)->size)
+
+L_EXTERN l_rxslab* l_rxslab_acquire(l_service* srvc, l_int minsize);
+L_EXTERN void l_rxslab_release(l_service* srvc, l_rxslab** slab);
+L_EXTERN int l_rxslab_ensure(l_service* srvc, l_rxslab** slab, l_int start, l_int remain);
+L_EXTERN l_rxspan l_rxslab_span(l_rxslab* slab, l_int start, l_int end);
+L_EXTERN void l_rxspan_release(l_service* srvc, l_rxspan* span);
+
+/* loop counters - each thread counts its own loop and the counters are read with
+relaxed loads, so they cost no lock on the hot path. index 0 is the master and
+1 ~ l_loopstat_threads()-1 are the workers. messages are the ones master routed
+or worker handled, events are the io events master waited. with the config
+loop_stats_interval (ms) master copies all counters into a snapshot and logs it
+periodically, l_loopstat_snapshot returns the time (ms) of the last snapshot. */
+
+typedef struct {
+  l_ulong loops;
+  l_ulong waits;
+  l_ulong events;
+  l_ulong messages;
+  l_ulong coalesced; /* master wakeups which were already signaled */
+  l_ulong signals; /* condvar signals master sent to wake workers */
+  l_ulong blockedns;
+  l_ulong busyns;
+} l_loopstat;
+
+L_EXTERN int l_loopstat_threads();
+L_EXTERN int l_loopstat_get(int index, l_loopstat* out);
+L_EXTERN l_ulong l_loopstat_snapshot(l_loopstat* out, int n);
 
 /* master service */
 
@@ -1,33 +1,20 @@
 #define L_LIBRARY_IMPL
 #include "core/shortstr.h"
+#include "core/hash.h"
+#include <stddef.h>
 
 typedef struct l_shortstr {
-  l_smplnode node;
   struct l_shortstr* next;
   l_byte flags;
   l_byte extra;
-  l_byte size;
+  l_byte size; /* the table key is the length prefixed bytes from here */
   l_byte s[1];
 } l_shortstr;
 
-L_EXTERN l_umedit
-l_string_make_hash(l_strn s, l_umedit seed)
+L_EXTERN l_hashtable*
+l_shortstr_createTable(l_byte sizebits)
 {
-  l_int step = (s.len >> 5) + 1;
-  l_umedit hash = seed ^ l_cast(l_umedit, s.len);
-  for (; s.len >= step; s.len -= step) {
-    hash ^= ((hash<<5) + (hash>>2) + s.start[s.len - 1]);
-  }
-  return hash;
-}
-
-static int
-l_shortstr_check_func(void* from, l_smplnode* node)
-{
-  l_strn* s = (l_strn*)from;
-  l_shortstr* shortstr = (l_shortstr*)node;
-  if (s.len != shortstr->size) return false;
-  return memcmp(s.start, shortstr->s, shortstr->size) == 0;
+  return l_hashtable_createKeyed(sizebits, (l_int)offsetof(l_shortstr, size));
 }
 
 L_EXTERN l_shortstr*
@@ -35,25 +22,28 @@ l_shortstr_create(l_hashtable* table, l_strn from, l_allocfunc func)
 {
   l_umedit hash = 0;
   l_shortstr* shortstr = 0;
-  l_smplnode* elem = 0;
 
-  if (l_strn_is_empty(&from) || from.n > 255) return 0;
+  if (l_strn_isEmpty(&from) || from.len > 255) return 0;
 
-  hash = l_string_make_hash(from, table->seed);
-  if ((elem == l_hashtable_find(table, hash, l_shortstr_check_func, &from)) != 0) {
-    return (l_shortstr*)elem;
+  hash = (l_umedit)l_hash_strn(from);
+  if ((shortstr = (l_shortstr*)l_hashtable_findStr(table, hash, from)) != 0) {
+    return shortstr;
   }
 
-  shortstr = (l_shortstr*)allocfunc(sizeof(l_shortstr) + from.n);
+  shortstr = (l_shortstr*)l_malloc(func, sizeof(l_shortstr) + from.len);
   if (shortstr == 0) return 0;
 
-  shortstr.next = 0;
-  shortstr.flags = shortstr.extra = 0;
-  shortstr.size = from.n;
-  l_copy_n(from.start, from.n, shortstr.s);
-  *(shortstr.s + from.n) = 0;
+  shortstr->next = 0;
+  shortstr->flags = shortstr->extra = 0;
+  shortstr->size = (l_byte)from.len;
+  l_copy_n(from.start, from.len, shortstr->s);
+  *(shortstr->s + from.len) = 0;
+
+  if (!l_hashtable_add(table, shortstr, hash)) {
+    l_mfree(func, shortstr);
+    return 0;
+  }
 
-  l_hashtable_add(table, &shortstr->node, hash);
   return shortstr;
 }
 
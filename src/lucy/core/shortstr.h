@@ -1,10 +1,12 @@
 #ifndef l_core_shortstr_h
 #define l_core_shortstr_h
 #include "core/base.h"
+#include "core/table.h"
 
 typedef struct l_shortstr l_shortstr;
 
-L_EXTERN l_shortstr* l_shortstr_create(l_byte size, const void* s, l_allocfunc func);
+L_EXTERN l_hashtable* l_shortstr_createTable(l_byte sizebits);
+L_EXTERN l_shortstr* l_shortstr_create(l_hashtable* table, l_strn from, l_allocfunc func);
 L_EXTERN void l_shortstr_free(l_shortstr* self, l_allocfunc func);
 
 #endif /* l_core_shortstr_h */
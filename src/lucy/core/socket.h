@@ -6,6 +6,7 @@
 
 #define L_SOCKET_IPV4 0x01
 #define L_SOCKET_IPV6 0x02
+#define L_SOCKET_UNIX 0x03
 
 typedef struct {
   L_PLAT_IMPL_SIZE(L_SOCKADDR_SIZE);
@@ -16,11 +17,19 @@ typedef struct {
   l_sockaddr remote;
 } l_sockconn;
 
+typedef struct {
+  void* base;
+  l_int len;
+} l_iobuf;
+
 L_EXTERN int l_sockaddr_init(l_sockaddr* self, l_strt ip, l_ushort port);
 L_EXTERN l_ushort l_sockaddr_family(l_sockaddr* self);
 L_EXTERN l_ushort l_sockaddr_port(l_sockaddr* self);
 L_EXTERN int l_sockaddr_ip(l_sockaddr* self, l_byte* out, l_int len);
-L_EXTERN int l_sockaddr_ipstring(l_sockaddr* self, l_string* out);
+L_EXTERN int l_sockaddr_ipstring(l_sockaddr* self, l_string* out); /* the path of an unix address */
+L_EXTERN int l_sockaddr_initUnix(l_sockaddr* self, l_strt path); /* a path starts with '@' is in the abstract namespace */
+L_EXTERN int l_sockaddr_equal(const l_sockaddr* a, const l_sockaddr* b);
+L_EXTERN l_ulong l_sockaddr_hash(const l_sockaddr* self, l_ulong seed);
 
 L_INLINE int
 l_socket_isEmpty(l_filedesc sock)
@@ -28,16 +37,127 @@ l_socket_isEmpty(l_filedesc sock)
   return l_filedesc_isEmpty(sock);
 }
 
+/* with L_SOCKET_LISTEN_REUSEPORT many sockets can listen on the same address,
+the kernel spreads the connections to them by the hash of the address pair,
+or by the cpu after l_socket_steerByCpu on any one of them. */
+
+#define L_SOCKET_LISTEN_REUSEPORT 0x01
+#define L_SOCKET_SEQPACKET 0x02 /* an unix socket keeps the message boundaries */
+
+/* socket option profile - the options given are applied, the others keep the
+system default. defer_accept, fastopen, rcvbuf and sndbuf are applied to the
+listen socket before listen (the accepted sockets inherit the buffer sizes and
+the window scale is decided by the rcvbuf at the handshake), the others are
+applied to each accepted or connected socket. l_sockopts_set validates the
+value and returns false for an unknown option or a value out of range. */
+
+#define L_SOCKOPT_NODELAY       0  /* 0 or 1, disable the nagle algorithm */
+#define L_SOCKOPT_DEFER_ACCEPT  1  /* seconds to wait for the first data before accept */
+#define L_SOCKOPT_FASTOPEN      2  /* the queue length of pending fast open requests */
+#define L_SOCKOPT_RCVBUF        3  /* bytes */
+#define L_SOCKOPT_SNDBUF        4  /* bytes */
+#define L_SOCKOPT_NOTSENT_LOWAT 5  /* bytes unsent in the send buffer before writable */
+#define L_SOCKOPT_BUSY_POLL     6  /* microseconds to busy poll the device queue on read */
+#define L_SOCKOPT_KEEPALIVE     7  /* 0 or 1 */
+#define L_SOCKOPT_KEEPIDLE      8  /* seconds idle before the first probe */
+#define L_SOCKOPT_KEEPINTVL     9  /* seconds between the probes */
+#define L_SOCKOPT_KEEPCNT       10 /* probes before the connection is dropped */
+#define L_SOCKOPT_USER_TIMEOUT  11 /* milliseconds the sent data can stay unacknowledged */
+#define L_SOCKOPT_COUNT         12
+
+typedef struct {
+  l_umedit given; /* bit i is set if option i is given */
+  int value[L_SOCKOPT_COUNT];
+} l_sockopts;
+
+L_EXTERN void l_sockopts_init(l_sockopts* self);
+L_EXTERN int l_sockopts_set(l_sockopts* self, int opt, l_int value);
+L_EXTERN int l_sockopts_setByName(void* self, l_strn name, l_int value); /* the name is the option in lower case without L_SOCKOPT_ */
+L_EXTERN int l_socket_setConnOpts(l_filedesc sock, const l_sockopts* opts); /* return false if any option failed */
+
 L_EXTERN void l_socket_init(); /* socket global init */
 L_EXTERN l_filedesc l_socket_listen(const l_sockaddr* addr, int backlog);
+L_EXTERN l_filedesc l_socket_listenEx(const l_sockaddr* addr, int backlog, l_umedit flags, const l_sockopts* opts);
+L_EXTERN int l_socket_steerByCpu(l_filedesc sock, int nshard); /* attach to the reuseport group of sock */
 L_EXTERN void l_socket_accept(l_filedesc sock, void (*cb)(void*, l_sockconn*), void* ud);
+L_EXTERN int l_socket_acceptBatch(l_filedesc sock, l_sockconn* conns, int n); /* the accepted sockets are nonblocking */
 L_EXTERN void l_socket_close(l_filedesc* sock);
 L_EXTERN void l_socket_shutdown(l_filedesc sock, l_byte r_w_a);
 L_EXTERN void l_socketconn_init(l_sockconn* self, l_strt ip, l_ushort port);
 L_EXTERN int l_socket_connect(l_sockconn* conn);
+L_EXTERN int l_socket_connectEx(l_sockconn* conn, l_umedit flags, const l_sockopts* opts); /* opts are the connection options */
+L_EXTERN int l_socket_connectError(l_filedesc sock); /* SO_ERROR of a connect in progress, 0 if connected */
+L_EXTERN int l_socket_isAlive(l_filedesc sock); /* an idle connection is not closed and has no data to read */
+L_EXTERN int l_socket_pair(l_filedesc* pair, l_umedit flags); /* connected unix sockets, nonblocking */
+
+/* fd passing - an unix socket can carry open fds to another process (SCM_RIGHTS)
+together with at least one byte of data. l_socket_sendFds returns the bytes
+sent, 0 if the socket buffer is full, or L_ERROR. l_socket_recvFds returns the
+bytes received, 0 if nothing is pending, or L_ERROR also if the peer closed,
+*nfd is the capacity of fds and is set to the number received. the received
+fds are close-on-exec, the sent ones can be closed after the call. */
+
+#define L_SOCKET_MAX_FDS 16
+
+L_EXTERN l_int l_socket_sendFds(l_filedesc sock, const void* data, l_int len, const l_filedesc* fds, int nfd);
+L_EXTERN l_int l_socket_recvFds(l_filedesc sock, void* out, l_int len, l_filedesc* fds, int* nfd);
 L_EXTERN l_sockaddr l_socket_localaddr(l_filedesc sock);
 L_EXTERN l_int l_socket_read(l_filedesc sock, void* out, l_int count, l_int* status);
 L_EXTERN l_int l_socket_write(l_filedesc sock, const void* buf, l_int count, l_int* status);
+
+/* vectored io - the iov array is advanced past the bytes transferred, so after a
+partial transfer (*status > 0 is the bytes left, the same as l_socket_write) the
+call can be repeated with the same array. with L_SOCKET_ZEROCOPY a large write
+is sent from the pages of the buffers without copying (linux MSG_ZEROCOPY, the
+socket needs l_socket_setZeroCopy first), and the buffers must be kept until
+l_socket_zeroCopyDone reports the sends complete. the kernel numbers the zerocopy
+sends of a socket from 0 and *sends is increased by the number issued. pending
+completions are reported as L_SOCKET_ERR events of the socket. */
+
+#define L_SOCKET_ZEROCOPY 0x01
+#define L_SOCKET_ZEROCOPY_MIN (16*1024) /* the smaller write is copied anyway */
+
+L_EXTERN l_int l_socket_readv(l_filedesc sock, l_iobuf* iov, int n, l_int* status);
+L_EXTERN l_int l_socket_writev(l_filedesc sock, l_iobuf* iov, int n, l_int* status);
+L_EXTERN l_int l_socket_writevEx(l_filedesc sock, l_iobuf* iov, int n, l_umedit flags, l_umedit* sends, l_int* status);
+L_EXTERN int l_socket_setZeroCopy(l_filedesc sock, int enable);
+L_EXTERN int l_socket_zeroCopyDone(l_filedesc sock, l_umedit* upto); /* return completions reaped, raise *upto to the sends completed */
+
+/* datagram sockets - l_socket_dgram creates a nonblocking udp socket bound to
+addr, or not bound if addr is null. l_socket_recvBatch receives up to n
+datagrams in one call (linux recvmmsg), each into the buffer of its l_dgram, and
+returns the number received, 0 if none is pending, or L_ERROR. len is the bytes
+received and L_DGRAM_TRUNC is set if the buffer was too small. after
+l_socket_setGro the kernel can coalesce the datagrams of a flow into one buffer
+of segments of segsize bytes each, the last one can be shorter. l_socket_sendBatch
+sends n datagrams in one call (sendmmsg) and returns the number sent, it is less
+than n if the socket buffer is full. the kernel splits a datagram with segsize
+into datagrams of segsize bytes (linux UDP_SEGMENT), the addr of a datagram to
+send is ignored if the socket is connected and addr is zeroed. */
+
+#define L_DGRAM_TRUNC 0x01
+
+typedef struct {
+  l_sockaddr addr; /* source of a received datagram or destination to send */
+  l_byte* data;
+  l_int size; /* buffer size */
+  l_int len; /* bytes received or to send */
+  l_ushort segsize; /* gro or gso segment size, 0 if not segmented */
+  l_ushort flags;
+} l_dgram;
+
+L_EXTERN l_filedesc l_socket_dgram(const l_sockaddr* addr, l_umedit flags); /* flags can be L_SOCKET_LISTEN_REUSEPORT */
+L_EXTERN int l_socket_recvBatch(l_filedesc sock, l_dgram* dgram, int n);
+L_EXTERN int l_socket_sendBatch(l_filedesc sock, l_dgram* dgram, int n);
+L_EXTERN int l_socket_setGro(l_filedesc sock, int enable);
+
+/* send count bytes of the file from *offset without copying them to the user
+space (linux sendfile), *offset is advanced past the bytes sent. if offset is
+null the file is a pipe and the bytes are spliced from its read end, the pipe
+must already hold the count bytes. *status is 0 done, the bytes left on EAGAIN,
+or L_ERROR also if the file or the pipe ends early. */
+
+L_EXTERN l_long l_socket_sendFile(l_filedesc sock, l_filedesc file, l_long* offset, l_long count, l_int* status);
 L_EXTERN void l_socket_test();
 L_EXTERN void l_plat_event_test();
 L_EXTERN void l_plat_sock_test();
@@ -53,6 +173,8 @@ L_EXTERN void l_plat_sock_test();
 #define L_SOCKET_FLAG_ADDED   0x01
 #define L_SOCKET_FLAG_LISTEN  0x02
 #define L_SOCKET_FLAG_CONNECT 0x04
+#define L_SOCKET_FLAG_SHARD   0x08
+#define L_SOCKET_FLAG_DGRAM   0x10
 
 typedef struct {
   l_filedesc fd;
@@ -1,5 +1,6 @@
 #define L_LIBRARY_IMPL
 #include "core/state.h"
+#include "core/string.h"
 
 typedef struct l_luaextra {
 
@@ -31,6 +32,51 @@ l_luaextra_get(lua_State* L)
   return *((l_luaextra**)lua_getextraspace(L));
 }
 
+/* lucy.utf8check(s) - return true, or false and the 1-based position of the first invalid byte */
+static int
+l_lualib_utf8check(lua_State* L)
+{
+  size_t len = 0;
+  const l_byte* s = (const l_byte*)luaL_checklstring(L, 1, &len);
+  const l_byte* e = l_utf8_validate(l_strt_n(s, (l_int)len));
+  if (e == s + len) {
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+  lua_pushboolean(L, 0);
+  lua_pushinteger(L, (lua_Integer)(e - s + 1));
+  return 2;
+}
+
+/* lucy.utf8len(s) - return number of runes, or nil and the position of the first invalid byte */
+static int
+l_lualib_utf8len(lua_State* L)
+{
+  size_t len = 0;
+  const l_byte* s = (const l_byte*)luaL_checklstring(L, 1, &len);
+  const l_byte* e = l_utf8_validate(l_strt_n(s, (l_int)len));
+  if (e == s + len) {
+    lua_pushinteger(L, (lua_Integer)l_utf8_count(l_strt_n(s, (l_int)len)));
+    return 1;
+  }
+  lua_pushnil(L);
+  lua_pushinteger(L, (lua_Integer)(e - s + 1));
+  return 2;
+}
+
+static const luaL_Reg l_lualib_funcs[] = {
+  {"utf8check", l_lualib_utf8check},
+  {"utf8len", l_lualib_utf8len},
+  {0, 0}
+};
+
+static void
+l_lualib_open(lua_State* L)
+{
+  luaL_newlib(L, l_lualib_funcs);
+  lua_setglobal(L, "lucy");
+}
+
 L_EXTERN lua_State*
 l_luastate_new()
 {
@@ -42,6 +88,7 @@ l_luastate_new()
   }
 
   luaL_openlibs(L); /* open all standard lus libraries */
+  l_lualib_open(L);
   l_luaextra_init(L);
   l_luaconf_init(L);
   return L;
@@ -501,6 +548,54 @@ l_luaconf_strv(lua_State* L, int (*func)(void* stream, l_strn str), void* stream
   return func(stream, l_strn_n(result, len));
 }
 
+/* call func for each string key of the table, the value should be a number or
+a boolean. return false if the table not exist or any field is not accepted. */
+L_EXTERN int
+l_luaconf_tablev(lua_State* L, int (*func)(void* obj, l_strn key, l_int value), void* obj, int n, ...)
+{
+  int startelems = 0, ok = true;
+  const char* key = 0;
+  size_t len = 0;
+  l_int value = 0;
+  va_list vl;
+  va_start(vl, n);
+  startelems = lua_gettop(L);
+
+  if (!l_luaconf_getv(L, n, vl) || !lua_istable(L, -1)) {
+    lua_pop(L, lua_gettop(L) - startelems);
+    va_end(vl);
+    return false;
+  }
+
+  va_end(vl);
+
+  lua_pushnil(L); /* the first key */
+  while (lua_next(L, -2)) { /* push key and value */
+    if (lua_type(L, -2) != LUA_TSTRING) { /* lua_tolstring on a number key confuses lua_next */
+      lua_pop(L, 1);
+      continue;
+    }
+    key = lua_tolstring(L, -2, &len);
+    if (lua_isboolean(L, -1)) {
+      value = lua_toboolean(L, -1);
+    } else if (lua_type(L, -1) == LUA_TNUMBER) {
+      value = lua_tointeger(L, -1);
+    } else {
+      l_loge_1("loadconf %s not a number", ls(key));
+      ok = false;
+      lua_pop(L, 1);
+      continue;
+    }
+    if (!func(obj, l_strn_n(key, len), value)) {
+      ok = false;
+    }
+    lua_pop(L, 1); /* pop the value and keep the key for next */
+  }
+
+  lua_pop(L, lua_gettop(L) - startelems);
+  return ok;
+}
+
 /**
  * ## Continuations
  *
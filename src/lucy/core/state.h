@@ -33,6 +33,7 @@ L_EXTERN l_int l_luaconf_int(lua_State* L, const void* name);
 L_EXTERN l_int l_luaconf_intv(lua_State* L, int n, ...);
 L_EXTERN int l_luaconf_str(lua_State* L, int (*read)(void* obj, l_strn s), void* obj, const void* name);
 L_EXTERN int l_luaconf_strv(lua_State* L, int (*read)(void* obj, l_strn s), void* obj, int n, ...);
+L_EXTERN int l_luaconf_tablev(lua_State* L, int (*read)(void* obj, l_strn key, l_int value), void* obj, int n, ...);
 
 #endif /* lucy_state_h */
 
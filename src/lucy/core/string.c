@@ -31,10 +31,48 @@ L_PRIVAT void l_buffer_free(l_buffer* buffer, l_thread* hint);
 static void
 l_string_setEnd(l_string* self, l_int len)
 {
-  l_string_ptr(self)->size = len;
+  if (self->p) {
+    l_string_ptr(self)->size = len;
+  } else {
+    self->n = (l_byte)len;
+  }
   *(l_string_start(self) + len) = 0;
 }
 
+static int
+l_string_initBuffer(l_string* self, l_int capacity, l_strn from, l_thread* hint)
+{
+  l_int size = capacity;
+
+  if (size <= from.len)
+    size = from.len + 1;
+  else /* 1 for zero terminated byte */
+    size += 1;
+
+  size += sizeof(l_strbuf);
+  if (!l_buffer_init((l_buffer*)self, size, hint)) {
+    return false;
+  }
+
+  l_string_ptr(self)->limit = 0;
+  l_string_setEnd(self, 0);
+  if (l_copy_n(from.start, from.len, l_string_start(self))) {
+    l_string_setEnd(self, from.len);
+  }
+  return true;
+}
+
+static int /* move inline bytes into a pooled buffer */
+l_string_spill(l_string* self, l_int capacity, l_thread* hint)
+{
+  l_string s = {0};
+  if (!l_string_initBuffer(&s, capacity, l_strn_n(self->a, self->n), hint)) {
+    return false;
+  }
+  *self = s;
+  return true;
+}
+
 L_EXTERN l_string
 l_string_empty()
 {
@@ -62,21 +100,20 @@ l_string_createEx(l_int size, l_thread* hint)
 L_EXTERN l_string
 l_string_createFromEx(l_int size, l_strn from, l_thread* hint)
 {
-  l_string s;
+  l_string s = {0};
 
   if (size < 0) size = 0;
-  if (size <= from.len)
-    size = from.len + 1;
-  else /* 1 for zero terminated byte */
-    size += 1;
+  if (from.len < 0) from.len = 0;
 
-  size += sizeof(l_strbuf);
-  if (!l_buffer_init((l_buffer*)&s, size, hint)) {
-    return (l_string){0};
+  if (size <= L_STRING_INLINE_SIZE && from.len <= L_STRING_INLINE_SIZE) {
+    if (l_copy_n(from.start, from.len, s.a)) {
+      l_string_setEnd(&s, from.len);
+    }
+    return s;
   }
 
-  if (l_copy_n(from.start, from.len, l_string_start(&s))) {
-    l_string_setEnd(&s, from.len);
+  if (!l_string_initBuffer(&s, size, from, hint)) {
+    return (l_string){0};
   }
   return s;
 }
@@ -84,7 +121,11 @@ l_string_createFromEx(l_int size, l_strn from, l_thread* hint)
 L_EXTERN void
 l_string_setLimit(l_string* self, l_int limit)
 {
-  l_int capacity = l_string_capacity(self);
+  l_int capacity = 0;
+  if (!self->p && !l_string_spill(self, L_STRING_INLINE_SIZE, 0)) {
+    return; /* the limit is kept in the pooled buffer */
+  }
+  capacity = l_string_capacity(self);
   if (limit < 0) limit = 0;
   if (limit < capacity) limit = capacity;
   l_string_ptr(self)->limit = limit;
@@ -94,11 +135,11 @@ L_PRIVAT void
 l_string_initLog(l_string* log, l_int limit, l_thread* hint)
 {
   if (limit < 8) limit = 8;
-  if (l_string_ptr(log)) {
+  if (log->p) {
     l_int capacity = l_string_capacity(log);
     if (limit < capacity) limit = capacity;
-  } else {
-    *log = l_string_createEx(limit, hint);
+  } else if (!l_string_initBuffer(log, limit, l_strn_empty(), hint)) {
+    return;
   }
   l_string_ptr(log)->limit = -limit; /* set negative limit */
 }
@@ -106,19 +147,29 @@ l_string_initLog(l_string* log, l_int limit, l_thread* hint)
 L_EXTERN void
 l_string_free(l_string* self, l_thread* hint)
 {
-  l_buffer_free((l_buffer*)self, hint);
+  if (self->p) {
+    l_buffer_free((l_buffer*)self, hint);
+  }
+  self->a[0] = 0;
+  self->n = 0;
 }
 
 L_EXTERN void
 l_string_clear(l_string* self)
 {
-  *l_string_start(self) = 0;
-  l_string_ptr(self)->size = 0;
+  l_string_setEnd(self, 0);
+}
+
+L_EXTERN int
+l_string_isInline(l_string* self)
+{
+  return self->p == 0;
 }
 
 L_EXTERN l_int
 l_string_capacity(l_string* self)
 {
+  if (!self->p) return L_STRING_INLINE_SIZE;
   return l_string_ptr(self)->HEAD.bsize - sizeof(l_strbuf) - 1;
 }
 
@@ -131,20 +182,22 @@ l_string_remain(l_string* self)
 L_EXTERN l_int
 l_string_size(l_string* self)
 {
-  return l_string_ptr(self)->size;
+  return self->p ? l_string_ptr(self)->size : self->n;
 }
 
 L_EXTERN l_int
 l_string_limit(l_string* self)
 {
-  l_int limit = l_string_ptr(self)->limit;
+  l_int limit = 0;
+  if (!self->p) return 0; /* no limit */
+  limit = l_string_ptr(self)->limit;
   return limit >= 0 ? limit : -limit;
 }
 
 L_EXTERN l_byte*
 l_string_start(l_string* self)
 {
-  return (l_byte*)(l_string_ptr(self) + 1);
+  return self->p ? (l_byte*)(l_string_ptr(self) + 1) : self->a;
 }
 
 L_EXTERN l_byte*
@@ -156,13 +209,13 @@ l_string_end(l_string* self)
 L_EXTERN l_strt
 l_string_strt(l_string* self)
 {
-  return l_strt_n(l_string_start(self), l_string_ptr(self)->size);
+  return l_strt_n(l_string_start(self), l_string_size(self));
 }
 
 L_EXTERN l_strn
 l_string_strn(l_string* self)
 {
-  return l_strn_n(l_string_start(self), l_string_ptr(self)->size);
+  return l_strn_n(l_string_start(self), l_string_size(self));
 }
 
 L_EXTERN int
@@ -174,22 +227,29 @@ l_string_equal(l_string* self, l_strt s)
 L_EXTERN int
 l_string_isEmpty(l_string* self)
 {
-  return l_string_ptr(self)->size == 0;
+  return l_string_size(self) == 0;
 }
 
 L_EXTERN int
 l_string_ntEmpty(l_string* self)
 {
-  return l_string_ptr(self)->size != 0;
+  return l_string_size(self) != 0;
 }
 
 L_EXTERN int
 l_string_ensureCapacity(l_string* self, l_int size)
 {
-  l_int limit = l_string_limit(self);
+  l_int limit = 0;
+  if (!self->p) {
+    return size <= L_STRING_INLINE_SIZE || l_string_spill(self, size, 0);
+  }
+  limit = l_string_limit(self);
   if (limit > 0 && size > limit) {
     return false;
   }
+  if (size <= l_string_capacity(self)) {
+    return true;
+  }
   return l_buffer_ensureCapacity((l_buffer*)self, size + 1 + sizeof(l_strbuf));
 }
 
@@ -241,8 +301,7 @@ l_string_appendReversed(l_string* self, l_strt s)
     *p++ = *s.end;
   }
 
-  *p = 0;
-  l_string_ptr(self)->size += len;
+  l_string_setEnd(self, l_string_size(self) + len);
   return true;
 }
 
@@ -285,8 +344,7 @@ l_string_appendReversedPossible(l_string* self, l_strt s)
     *p++ = *s.end;
   }
 
-  *p = 0;
-  l_string_ptr(self)->size += len;
+  l_string_setEnd(self, l_string_size(self) + len);
   return len;
 }
 
@@ -339,7 +397,7 @@ l_string_format_out(l_string* self, l_strt s)
     return;
   }
 
-  if (l_string_ptr(self)->limit >=0) {
+  if (!self->p || l_string_ptr(self)->limit >= 0) {
     l_string_append(self, s);
     return;
   }
@@ -363,7 +421,7 @@ l_string_format_out_reverse(l_string* self, l_strt s)
     return;
   }
 
-  if (l_string_ptr(self)->limit >= 0) {
+  if (!self->p || l_string_ptr(self)->limit >= 0) {
     l_string_appendReversed(self, s);
     return;
   }
@@ -545,6 +603,104 @@ l_string_parseHex(l_strt s)
   return (negative ? -value : value);
 }
 
+/** UTF-8 (RFC 3629) well-formed byte sequences **
+00..7F
+C2..DF 80..BF
+E0     A0..BF 80..BF
+E1..EC 80..BF 80..BF
+ED     80..9F 80..BF (no surrogates D800..DFFF)
+EE..EF 80..BF 80..BF
+F0     90..BF 80..BF 80..BF
+F1..F3 80..BF 80..BF 80..BF
+F4     80..8F 80..BF 80..BF (up to 10FFFF) */
+
+/* return the position after the rune, 0 if the sequence is invalid, or s.start
+if the sequence is valid so far but incomplete (more bytes are needed) */
+L_EXTERN const l_byte*
+l_utf8_decode(l_strt s, l_umedit* rune)
+{
+  const l_byte* p = s.start;
+  l_umedit c = 0;
+  l_byte lo = 0x80, hi = 0xbf;
+  l_int n = 0;
+
+  if (p >= s.end) return s.start;
+
+  c = *p++;
+  if (c < 0x80) {
+    if (rune) *rune = c;
+    return p;
+  }
+
+  if (c < 0xc2) return 0; /* continuation byte or overlong 2-byte sequence */
+  else if (c < 0xe0) { n = 1; c &= 0x1f; }
+  else if (c < 0xf0) { n = 2; if (c == 0xe0) lo = 0xa0; else if (c == 0xed) hi = 0x9f; c &= 0x0f; }
+  else if (c < 0xf5) { n = 3; if (c == 0xf0) lo = 0x90; else if (c == 0xf4) hi = 0x8f; c &= 0x07; }
+  else return 0;
+
+  for (; n > 0; --n) {
+    if (p >= s.end) return s.start;
+    if (*p < lo || *p > hi) return 0;
+    c = (c << 6) | (*p++ & 0x3f);
+    lo = 0x80; hi = 0xbf;
+  }
+
+  if (rune) *rune = c;
+  return p;
+}
+
+/* return s.end if s is valid, otherwise the start of the first invalid or incomplete sequence */
+L_EXTERN const l_byte*
+l_utf8_validate(l_strt s)
+{
+  l_ulong highs = ((~(l_ulong)0) / 255) << 7; /* 0x8080...80 */
+  l_ulong w = 0;
+  const l_byte* p = s.start;
+  const l_byte* e = 0;
+
+  while (p < s.end) {
+    /* skip ascii a word at a time */
+    while (s.end - p >= (l_int)sizeof(l_ulong)) {
+      memcpy(&w, p, sizeof(l_ulong));
+      if (w & highs) break;
+      p += sizeof(l_ulong);
+    }
+    while (p < s.end && *p < 0x80) {
+      ++p;
+      if (((l_uint)p & (sizeof(l_ulong) - 1)) == 0) break;
+    }
+    if (p >= s.end || *p < 0x80) continue;
+    if ((e = l_utf8_decode(l_strt_from(p, s.end), 0)) == 0 || e == p) {
+      return p;
+    }
+    p = e;
+  }
+  return s.end;
+}
+
+/* return number of runes in s, s should be valid utf-8 */
+L_EXTERN l_int
+l_utf8_count(l_strt s)
+{
+  l_ulong ones = (~(l_ulong)0) / 255;
+  l_ulong highs = ones << 7;
+  l_ulong w = 0, cont = 0;
+  const l_byte* p = s.start;
+  l_int n = s.end - s.start;
+
+  /* count and exclude continuation bytes 10xxxxxx */
+  while (s.end - p >= (l_int)sizeof(l_ulong)) {
+    memcpy(&w, p, sizeof(l_ulong));
+    cont = w & ~(w << 1) & highs; /* bit 7 is set and bit 6 is clear */
+    n -= (l_int)(((cont >> 7) * ones) >> ((sizeof(l_ulong) - 1) * 8));
+    p += sizeof(l_ulong);
+  }
+  for (; p < s.end; ++p) {
+    if ((*p & 0xc0) == 0x80) --n;
+  }
+  return n;
+}
+
 
 L_EXTERN void
 l_string_format_u(l_string* self, l_ulong n, l_umedit flags)
@@ -1220,5 +1376,55 @@ l_string_test()
 
   l_assert(l_check_is_alphanum_underscore('_'));
   l_assert(l_check_is_alphanum_underscore_hyphen('-'));
+
+  {
+    const l_byte mixed[] = "url?q=\xe4\xbd\xa0\xe5\xa5\xbd&e=\xf0\x9f\x98\x80&c=\xc2\xa9 end";
+    const l_byte* invalid[] = {
+      l_cstr("\xc0\xaf"), /* overlong '/' */
+      l_cstr("\xe0\x80\xaf"), /* overlong '/' */
+      l_cstr("\xed\xa0\x80"), /* surrogate D800 */
+      l_cstr("\xf4\x90\x80\x80"), /* 110000 */
+      l_cstr("\xf5\x80\x80\x80"),
+      l_cstr("\x80"),
+      l_cstr("\xc3\x28")
+    };
+    l_umedit rune = 0;
+    l_int i = 0;
+
+    l_assert(l_utf8_validate(l_strt_n(mixed, sizeof(mixed) - 1)) == mixed + sizeof(mixed) - 1);
+    l_assert(l_utf8_count(l_strt_n(mixed, sizeof(mixed) - 1)) == sizeof(mixed) - 1 - 2*2 - 3 - 1);
+    l_assert(l_utf8_validate(l_strt_n(mixed, 8)) == mixed + 6); /* incomplete at end */
+    l_assert(l_utf8_decode(l_strt_n(mixed + 6, 2), &rune) == mixed + 6);
+    l_assert(l_utf8_decode(l_strt_n(mixed + 6, 3), &rune) == mixed + 9 && rune == 0x4f60);
+    l_assert(l_utf8_decode(l_strt_n(mixed + 15, 4), &rune) == mixed + 19 && rune == 0x1f600);
+    for (i = 0; i < (l_int)(sizeof(invalid) / sizeof(invalid[0])); ++i) {
+      l_strt bad = l_strt_c(invalid[i]);
+      l_assert(l_utf8_decode(bad, &rune) == 0);
+      l_assert(l_utf8_validate(bad) == bad.start);
+    }
+  }
+
+  {
+    l_string s = l_string_createFrom(l_strn_literal("content-type"));
+    l_assert(l_string_isInline(&s));
+    l_assert(l_string_size(&s) == 12);
+    l_assert(l_string_capacity(&s) == L_STRING_INLINE_SIZE);
+    l_assert(*l_string_end(&s) == 0);
+    l_assert(l_string_equal(&s, l_strt_literal("content-type")));
+    l_assert(l_string_appendLen(&s, ": text", 6));
+    l_assert(l_string_isInline(&s));
+    l_assert(l_string_equal(&s, l_strt_literal("content-type: text")));
+    l_assert(l_string_appendLen(&s, "/html", 5));
+    l_assert(!l_string_isInline(&s));
+    l_assert(l_string_equal(&s, l_strt_literal("content-type: text/html")));
+    l_assert(*l_string_end(&s) == 0);
+    l_string_clear(&s);
+    l_assert(l_string_isEmpty(&s) && !l_string_isInline(&s));
+    l_string_free(&s, 0);
+    l_assert(l_string_isInline(&s) && l_string_isEmpty(&s));
+    s = l_string_create(L_STRING_INLINE_SIZE + 1);
+    l_assert(!l_string_isInline(&s));
+    l_string_free(&s, 0);
+  }
 }
 
@@ -16,8 +16,12 @@
 
 #define lstring(s) lp(l_string_start(s))
 
+#define L_STRING_INLINE_SIZE 22 /* max bytes held in place without a pooled buffer */
+
 typedef struct {
-  void* p;
+  void* p; /* pooled l_strbuf, or 0 if the bytes are held inline */
+  l_byte a[L_STRING_INLINE_SIZE + 1]; /* inline bytes and the zero terminated byte */
+  l_byte n; /* inline size */
 } l_string;
 
 typedef struct l_thread l_thread;
@@ -30,6 +34,7 @@ L_EXTERN l_string l_string_createFromEx(l_int size, l_strn from, l_thread* hint)
 L_EXTERN void l_string_setLimit(l_string* self, l_int limit);
 L_EXTERN void l_string_free(l_string* self, l_thread* hint);
 L_EXTERN void l_string_clear(l_string* self);
+L_EXTERN int l_string_isInline(l_string* self);
 L_EXTERN l_int l_string_capacity(l_string* self); /* exclude the last byte */
 L_EXTERN l_int l_string_remain(l_string* self); /* exclude the last byte */
 L_EXTERN l_int l_string_size(l_string* self);
@@ -53,6 +58,9 @@ L_EXTERN l_int l_string_appendLenPossible(l_string* self, const void* s, l_int l
 L_EXTERN l_int l_string_appendReversedPossible(l_string* self, l_strt s);
 L_EXTERN l_int l_string_parseDec(l_strt s);
 L_EXTERN l_int l_string_parseHex(l_strt s);
+L_EXTERN const l_byte* l_utf8_decode(l_strt s, l_umedit* rune);
+L_EXTERN const l_byte* l_utf8_validate(l_strt s);
+L_EXTERN l_int l_utf8_count(l_strt s);
 L_EXTERN void l_string_format_s(l_string* self, l_strt s, l_umedit flags);
 L_EXTERN void l_string_format_c(l_string* self, int ch, l_umedit flags);
 L_EXTERN void l_string_format_b(l_string* self, int truefalse, l_umedit flags);
@@ -1,20 +1,219 @@
 #define L_LIBRARY_IMPL
 #include "core/table.h"
+#include <stddef.h>
+#include <string.h>
+
+/* each slot has a control byte, it is L_HASHTABLE_EMPTY, L_HASHTABLE_DELETED, or
+the low 7 bits of the hash (tag) for a used slot. the slots are probed in groups
+of L_HASHTABLE_GROUP control bytes, the group of a hash is selected by the high
+bits of the hash, and the next group is tried only if the group has no empty slot */
+
+#define L_HASHTABLE_EMPTY (0x80)
+#define L_HASHTABLE_DELETED (0xfe)
+#define L_HASHTABLE_GROUP ((l_umedit)sizeof(l_ulong))
+#define L_HASHTABLE_MOVE_SLOTS (32) /* old slots moved to the new array by each add or del */
+#define L_HASHTABLE_LSB ((l_ulong)0x0101010101010101)
+#define L_HASHTABLE_MSB ((l_ulong)0x8080808080808080)
 
 typedef struct {
-  l_smplnode node;
-} l_hashslot;
+  l_byte* ctrl; /* the block: ctrl[nslot], hash[nslot], elem[nslot] */
+  l_umedit* hash;
+  void** elem;
+  l_umedit nslot;
+  l_umedit nfull;
+  l_umedit ndeleted;
+} l_hasharray;
 
 typedef struct l_hashtable {
-  l_umedit nslot;
-  l_umedit nelem;
-  l_hashslot slot[1];
+  l_hasharray cur;
+  l_hasharray old; /* the array is moving to cur, nslot is 0 if no resize in progress */
+  l_umedit moved; /* number of old slots already moved */
+  l_int keyoffset; /* offset of the length prefixed key in the element, or -1 */
 } l_hashtable;
 
-L_EXTERN l_hashtable*
-l_hashtable_create(l_byte sizebits)
+static int
+l_hasharray_init(l_hasharray* a, l_umedit nslot)
+{
+  l_byte* p = (l_byte*)l_raw_malloc(nslot * (1 + sizeof(l_umedit) + sizeof(void*)));
+  if (p == 0) return false;
+  memset(p, L_HASHTABLE_EMPTY, nslot);
+  a->ctrl = p;
+  a->hash = (l_umedit*)(p + nslot);
+  a->elem = (void**)(p + nslot * (1 + sizeof(l_umedit)));
+  a->nslot = nslot;
+  a->nfull = a->ndeleted = 0;
+  return true;
+}
+
+static void
+l_hasharray_free(l_hasharray* a)
+{
+  if (a->ctrl) l_raw_mfree(a->ctrl);
+  l_zero_n(a, sizeof(l_hasharray));
+}
+
+static l_ulong
+l_hasharray_group(l_hasharray* a, l_umedit base)
+{
+  l_ulong w;
+  memcpy(&w, a->ctrl + base, sizeof(l_ulong));
+  return w;
+}
+
+/* the result has the high bit set in the byte of each matched slot, bytes are kept
+in memory order so the matched slots are found by reading the bytes of the result */
+
+static l_ulong
+l_hasharray_matchTag(l_ulong w, l_byte tag)
+{
+  w ^= L_HASHTABLE_LSB * tag; /* may have false positives, the caller checks the slot */
+  return (w - L_HASHTABLE_LSB) & ~w & L_HASHTABLE_MSB;
+}
+
+static l_ulong
+l_hasharray_matchEmpty(l_ulong w)
+{
+  return w & ~(w << 6) & L_HASHTABLE_MSB; /* only 0x80 has bit 7 set and bit 1 not set */
+}
+
+static l_ulong
+l_hasharray_matchFree(l_ulong w)
+{
+  return w & ~(w << 7) & L_HASHTABLE_MSB; /* empty or deleted, bit 7 set and bit 0 not set */
+}
+
+static int
+l_hasharray_matchAt(l_ulong m, l_umedit i)
+{
+  return ((const l_byte*)&m)[i] != 0;
+}
+
+static int
+l_hashtable_keyEqual(l_hashtable* self, void* elem, const l_strn* key)
+{
+  const l_byte* k = (const l_byte*)elem + self->keyoffset;
+  return k[0] == key->len && memcmp(k + 1, key->start, key->len) == 0;
+}
+
+/* return the slot index of the element, or -1 if not found. the element is checked
+by the key if key is not 0, otherwise by the check function */
+static l_int
+l_hasharray_lookup(l_hashtable* self, l_hasharray* a, l_umedit hash, int (*check)(void*, void*), void* obj, const l_strn* key)
+{
+  l_umedit gmask = 0, g = 0, step = 0, base = 0, i = 0;
+  l_byte tag = (l_byte)(hash & 0x7f);
+  l_ulong w = 0, m = 0;
+  void* elem = 0;
+
+  if (a->nslot == 0) return -1;
+  gmask = a->nslot / L_HASHTABLE_GROUP - 1;
+  g = (hash >> 7) & gmask;
+
+  for (;;) {
+    base = g * L_HASHTABLE_GROUP;
+    w = l_hasharray_group(a, base);
+    if ((m = l_hasharray_matchTag(w, tag))) {
+      for (i = 0; i < L_HASHTABLE_GROUP; ++i) {
+        if (!l_hasharray_matchAt(m, i) || a->ctrl[base + i] != tag || a->hash[base + i] != hash) continue;
+        elem = a->elem[base + i];
+        if (key ? l_hashtable_keyEqual(self, elem, key) : check(obj, elem)) return (l_int)(base + i);
+      }
+    }
+    if (l_hasharray_matchEmpty(w)) return -1;
+    if (++step > gmask) return -1; /* all groups are probed */
+    g = (g + step) & gmask;
+  }
+}
+
+static void
+l_hasharray_insert(l_hasharray* a, void* elem, l_umedit hash)
+{
+  l_umedit gmask = a->nslot / L_HASHTABLE_GROUP - 1;
+  l_umedit g = (hash >> 7) & gmask, step = 0, i = 0, base = 0;
+  l_ulong m = 0;
+
+  for (;;) {
+    base = g * L_HASHTABLE_GROUP;
+    if ((m = l_hasharray_matchFree(l_hasharray_group(a, base)))) break;
+    g = (g + (++step)) & gmask;
+  }
+
+  for (i = 0; !l_hasharray_matchAt(m, i); ++i) {}
+  i += base;
+  if (a->ctrl[i] == L_HASHTABLE_DELETED) a->ndeleted -= 1;
+  a->ctrl[i] = (l_byte)(hash & 0x7f);
+  a->hash[i] = hash;
+  a->elem[i] = elem;
+  a->nfull += 1;
+}
+
+static void
+l_hasharray_erase(l_hasharray* a, l_umedit i)
+{
+  /* a group that has an empty slot has never been full, so no probe has passed it
+  and the slot can be empty again, otherwise it must be kept as deleted */
+  if (l_hasharray_matchEmpty(l_hasharray_group(a, i & ~(L_HASHTABLE_GROUP - 1)))) {
+    a->ctrl[i] = L_HASHTABLE_EMPTY;
+  } else {
+    a->ctrl[i] = L_HASHTABLE_DELETED;
+    a->ndeleted += 1;
+  }
+  a->elem[i] = 0;
+  a->nfull -= 1;
+}
+
+static void
+l_hashtable_moveOld(l_hashtable* self, l_umedit nslot)
+{
+  l_hasharray* old = &self->old;
+  l_umedit end = 0;
+
+  if (old->nslot == 0) return;
+
+  end = (nslot > old->nslot - self->moved) ? old->nslot : self->moved + nslot;
+  for (; self->moved < end && old->nfull; ++self->moved) {
+    if (old->ctrl[self->moved] & 0x80) continue;
+    l_hasharray_insert(&self->cur, old->elem[self->moved], old->hash[self->moved]);
+    old->ctrl[self->moved] = L_HASHTABLE_DELETED; /* keep the probe chains of the old array */
+    old->nfull -= 1;
+  }
+
+  if (old->nfull == 0) {
+    l_hasharray_free(old);
+    self->moved = 0;
+  }
+}
+
+static int
+l_hashtable_grow(l_hashtable* self)
+{
+  l_umedit nelem = 0, nslot = self->cur.nslot;
+
+  l_hashtable_moveOld(self, self->old.nslot); /* finish previous resize first */
+
+  nelem = self->cur.nfull + 1;
+  if (nelem > nslot / 2) { /* otherwise there are too many deleted slots, rehash at same size */
+    if (nslot >= (1U << 30)) {
+      l_loge_1("hashtable slots %d", ld(nslot));
+      return false;
+    }
+    nslot *= 2;
+  }
+
+  self->old = self->cur;
+  if (!l_hasharray_init(&self->cur, nslot)) {
+    self->cur = self->old;
+    l_zero_n(&self->old, sizeof(l_hasharray));
+    return false;
+  }
+
+  self->moved = 0;
+  return true;
+}
+
+static l_hashtable*
+l_hashtable_createImpl(l_byte sizebits, l_int keyoffset)
 {
-  l_umedit size = 0;
   l_hashtable* table = 0;
 
   if (sizebits > 30) {
@@ -22,117 +221,164 @@ l_hashtable_create(l_byte sizebits)
     return 0;
   }
 
-  size = (1 << sizebits);
-  table = (l_hashtable*)l_raw_calloc(sizeof(l_hashtable) + sizeof(l_hashslot) * size);
-  table->nslot = size;
-  table->nelem = 0;
+  if ((1U << sizebits) < L_HASHTABLE_GROUP) {
+    sizebits = 0;
+    while ((1U << sizebits) < L_HASHTABLE_GROUP) ++sizebits;
+  }
 
+  table = (l_hashtable*)l_raw_calloc(sizeof(l_hashtable));
+  if (!l_hasharray_init(&table->cur, 1U << sizebits)) {
+    l_raw_mfree(table);
+    return 0;
+  }
+
+  table->keyoffset = keyoffset;
   return table;
 }
 
-static l_smplnode*
-l_hashtable_slot_head_node(l_hashtable* self, l_umedit hash)
+L_EXTERN l_hashtable*
+l_hashtable_create(l_byte sizebits)
 {
-  return &(self->slot[hash & (self->nslot - 1)].node);
+  return l_hashtable_createImpl(sizebits, -1);
+}
+
+L_EXTERN l_hashtable*
+l_hashtable_createKeyed(l_byte sizebits, l_int keyoffset)
+{
+  return l_hashtable_createImpl(sizebits, keyoffset);
 }
 
 L_EXTERN int
-l_hashtable_add(l_hashtable* self, l_smplnode* elem, l_umedit hash)
+l_hashtable_add(l_hashtable* self, void* elem, l_umedit hash)
 {
-  l_smplnode* slot = 0;
+  l_hasharray* cur = &self->cur;
 
   if (elem == 0) return false;
 
-  slot = l_hashtable_slot_head_node(self, hash);
-  elem->next = slot->next;
-  slot->next = elem;
-  self->nelem += 1;
-
-  if (self->nelem >= self->nslot) {
-    l_logw_2("nelem %d nslot %d", ld(self->nelem), ld(self->nslot));
+  if ((cur->nfull + cur->ndeleted + self->old.nfull + 1) * 8 > cur->nslot * 7) {
+    if (!l_hashtable_grow(self)) return false;
   }
 
+  l_hasharray_insert(cur, elem, hash);
+  l_hashtable_moveOld(self, L_HASHTABLE_MOVE_SLOTS);
   return true;
 }
 
-L_EXTERN l_smplnode*
-l_hashtable_find(l_hashtable* self, l_umedit hash, int (*check)(void*, l_smplnode*), void* obj)
+L_EXTERN void*
+l_hashtable_find(l_hashtable* self, l_umedit hash, int (*check)(void*, void*), void* obj)
 {
-  l_smplnode* slot = l_hashtable_slot_head_node(self, hash);
-  l_smplnode* elem = slot->next;
-  int depth = 0;
+  l_int i = 0;
 
-  while (elem) {
-    depth += 1;
-    if (check(obj, elem)) break;
-    elem = elem->next;
+  if ((i = l_hasharray_lookup(self, &self->cur, hash, check, obj, 0)) >= 0) {
+    return self->cur.elem[i];
   }
 
-  if (depth > 3) {
-    l_logw_2("hashtable slot depth %d bottom %d", ld(depth), ld(elem == 0));
+  if ((i = l_hasharray_lookup(self, &self->old, hash, check, obj, 0)) >= 0) {
+    return self->old.elem[i];
   }
 
-  return elem;
+  return 0;
 }
 
-L_EXTERN l_smplnode*
-l_hashtable_del(l_hashtable* self, l_umedit hash, int (*check)(void*, l_smplnode*), void* obj)
+L_EXTERN void*
+l_hashtable_findStr(l_hashtable* self, l_umedit hash, l_strn key)
 {
-  l_smplnode* elem = l_hashtable_slot_head_node(self, hash);
-  l_smplnode* node = elem->next;
-  int depth = 0;
+  l_int i = 0;
 
-  while (node) {
-    depth += 1;
+  l_assert(self->keyoffset >= 0);
 
-    if (check(obj, node)) {
-      elem->next = node->next;
-      self->nelem -= 1;
-      break;
-    }
+  if ((i = l_hasharray_lookup(self, &self->cur, hash, 0, 0, &key)) >= 0) {
+    return self->cur.elem[i];
+  }
 
-    elem = node;
-    node = elem->next;
+  if ((i = l_hasharray_lookup(self, &self->old, hash, 0, 0, &key)) >= 0) {
+    return self->old.elem[i];
   }
 
-  if (depth > 3) {
-    l_logw_2("hashtable slot depth %d bottom %d", ld(depth), ld(node == 0));
+  return 0;
+}
+
+static void*
+l_hashtable_delImpl(l_hashtable* self, l_umedit hash, int (*check)(void*, void*), void* obj, const l_strn* key)
+{
+  l_hasharray* a = &self->cur;
+  void* elem = 0;
+  l_int i = 0;
+
+  if ((i = l_hasharray_lookup(self, a, hash, check, obj, key)) < 0) {
+    a = &self->old;
+    if ((i = l_hasharray_lookup(self, a, hash, check, obj, key)) < 0) {
+      return 0;
+    }
   }
 
-  return node;
+  elem = a->elem[i];
+  l_hasharray_erase(a, (l_umedit)i);
+  l_hashtable_moveOld(self, L_HASHTABLE_MOVE_SLOTS);
+  return elem;
+}
+
+L_EXTERN void*
+l_hashtable_del(l_hashtable* self, l_umedit hash, int (*check)(void*, void*), void* obj)
+{
+  return l_hashtable_delImpl(self, hash, check, obj, 0);
+}
+
+L_EXTERN void*
+l_hashtable_delStr(l_hashtable* self, l_umedit hash, l_strn key)
+{
+  l_assert(self->keyoffset >= 0);
+  return l_hashtable_delImpl(self, hash, 0, 0, &key);
+}
+
+L_EXTERN l_umedit
+l_hashtable_size(l_hashtable* self)
+{
+  return self->cur.nfull + self->old.nfull;
+}
+
+static void
+l_hasharray_foreach(l_hasharray* a, l_umedit from, void (*func)(void*, void*), void* obj)
+{
+  l_umedit i = from;
+
+  for (; i < a->nslot; ++i) {
+    if (a->ctrl[i] & 0x80) continue;
+    func(obj, a->elem[i]);
+  }
 }
 
 L_EXTERN void
-l_hashtable_foreach(l_hashtable* self, void (*func)(void*, l_smplnode*), void* obj)
+l_hashtable_foreach(l_hashtable* self, void (*func)(void*, void*), void* obj)
 {
-  l_hashslot* slot = self->slot;
-  l_hashslot* send = slot + self->nslot;
-  l_smplnode* elem = 0;
+  l_hasharray_foreach(&self->cur, 0, func, obj);
+  l_hasharray_foreach(&self->old, self->moved, func, obj);
+}
+
+static void
+l_hasharray_clear(l_hasharray* a, l_allocfunc func)
+{
+  l_umedit i = 0;
 
-  for (; slot < send; ++slot) {
-    elem = slot->node.next;
-    while (elem) {
-      func(obj, elem);
-      elem = elem->next;
+  if (func) {
+    for (; i < a->nslot; ++i) {
+      if (a->ctrl[i] & 0x80) continue;
+      l_mfree(func, a->elem[i]);
     }
   }
+
+  memset(a->ctrl, L_HASHTABLE_EMPTY, a->nslot);
+  a->nfull = a->ndeleted = 0;
 }
 
 L_EXTERN void
 l_hashtable_clear(l_hashtable* self, l_allocfunc func)
 {
-  l_hashslot* slot = self->slot;
-  l_hashslot* send = slot + self->nslot;
-  l_smplnode* head = 0;
-  l_smplnode* first = 0;
-
-  for (; slot < send; ++slot) {
-    head = &slot->node;
-    while (head->next) {
-      first = head->next;
-      head->next = first->next;
-      if (func) l_mfree(func, first);
-    }
+  l_hasharray_clear(&self->cur, func);
+  if (self->old.nslot) {
+    l_hasharray_clear(&self->old, func);
+    l_hasharray_free(&self->old);
+    self->moved = 0;
   }
 }
 
@@ -141,10 +387,108 @@ l_hashtable_free(l_hashtable** self, l_allocfunc func)
 {
   if (*self == 0) return;
   l_hashtable_clear(*self, func);
+  l_hasharray_free(&(*self)->cur);
   l_raw_mfree(*self);
   *self = 0;
 }
 
+typedef struct {
+  l_umedit id;
+  l_byte size;
+  l_byte s[15];
+} l_hashtable_testelem;
+
+static l_umedit
+l_hashtable_testHash(l_strn s)
+{
+  l_umedit hash = 2166136261U;
+  l_int i = 0;
+  for (; i < s.len; ++i) {
+    hash = (hash ^ s.start[i]) * 16777619U;
+  }
+  return hash;
+}
+
+static int
+l_hashtable_testCheck(void* obj, void* elem)
+{
+  return ((l_hashtable_testelem*)elem)->id == *(l_umedit*)obj;
+}
+
+static void
+l_hashtable_testCount(void* obj, void* elem)
+{
+  *(l_umedit*)obj += ((l_hashtable_testelem*)elem)->id + 1;
+}
+
+L_EXTERN void
+l_hashtable_test()
+{
+  l_hashtable* t = l_hashtable_createKeyed(0, (l_int)offsetof(l_hashtable_testelem, size));
+  l_hashtable_testelem* a = (l_hashtable_testelem*)l_raw_calloc(sizeof(l_hashtable_testelem) * 3000);
+  l_hashtable_testelem* e = 0;
+  l_umedit i = 0, sum = 0, id = 0;
+  l_strn key;
+
+  for (i = 0; i < 3000; ++i) {
+    a[i].id = i;
+    a[i].s[0] = 'k';
+    for (id = i, a[i].size = 1; id; id /= 10) {
+      a[i].s[a[i].size++] = (l_byte)('0' + id % 10);
+    }
+    key = l_strn_n(a[i].s, a[i].size);
+    l_assert(l_hashtable_findStr(t, l_hashtable_testHash(key), key) == 0);
+    l_assert(l_hashtable_add(t, a + i, l_hashtable_testHash(key)));
+    l_assert(l_hashtable_findStr(t, l_hashtable_testHash(key), key) == a + i);
+    l_assert(l_hashtable_size(t) == i + 1);
+  }
+
+  for (i = 0; i < 3000; ++i) {
+    key = l_strn_n(a[i].s, a[i].size);
+    l_assert(l_hashtable_findStr(t, l_hashtable_testHash(key), key) == a + i);
+    l_assert(l_hashtable_find(t, l_hashtable_testHash(key), l_hashtable_testCheck, &a[i].id) == a + i);
+  }
+
+  for (i = 0; i < 3000; i += 2) { /* del the even ones */
+    key = l_strn_n(a[i].s, a[i].size);
+    l_assert(l_hashtable_delStr(t, l_hashtable_testHash(key), key) == a + i);
+  }
+  l_assert(l_hashtable_size(t) == 1500);
+
+  l_hashtable_foreach(t, l_hashtable_testCount, &sum);
+  for (id = 0, i = 1; i < 3000; i += 2) id += i + 1;
+  l_assert(sum == id);
+
+  for (i = 0; i < 3000; ++i) {
+    key = l_strn_n(a[i].s, a[i].size);
+    e = (l_hashtable_testelem*)l_hashtable_findStr(t, l_hashtable_testHash(key), key);
+    l_assert((i & 1) ? e == a + i : e == 0);
+  }
+
+  for (i = 0; i < 3000; i += 2) { /* re-add, the deleted slots are reused */
+    key = l_strn_n(a[i].s, a[i].size);
+    l_assert(l_hashtable_add(t, a + i, l_hashtable_testHash(key)));
+  }
+
+  for (i = 0; i < 3000; ++i) {
+    key = l_strn_n(a[i].s, a[i].size);
+    l_assert(l_hashtable_del(t, l_hashtable_testHash(key), l_hashtable_testCheck, &a[i].id) == a + i);
+  }
+  l_assert(l_hashtable_size(t) == 0);
+
+  /* all elements have the same hash */
+  for (i = 0; i < 100; ++i) {
+    l_assert(l_hashtable_add(t, a + i, 7));
+  }
+  for (i = 0; i < 100; ++i) {
+    l_assert(l_hashtable_find(t, 7, l_hashtable_testCheck, &a[i].id) == a + i);
+  }
+
+  l_hashtable_free(&t, 0);
+  l_assert(t == 0);
+  l_raw_mfree(a);
+}
+
 typedef struct l_treenode {
   void* data;
   struct l_treenode* next_sibling;
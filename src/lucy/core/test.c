@@ -1,6 +1,12 @@
 #include "core/base.h"
 #include "core/string.h"
 #include "core/match.h"
+#include "core/multimatch.h"
+#include "core/table.h"
+#include "core/hash.h"
+#include "core/heap.h"
+#include "core/histo.h"
+#include "core/ring.h"
 #include "core/socket.h"
 #include "core/service.h"
 
@@ -8,6 +14,12 @@ int l_test_start() {
   l_core_base_test();
   l_string_test();
   l_string_match_test();
+  l_multimatch_test();
+  l_hashtable_test();
+  l_hash_test();
+  l_mmheap_test();
+  l_histo_test();
+  l_ring_test();
   l_plat_core_test();
   l_plat_event_test();
   l_plat_sock_test();
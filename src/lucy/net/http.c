@@ -1,6 +1,7 @@
 #include <stddef.h>
 #include "net/http.h"
 #include "core/service.h"
+#include "net/http/httpd_receive_service.h"
 
 #define L_HTTP_METHOD_MAX_LEN (7)
 #define L_NUM_OF_HTTP_METHODS (4)
@@ -393,24 +394,23 @@ static const l_strn l_http_response_headers[] = {
   l_literal_strn("x-ua-compatible")
 };
 
-static l_stringmap l_method_map;
+static l_keywordmap l_method_map;
 static l_stringmap l_httpver_map;
-static l_stringmap l_common_map;
-static l_stringmap l_request_map;
-static l_stringmap l_response_map;
+static l_keywordmap l_common_map;
+static l_keywordmap l_request_map;
+static l_keywordmap l_response_map;
 
-l_stringmap* l_http_method_map() {
-  l_stringmap* map = &l_method_map;
+l_keywordmap* l_http_method_map() {
+  l_keywordmap* map = &l_method_map;
   if (map->t) return map;
-  *map = l_string_new_map(
-      L_HTTP_METHOD_MAX_LEN,
+  *map = l_keywordmap_new(
       l_http_methods,
       L_NUM_OF_HTTP_METHODS,
       false);
   return map;
 }
 
-l_stringmap* l_http_version_map() {
+l_stringmap* l_http_version_map() { /* versions are matched by prefix, e.g. HTTP/2 for HTTP/2.0 */
   l_stringmap* map = &l_httpver_map;
   if (map->t) return map;
   *map = l_string_new_map(
@@ -421,33 +421,30 @@ l_stringmap* l_http_version_map() {
   return map;
 }
 
-l_stringmap* l_http_common_map() {
-  l_stringmap* map = &l_common_map;
+l_keywordmap* l_http_common_map() {
+  l_keywordmap* map = &l_common_map;
   if (map->t) return map;
-  *map = l_string_new_map(
-      L_HTTP_HEADER_MAX_LEN,
+  *map = l_keywordmap_new(
       l_http_common_headers,
       L_NUM_OF_COMMON_HEADERS,
       false);
   return map;
 }
 
-l_stringmap* l_http_request_map() {
-  l_stringmap* map = &l_request_map;
+l_keywordmap* l_http_request_map() {
+  l_keywordmap* map = &l_request_map;
   if (map->t) return map;
-  *map = l_string_new_map(
-      L_HTTP_HEADER_MAX_LEN,
+  *map = l_keywordmap_new(
       l_http_request_headers,
       L_NUM_OF_REQUEST_HEADERS,
       false);
   return map;
 }
 
-l_stringmap* l_http_response_map() {
-  l_stringmap* map = &l_response_map;
+l_keywordmap* l_http_response_map() {
+  l_keywordmap* map = &l_response_map;
   if (map->t) return map;
-  *map = l_string_new_map(
-      L_HTTP_HEADER_MAX_LEN,
+  *map = l_keywordmap_new(
       l_http_response_headers,
       L_NUM_OF_RESPONSE_HEADERS,
       false);
@@ -702,11 +699,20 @@ int l_http_write_body(l_http_server_receive_service* ssrx, l_strt body, int mime
   return true;
 }
 
-int l_http_write_file(l_http_server_receive_service* ssrx, l_strt filename, int mime) {
+void l_http_close_file(l_httpd_receive_service* ssrx) {
+  if (ssrx->txfopen) {
+    l_filedesc_close(&ssrx->txfile);
+    ssrx->txfopen = false;
+  }
+  ssrx->txfoff = ssrx->txfend = 0;
+}
+
+int l_http_write_file(l_httpd_receive_service* ssrx, l_strt filename, int mime) {
+  /* the file body is not read into txbuf, it is sent by sendfile after txbuf
+  from l_http_send_response_impl, the memory used is not related to the size */
   l_string* txbuf = &ssrx->txbuf;
   l_long filesize = 0;
-  l_filestream file;
-  l_int n = 0;
+  l_filedesc file;
 
   if (ssrx->stage != L_HTTP_WRITE_STATUS && ssrx->stage != L_HTTP_WRITE_HEADER) {
     l_loge_1("cannot write body in stage %d", ld(ssrx->stage));
@@ -718,64 +724,79 @@ int l_http_write_file(l_http_server_receive_service* ssrx, l_strt filename, int
     return false;
   }
 
-  file = l_open_read_unbuffered(filename.start);
-  if (file.stream == 0) return false;
-  if (!(filesize = l_file_size(filename.start))) return false;
-  if (!l_string_ensure_remain(txbuf, filesize + 1)) return false;
+  file = l_filedesc_openRead(filename.start, &filesize);
+  if (l_filedesc_isEmpty(file)) return false;
+  if (filesize <= 0) { /* empty or not a regular file */
+    l_filedesc_close(&file);
+    return false;
+  }
 
   if (ssrx->httpver > L_HTTP_VER_0NN) {
     l_string_format_2(txbuf, "Content-Type: %strn\r\nContent-Length: %d\r\n\r\n", lstrn(&l_mime_types[mime]), ld(filesize));
   }
 
-  n = l_read_file(&file, l_string_end(txbuf), filesize);
-  txbuf->b->size += n;
+  l_http_close_file(ssrx);
+  ssrx->txfile = file;
+  ssrx->txfopen = true;
+  ssrx->txfoff = 0;
+  ssrx->txfend = filesize;
   ssrx->stage = L_HTTP_WRITE_BODY;
-
-  if (n != filesize) {
-    l_loge_2("read size %d doesn't match to file size %d", ld(n), ld(filesize));
-    return false;
-  }
-
   return true;
 }
 
-int l_http_write_css_file(l_http_server_receive_service* ssrx, l_strt filename) {
+int l_http_write_css_file(l_httpd_receive_service* ssrx, l_strt filename) {
   return l_http_write_file(ssrx, filename, L_HTTP_MIME_CSS);
 }
 
-int l_http_write_js_file(l_http_server_receive_service* ssrx, l_strt filename) {
+int l_http_write_js_file(l_httpd_receive_service* ssrx, l_strt filename) {
   return l_http_write_file(ssrx, filename, L_HTTP_MIME_JS);
 }
 
-int l_http_write_html_file(l_http_server_receive_service* ssrx, l_strt filename) {
+int l_http_write_html_file(l_httpd_receive_service* ssrx, l_strt filename) {
   return l_http_write_file(ssrx, filename, L_HTTP_MIME_HTML);
 }
 
-int l_http_write_plain_file(l_http_server_receive_service* ssrx, l_strt filename) {
+int l_http_write_plain_file(l_httpd_receive_service* ssrx, l_strt filename) {
   return l_http_write_file(ssrx, filename, L_HTTP_MIME_PLAIN);
 }
 
 static int l_http_send_response_impl(l_service* srvc) {
-  l_http_server_receive_service* ssrx = (l_http_server_receive_service*)srvc;
+  l_httpd_receive_service* ssrx = (l_httpd_receive_service*)srvc;
   l_rune* txcur = ssrx->txcur;
   l_rune* txend = l_string_end(&ssrx->txbuf);
   l_int count = txend - txcur, n = 0;
   l_int status = 0;
 
-  if ((n = l_socket_write(ssrx->comm.sock, txcur, count, &status)) < 0) {
-    return L_STATUS_EWRITE;
+  if (count > 0) {
+    if ((n = l_socket_write(ssrx->comm.sock, txcur, count, &status)) < 0 || status < 0) {
+      l_http_close_file(ssrx);
+      return L_STATUS_EWRITE;
+    }
+
+    ssrx->txcur += n;
+
+    if (n < count) {
+      return l_service_yield(&ssrx->head, l_http_send_response_impl);
+    }
   }
 
-  ssrx->txcur += n;
+  if (ssrx->txfoff < ssrx->txfend) { /* the file body after status and headers */
+    l_socket_sendFile(ssrx->comm.sock, ssrx->txfile, &ssrx->txfoff, ssrx->txfend - ssrx->txfoff, &status);
+    if (status < 0) {
+      l_http_close_file(ssrx);
+      return L_STATUS_EWRITE;
+    }
 
-  if (n < count) {
-    return l_service_yield(&ssrx->head, l_http_send_response_impl);
+    if (status > 0) {
+      return l_service_yield(&ssrx->head, l_http_send_response_impl);
+    }
   }
 
+  l_http_close_file(ssrx);
   return 0;
 }
 
-int l_http_send_response(l_http_server_receive_service* ssrx) {
+int l_http_send_response(l_httpd_receive_service* ssrx) {
   l_string* txbuf = &ssrx->txbuf;
 
   if (l_string_is_empty(txbuf) || ssrx->stage < L_HTTP_WRITE_STATUS) {
@@ -870,14 +891,14 @@ int l_http_check_url_last_part(l_http_server_receive_service* ssrx, l_strt sep)
   }
 
   if (pcur == sep.end) {
-    ssrx->suffix = ssrx->suffixend = pcur - l_string_cstr(&ssrx->rxbuf);
+    ssrx->suffix = ssrx->suffixend = pcur - l_rxslab_data(ssrx->comm.slab);
     return true;
   }
 
   if (*pcur == '.') {
     if (ssrx->suffix != 0) return false; /* cannot have two '.', such as "file.sub.fix" */
 
-    ssrx->suffix = ssrx->suffixend = pcur - l_string_cstr(&ssrx->rxbuf);
+    ssrx->suffix = ssrx->suffixend = pcur - l_rxslab_data(ssrx->comm.slab);
 
     if (pcur == sep.start || pcur + 1 == sep.end) {
       return false; /* "/.sub" "/file." is not allowed */
@@ -894,7 +915,7 @@ int l_http_check_url_last_part(l_http_server_receive_service* ssrx, l_strt sep)
       return false; /* "file.#" is not allowed, # is not an alphanum_underscore_hyphen */
     }
 
-    ssrx->suffixend = pcur - l_string_cstr(&ssrx->rxbuf);
+    ssrx->suffixend = pcur - l_rxslab_data(ssrx->comm.slab);
     if (pcur == sep.end) return true;
   }
 
@@ -907,7 +928,7 @@ int l_http_check_url_last_part(l_http_server_receive_service* ssrx, l_strt sep)
     return true;
   }
 
-  ssrx->arg = pcur - l_string_cstr(&ssrx->rxbuf);
+  ssrx->arg = pcur - l_rxslab_data(ssrx->comm.slab);
   return true;
 
 #if 0
@@ -930,7 +951,7 @@ int l_http_check_url_last_part(l_http_server_receive_service* ssrx, l_strt sep)
 
 int l_http_handle_url_path_sep(l_http_server_receive_service* ssrx) {
   int depth = 0;
-  const l_byte* bufstart = l_string_cstr(&ssrx->rxbuf);
+  const l_byte* bufstart = l_rxslab_data(ssrx->comm.slab);
   l_strt url = l_strt_e(bufstart + ssrx->url, bufstart + ssrx->uend);
   const l_byte* pcur = url.start;
   l_strt sep = l_empty_strt();
@@ -976,7 +997,6 @@ typedef struct {
   l_http_server_service* server;
   l_sockaddr remote;
   l_http_read_common comm;
-  l_string rxbuf;
   int stage;
   l_byte method; /* method */
   l_byte httpver; /* http version */
@@ -1041,7 +1061,7 @@ void l_http_server_handle_get_method(l_http_server_receive_service* ssrx) {
    受限字符有 {} | \ ^ ~ [ ] ' < > "　以及不可打印字符 0x00~0x1F >=0x7F，而且不能使用空格，通常使用+来替代空格
    0~9A~Za~z_- */
   l_filesuffix file_suffix;
-  const l_byte* start = l_string_cstr(&ssrx->rxbuf);
+  const l_byte* start = l_rxslab_data(ssrx->comm.slab);
 
   if (!l_http_handle_url_path_sep(ssrx)) {
     l_http_write_status(ssrx, L_HTTP_404_NOT_FOUND);
@@ -1058,7 +1078,7 @@ void l_http_server_handle_get_method(l_http_server_receive_service* ssrx) {
 
 void l_http_server_handle_post_method(l_http_server_receive_service* ssrx) {
   l_filesuffix file_suffix;
-  const l_byte* start = l_string_cstr(&ssrx->rxbuf);
+  const l_byte* start = l_rxslab_data(ssrx->comm.slab);
 
   if (!l_http_handle_url_path_sep(ssrx)) {
     l_http_write_status(ssrx, L_HTTP_404_NOT_FOUND);
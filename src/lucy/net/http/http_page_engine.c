@@ -1,4 +1,5 @@
 #include "net/http/http_fileread_service.h"
+#include "core/hash.h"
 
 /**
  * # HTTP原始文件缓存服务
@@ -14,7 +15,6 @@ typedef struct {
   l_service head;
   l_hashtable* stbl;
   l_filedescriptor rootdir;
-  l_umedit seed;
 } l_http_fileread_service;
 
 /*
@@ -98,7 +98,7 @@ ll_handle_url_request(l_http_fileread_service* srvc, l_http_url_parts* url)
 }
 
 static int
-ll_check_string_equal(l_strn* filename, l_smplnode* node)
+ll_check_string_equal(void* filename, void* elem)
 {
 }
 
@@ -108,7 +108,7 @@ typedef struct {
 static void
 ll_handle_url_request_impl(l_http_fileread_service* srvc, l_strn completeFileName, l_strn query)
 {
-  l_umedit hash = l_string_hash(completeFileName, srvc->seed);
+  l_umedit hash = (l_umedit)l_hash_strn(completeFileName);
   l_supertext* text = (l_string*)l_hashtable_find(srvc->stbl, hash, ll_check_string_equal, &completeFileName);
   if (text) {
     /* TODO: response back */
@@ -3,42 +3,73 @@
 
 #define L_HTTP_ESTIMATED_LINE_LENGTH (128)
 
+static int /* make room for remain more bytes in the slab, a slab is taken from the thread if there is none */
+l_http_read_ensure(l_http_read_common* comm, l_int remain)
+{
+  l_int size = comm->slab ? comm->slab->size : 0;
+
+  if (size + remain > comm->rx_limit) {
+    return L_STATUS_ELIMIT;
+  }
+
+  if (!l_rxslab_ensure(comm->srvc, &comm->slab, 0, remain)) {
+    return L_STATUS_ENOMEM;
+  }
+
+  return 0;
+}
+
+static int /* nothing is received, give the slab back so the idle connection holds no buffer */
+l_http_read_waitmore(l_http_read_common* comm)
+{
+  if (comm->slab && comm->slab->size == 0) {
+    l_rxslab_release(comm->srvc, &comm->slab);
+  }
+  return L_STATUS_WAITMORE;
+}
+
 L_EXTERN int
 l_http_read_length(l_http_read_common* comm, l_int len)
 {
-  l_string* rxbuf = comm->buf;
+  l_rxslab* slab = 0;
+  l_byte* data = 0;
   l_int count = 0, n = 0, status = 0;
-  l_rune* buff_start = 0;
 
   comm->lstart = comm->lend; /* move forward to last end position */
 
 ContinueCheckLength:
-  if (l_string_size(rxbuf) - comm->lstart >= len) {
+  if ((comm->slab ? comm->slab->size : 0) - comm->lstart >= len) {
     comm->lend = comm->lstart + len;
     return 0;
   }
 
-  if (count > 0 && n < count) return L_STATUS_WAITMORE; /* last time socket read indicates there is no more data */
+  if (count > 0 && n < count) return l_http_read_waitmore(comm); /* last time socket read indicates there is no more data */
 
-  if (!l_string_ensure_capacity(rxbuf, comm->lstart + len + 1)) {
-    return L_STATUS_ELIMIT;
+  if (count > 0 && !l_service_ioSpend(comm->srvc, n)) { /* let other services run, continue at the requeued event */
+    l_service_requeueEvent(comm->srvc, L_SOCKET_READ);
+    return L_STATUS_WAITMORE;
   }
 
-  buff_start = l_string_start(rxbuf);
-  count = l_string_remain(rxbuf) - 1;
-  n = l_socket_read(comm->sock, buff_start + l_string_size(rxbuf), count, &status);
+  if ((status = l_http_read_ensure(comm, comm->lstart + len + 1 - (comm->slab ? comm->slab->size : 0))) < 0) {
+    return status;
+  }
+
+  slab = comm->slab; /* read into the slab directly, the data is kept 0 terminated */
+  data = l_rxslab_data(slab);
+  count = l_rxslab_remain(slab) - 1;
+  n = l_socket_read(comm->sock, data + slab->size, count, &status);
   if (status < 0) return L_STATUS_EREAD;
 
-  rxbuf->b->size += n; /* may read more data beyond newline */
-  *(buff_start + rxbuf->b->size) = 0;
+  slab->size += n; /* may read more data beyond newline */
+  data[slab->size] = 0;
   goto ContinueCheckLength;
 }
 
 L_EXTERN int
 l_http_read_line(l_http_read_common* comm)
 {
-  l_string* rxbuf = comm->buf;
-  l_rune* buff_start = 0;
+  l_rxslab* slab = 0;
+  l_byte* data = 0;
   const l_rune* match_end = 0;
   l_rune* last_match_start = 0;
   l_int count = 0, n = 0, status = 0;
@@ -47,37 +78,64 @@ l_http_read_line(l_http_read_common* comm)
 
 ContinueMatch:
 
-  buff_start = l_string_start(rxbuf);
-  match_end = l_string_match_until(l_string_newline_map(), l_strt_sft(buff_start, comm->mstart, l_string_size(rxbuf)), &last_match_start);
-  if (match_end) { /* newline matched */
-    comm->lnewline = last_match_start - buff_start;
-    comm->lend = match_end - buff_start;
-    comm->mstart = comm->lend;
-    return 0;
+  if ((slab = comm->slab)) {
+    data = l_rxslab_data(slab);
+    match_end = l_string_matchUntil(l_stringmap_httpNewline(), l_strt_sft(data, comm->mstart, slab->size), &last_match_start);
+    if (match_end) { /* newline matched */
+      comm->lnewline = last_match_start - data;
+      comm->lend = match_end - data;
+      comm->mstart = comm->lend;
+      return 0;
+    }
+    comm->mstart = last_match_start - data; /* next time match start here */
   }
 
-  comm->mstart = last_match_start - buff_start; /* next time match start here */
-  if (count > 0 && n < count) return L_STATUS_WAITMORE; /* last time socket read indicates there is no more data */
+  if (count > 0 && n < count) return l_http_read_waitmore(comm); /* last time socket read indicates there is no more data */
 
-  if (!l_string_ensure_remain(rxbuf, L_HTTP_ESTIMATED_LINE_LENGTH)) {
-    return L_STATUS_ELIMIT;
+  if (count > 0 && !l_service_ioSpend(comm->srvc, n)) {
+    l_service_requeueEvent(comm->srvc, L_SOCKET_READ);
+    return L_STATUS_WAITMORE;
+  }
+
+  if ((status = l_http_read_ensure(comm, L_HTTP_ESTIMATED_LINE_LENGTH)) < 0) {
+    return status;
   }
 
-  buff_start = l_string_start(rxbuf);
-  count = l_string_remain(rxbuf) - 1;
-  n = l_socket_read(comm->sock, buff_start + l_string_size(rxbuf), count, &status);
+  slab = comm->slab;
+  data = l_rxslab_data(slab);
+  count = l_rxslab_remain(slab) - 1;
+  n = l_socket_read(comm->sock, data + slab->size, count, &status);
   if (status < 0) return L_STATUS_EREAD;
 
-  rxbuf->b->size += n; /* may read more data beyond newline */
-  *(buff_start + rxbuf->b->size) = 0;
+  slab->size += n; /* may read more data beyond newline */
+  data[slab->size] = 0;
   goto ContinueMatch;
 }
 
-l_int l_http_match_header(l_stringmap* name, l_strt s, l_strt* value) {
+L_EXTERN int
+l_http_read_done(l_http_read_common* comm)
+{
+  /* the data of the request is not used any more, the pipelined data after it
+  is moved to the front of the slab, or the slab is released if there is none */
+  if (!l_rxslab_ensure(comm->srvc, &comm->slab, comm->lend, 0)) {
+    return L_STATUS_ENOMEM;
+  }
+
+  comm->lstart = comm->lnewline = comm->lend = comm->mstart = 0;
+  return 0;
+}
+
+L_EXTERN l_rxspan
+l_http_read_span(l_http_read_common* comm, l_int start, l_int end)
+{
+  return l_rxslab_span(comm->slab, start, end);
+}
+
+l_int l_http_match_header(l_keywordmap* name, l_strt s, l_strt* value) {
   const l_rune* match_end = 0;
   l_int headid = 0;
 
-  if ((match_end = l_string_match_ex(name, s, &headid, 0)) < s.start) {
+  if ((match_end = l_string_matchKeyword(name, s, &headid, 0)) < s.start) {
     return L_STATUS_EMATCH;
   }
 
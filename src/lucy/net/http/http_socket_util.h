@@ -3,6 +3,8 @@
 
 L_EXTERN int l_http_read_length(l_http_read_common* comm, l_int len);
 L_EXTERN int l_http_read_line(l_http_read_common* comm);
+L_EXTERN int l_http_read_done(l_http_read_common* comm);
+L_EXTERN l_rxspan l_http_read_span(l_http_read_common* comm, l_int start, l_int end); /* read-only until l_rxspan_release */
 L_EXTERN int l_http_read_chunked_body(l_service* srvc);
 L_EXTERN int l_http_read_body(l_service* srvc);
 
@@ -3,7 +3,6 @@
 
 #define L_HTTP_DEFAULT_PORT 80
 #define L_HTTP_DEFAULT_TX_INIT_SIZE 1024
-#define L_HTTP_DEFAULT_RX_INIT_SIZE 128
 #define L_HTTP_DEFAULT_RX_LIMIT 1024*8
 
 static int
@@ -46,12 +45,53 @@ l_httpd_listen_service_getmod(void* self, l_strt str)
   return true;
 }
 
+static l_httpd_listen_service*
+l_httpd_listen_service_shard(l_httpd_listen_service* ss)
+{
+  l_httpd_listen_service* shard = L_SERVICE_CREATE(l_httpd_listen_service);
+  shard->ip = ss->ip; /* the strings are shared with the first shard and only read */
+  shard->port = ss->port;
+  shard->backlog = ss->backlog;
+  shard->tx_init_size = ss->tx_init_size;
+  shard->rx_limit = ss->rx_limit;
+  shard->lua_module = ss->lua_module;
+  shard->client_request_handler = ss->client_request_handler;
+  shard->sockopts = ss->sockopts;
+  return shard;
+}
+
+/* each shard has its own reuseport socket and accepts on its own worker */
+static int
+l_httpd_start_shards(l_httpd_listen_service* ss, l_sockaddr* sa, int nshard, int steer)
+{
+  l_httpd_listen_service* shard = ss;
+  int i = 1;
+
+  for (; i <= nshard; ++i) {
+    if (i > 1) shard = l_httpd_listen_service_shard(ss);
+    shard->sock = l_socket_listenEx(sa, ss->backlog, L_SOCKET_LISTEN_REUSEPORT, &ss->sockopts);
+    if (l_socket_isEmpty(shard->sock)) {
+      l_service_close(&shard->head);
+      return i > 1 ? 0 : L_STATUS_ERROR; /* the started shards keep serving */
+    }
+    if (i == 1 && steer && !l_socket_steerByCpu(shard->sock, nshard)) {
+      l_logw_s("http server steer by cpu not supported");
+    }
+    l_service_setListenShard(&shard->head, shard->sock);
+    l_service_setAccept(&shard->head, l_httpd_accept_conn);
+    l_service_startEx(&shard->head, l_service_workerThread(i));
+  }
+
+  return 0;
+}
+
 L_EXTERN int
 l_httpd_start(const void* http_conf_name, int (*client_request_handler)(l_service*))
 {
   l_sockaddr sa;
   l_httpd_listen_service* ss = 0;
   lua_State* L = l_get_luastate();
+  int nshard = 0;
 
   ss = L_SERVICE_CREATE(l_httpd_listen_service);
 
@@ -75,10 +115,6 @@ l_httpd_start(const void* http_conf_name, int (*client_request_handler)(l_servic
     ss->tx_init_size = L_HTTP_DEFAULT_TX_INIT_SIZE;
   }
 
-  if ((ss->rx_init_size = l_luaconf_intv(L, 2, http_conf_name, "rx_init_size")) < L_HTTP_DEFAULT_RX_INIT_SIZE) {
-    ss->rx_init_size = L_HTTP_DEFAULT_RX_INIT_SIZE;
-  }
-
   if ((ss->rx_limit = l_luaconf_intv(L, 2, http_conf_name, "rx_limit")) < L_HTTP_DEFAULT_RX_LIMIT) {
     ss->rx_limit = L_HTTP_DEFAULT_RX_LIMIT;
   }
@@ -89,22 +125,36 @@ l_httpd_start(const void* http_conf_name, int (*client_request_handler)(l_servic
     ss->client_request_handler = client_request_handler;
   }
 
+  l_sockopts_init(&ss->sockopts); /* an invalid option is logged and skipped */
+  l_luaconf_tablev(L, l_sockopts_setByName, &ss->sockopts, 2, http_conf_name, "sockopts");
+
   if (!l_sockaddr_init(&sa, l_string_strt(&ss->ip), ss->port)) {
     l_service_close(&ss->head);
     return L_STATUS_ERROR;
   }
 
-  ss->sock = l_socket_listen(&sa, ss->backlog);
+  nshard = (int)l_luaconf_intv(L, 2, http_conf_name, "listen_shards");
+  if (nshard < 0 || nshard > l_service_workers()) {
+    nshard = l_service_workers();
+  }
+
+  if (nshard > 1) {
+    l_logm_3("start http server: %s port %d listen shards %d", ls(http_conf_name), ld(ss->port), ld(nshard));
+    return l_httpd_start_shards(ss, &sa, nshard, l_luaconf_intv(L, 2, http_conf_name, "steer_cpu") != 0);
+  }
+
+  ss->sock = l_socket_listenEx(&sa, ss->backlog, 0, &ss->sockopts);
   if (l_socket_isEmpty(ss->sock)) {
     l_service_close(&ss->head);
     return L_STATUS_ERROR;
   }
 
-  l_logm_8("start http server: %s ip %s port %d backlog %d tx_init_size %d rx_init_size %d rx_limit %d module %s",
+  l_logm_7("start http server: %s ip %s port %d backlog %d tx_init_size %d rx_limit %d module %s",
     ls(http_conf_name), ls(l_string_start(&ss->ip)), ld(ss->port), ld(ss->backlog), ld(ss->tx_init_size),
-    ld(ss->rx_init_size), ld(ss->rx_limit), l_string_isEmpty(&ss->lua_module) ? ls("n/a") : ls(l_string_start(&ss->lua_module)));
+    ld(ss->rx_limit), l_string_isEmpty(&ss->lua_module) ? ls("n/a") : ls(l_string_start(&ss->lua_module)));
 
   l_service_setListen(&ss->head, ss->sock);
+  l_service_setAccept(&ss->head, l_httpd_accept_conn);
   l_service_start(&ss->head);
   return 0;
 }
@@ -9,14 +9,15 @@ typedef struct {
   l_handle sock;
   int backlog;
   l_int tx_init_size;
-  l_int rx_init_size;
   l_int rx_limit;
   int (*client_request_handler)(l_service*);
   l_int slots;
   l_hashtable* strpool;
+  l_sockopts sockopts;
 } l_httpd_listen_service;
 
 L_PRIVAT int l_httpd_receive_conn(l_httpd_listen_service* ss, l_connind_message* msg);
+L_PRIVAT int l_httpd_accept_conn(l_service* listen, l_sockconn* conn);
 
 #endif /* l_net_httpd_listen_service_h */
 
@@ -8,27 +8,52 @@ static int l_httpd_read_request(l_service* srvc);
 static int l_httpd_read_headers(l_service* srvc);
 static int l_httpd_write_response(l_service* srvc);
 
+static void
+l_httpd_receive_init(l_httpd_receive_service* ssrx, l_httpd_listen_service* ss, l_filedesc sock)
+{
+  l_thread* thread = ssrx->head.thread;
+  l_socket_setConnOpts(sock, &ss->sockopts);
+  ssrx->ss = ss;
+  ssrx->comm.sock = sock;
+  ssrx->comm.srvc = &ssrx->head;
+  ssrx->comm.rx_limit = ss->rx_limit;
+  ssrx->comm.slab = 0; /* taken from the thread when data arrives */
+  ssrx->txbuf = l_string_createEx(ss->tx_init_size, thread);
+  ssrx->txfile = l_filedesc_empty();
+  ssrx->txfoff = ssrx->txfend = 0;
+  ssrx->txfopen = false;
+  l_service_setResume(&ssrx->head, l_httpd_read_request);
+  l_service_setEvent(&ssrx->head, sock, L_SOCKET_RDWR);
+}
+
 L_PRIVAT int
 l_httpd_receive_conn(l_httpd_listen_service* ss, l_connind_message* msg)
 {
   l_httpd_receive_service* ssrx = 0;
   ssrx = L_SERVICE_CREATEFROM(ss, l_httpd_receive_service);
-  ssrx->ss = ss;
   ssrx->rmtFamily = l_connind_getFamily(msg);
   ssrx->rmtPort = l_connind_getPort(msg);
   l_copy_n(msg->addr, 16, ssrx->rmtAddr);
-  ssrx->comm.sock = l_connind_getSock(msg);
-  ssrx->comm.rx_limit = ss->rx_limit;
-  ssrx->comm.buf = &ssrx->rxbuf;
-  ssrx->rxbuf = l_string_createEx(ss->rx_init_size, ss->thread);
-  ssrx->txbuf = l_string_createEx(ss->tx_init_size, ss->thread);
-  l_string_setLimit(&ssrx->rxbuf, ss->rx_limit);
-  l_service_setResume(&ssrx->head, l_httpd_read_request);
-  l_service_setEvent(&ssrx->head, ssrx->comm.sock, L_SOCKET_RDWR);
+  l_httpd_receive_init(ssrx, ss, l_connind_getSock(msg));
   l_service_start(&ssrx->head);
   return 0;
 }
 
+/* called on the worker the connection is handed to, the receive service is
+created and started on this worker without a round trip through the master */
+L_PRIVAT int
+l_httpd_accept_conn(l_service* listen, l_sockconn* conn)
+{
+  l_httpd_receive_service* ssrx = 0;
+  if (!(ssrx = L_SERVICE_CREATE(l_httpd_receive_service))) return false;
+  ssrx->rmtFamily = l_sockaddr_family(&conn->remote);
+  ssrx->rmtPort = l_sockaddr_port(&conn->remote);
+  l_sockaddr_ip(&conn->remote, ssrx->rmtAddr, 16);
+  l_httpd_receive_init(ssrx, (l_httpd_listen_service*)listen, conn->sock);
+  l_service_start(&ssrx->head);
+  return true;
+}
+
 static int
 l_httpd_receive_service_proc(l_service* srvc, l_message* msg)
 {
@@ -39,7 +64,10 @@ l_httpd_receive_service_proc(l_service* srvc, l_message* msg)
   switch (msg->msgid) {
   case L_MSGID_SERVICE_START:
     return 0;
-  case L_MSGID_SERVICE_CLOSE: /* TODO: free service resources here */
+  case L_MSGID_SERVICE_CLOSE: /* the last message, free the buffers and the file of the connection */
+    l_rxslab_release(srvc, &ssrx->comm.slab);
+    l_http_close_file(ssrx); /* closed before the file body is sent */
+    l_string_free(&ssrx->txbuf, srvc->thread);
     return 0;
   default:
     if (msg->msgid != L_MSGID_SOCK_EVENT_IND) {
@@ -58,16 +86,9 @@ l_httpd_receive_service_proc(l_service* srvc, l_message* msg)
   /* TODO: there may be multiple events stored in masks */
 
   if (ssrx->stage < L_HTTP_WRRES_STAGE) {
-    int n = 0;
     if (!(masks & L_IOEVENT_READ)) {
       return 0;
     }
-    if ((n = l_service_resume(srvc)) != 0) {
-      if (n < 0) l_close_service(srvc);
-      return 0;
-    }
-    ssrx->stage = L_HTTP_WRRES_STAGE;
-    l_service_setResume(srvc, l_httpd_write_response);
   } else {
     if (masks & L_IOEVENT_READ) {
       /* read event received at writing response stage, read it out and discard */
@@ -79,17 +100,33 @@ l_httpd_receive_service_proc(l_service* srvc, l_message* msg)
     }
   }
 
-  if ((n = l_service_resume(srvc)) != 0) {
-    if (n < 0) l_close_service(srvc);
-    return 0;
-  }
+  for (; ;) {
+    if ((n = l_service_resume(srvc)) != 0) {
+      if (n < 0) l_close_service(srvc);
+      return 0;
+    }
+
+    if (ssrx->stage < L_HTTP_WRRES_STAGE) { /* the request is read, write the response */
+      ssrx->stage = L_HTTP_WRRES_STAGE;
+      l_service_setResume(srvc, l_httpd_write_response);
+      continue;
+    }
+
+    /* current request handled finished, prepare for next request or disconnect */
+    ssrx->stage = L_HTTP_RDREQ_STAGE;
+    if (ssrx->httpver <= L_HTTP_VER_10N || l_http_read_done(&ssrx->comm) < 0) {
+      l_close_service(srvc);
+      return 0;
+    }
 
-  /* current request handled finished, prepare for next request or disconnect */
-  ssrx->stage = L_HTTP_RDREQ_STAGE;
-  if (ssrx->httpver <= L_HTTP_VER_10N) {
-    l_close_service(srvc);
+    l_service_setResume(srvc, l_httpd_read_request);
+    if (!ssrx->comm.slab) {
+      return 0; /* wait the read event of the next request */
+    }
+
+    /* a pipelined request is in the slab already, it was read with the last one
+    and may bring no read event, parse it now */
   }
-  return 0;
 }
 
 static void
@@ -103,6 +140,10 @@ ContinueRead:
   n = l_socket_read(ssrx->comm.sock, buffer, L_HTTP_DISCARD_BUFFER_SIZE, &status);
   if (status < 0) return; /* status >=0 success, <0 L_STATUS_ERROR */
   if (n == L_HTTP_DISCARD_BUFFER_SIZE) {
+    if (!l_service_ioSpend(&ssrx->head, n)) {
+      l_service_requeueEvent(&ssrx->head, L_SOCKET_READ);
+      return;
+    }
     goto ContinueRead;
   }
   return;
@@ -114,7 +155,6 @@ l_httpd_read_request(l_service* srvc)
   /* <method> <request-url> HTTP/<major>.<minor><crlf> #CarriageReturn(CR) 13 '\r' #LineFeed(LF) 10 '\n' */
   l_httpd_receive_service* ssrx = (l_httpd_receive_service*)srvc;
   l_http_read_common* comm = &ssrx->comm;
-  l_string* rxbuf = &ssrx->rxbuf;
   const l_rune* buff_start = 0;
   const l_rune* line_end = 0;
   const l_rune* match_end = 0;
@@ -131,9 +171,9 @@ l_httpd_read_request(l_service* srvc)
   }
 
   /* a line is read, parse <method> first */
-  buff_start = l_string_start(rxbuf);
+  buff_start = l_rxslab_data(comm->slab);
   line_end = buff_start + comm->lnewline;
-  match_end = l_string_skip_space_and_match(l_http_method_map(), l_strt_e(buff_start + comm->lstart, line_end), &strid, 0);
+  match_end = l_string_skipSpaceAndMatchKeyword(l_http_method_map(), l_strt_e(buff_start + comm->lstart, line_end), &strid, 0);
   if (!match_end) {
     l_logw_1("unsupported method %s", lp(buff_start + comm->lstart));
     return L_STATUS_EMATCH;
@@ -143,6 +183,10 @@ l_httpd_read_request(l_service* srvc)
   /* parse <request-url> */
   match_end = l_string_skip_space_and_match_until(l_string_blank_map(), l_strt_e(match_end, line_end), &first_non_space_pos);
   if (!match_end) return L_STATUS_EMATCH;
+  if (l_utf8_validate(l_strt_e(first_non_space_pos, match_end)) != match_end) {
+    l_logw_s("invalid utf-8 in request url");
+    return L_STATUS_EINVAL;
+  }
   ssrx->url = first_non_space_pos - buff_start;
   ssrx->uend = match_end - buff_start;
 
@@ -166,7 +210,6 @@ static int l_httpd_read_headers(l_service* srvc) {
      <entity-body>  */
   l_httpd_receive_service* ssrx = (l_httpd_receive_service*)srvc;
   l_http_read_common* comm = &ssrx->comm;
-  l_string* rxbuf = &ssrx->rxbuf;
   const l_rune* buff_start = 0;
   const l_rune* line_end = 0;
   const l_rune* match_end = 0;
@@ -183,7 +226,7 @@ static int l_httpd_read_headers(l_service* srvc) {
       return l_service_yield(srvc, l_httpd_read_headers);
     }
 
-    buff_start = l_string_start(rxbuf);
+    buff_start = l_rxslab_data(comm->slab);
     line_end = buff_start + comm->lnewline;
     cur_line = l_strt_e(buff_start + comm->lstart, line_end);
 
@@ -192,6 +235,11 @@ static int l_httpd_read_headers(l_service* srvc) {
       break; /* current line is empty line, headers ended here */
     }
 
+    if (l_utf8_validate(cur_line) != cur_line.end) {
+      l_logw_s("invalid utf-8 in header line");
+      return L_STATUS_EINVAL;
+    }
+
     if ((headid = l_http_match_header(l_http_common_map(), cur_line, &headval)) >= 0) {
       ssrx->commasks |= (1 << headid);
       ssrx->comhead[headid].start = headval.start - buff_start;
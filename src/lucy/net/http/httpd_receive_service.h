@@ -12,11 +12,12 @@
 typedef struct {
   l_handle sock;
   l_int rx_limit;
-  l_string* buf;
+  l_rxslab* slab; /* the received data, only held while there is data to handle */
   l_int lstart; /* line start */
   l_int lnewline; /* newline pos */
   l_int lend; /* line end */
   l_int mstart; /* match start */
+  l_service* srvc; /* spend the io budget of the service */
 } l_http_read_common;
 
 typedef struct {
@@ -37,7 +38,6 @@ typedef struct {
   l_ushort rmtPort;
   l_byte rmtAddr[16];
   l_http_read_common comm;
-  l_string rxbuf;
   int stage;
   l_byte method; /* method */
   l_byte httpver; /* http version */
@@ -53,7 +53,12 @@ typedef struct {
   l_startend reqhead[32];
   l_string txbuf;
   l_byte* txcur;
+  l_filedesc txfile; /* the file body sent after txbuf */
+  l_long txfoff, txfend; /* the range of the file not sent yet */
+  l_byte txfopen;
 } l_httpd_receive_service;
 
+L_EXTERN void l_http_close_file(l_httpd_receive_service* ssrx); /* close the file body not sent yet */
+
 #endif /* l_net_httpd_receive_service_h */
 
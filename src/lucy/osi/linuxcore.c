@@ -432,6 +432,40 @@ l_filedesc_dirfd(const void* name)
    return fd;
 }
 
+L_EXTERN l_filedesc
+l_filedesc_openRead(const void* name, l_long* size)
+{
+  /** fstat - get file status **
+  #include <sys/stat.h>
+  int fstat(int fd, struct stat* statbuf);
+  It returns information about the file referred by the fd in the buffer
+  pointed to by statbuf. st_size is the size of the file in bytes for a
+  regular file, S_ISREG(st_mode) tests whether it is a regular file.
+  On success, zero is returned. On error, -1 is returned, and errno is set
+  appropriately. */
+  struct stat st;
+  l_filedesc fd;
+  fd.unifd = -1;
+
+  if (!name) return fd;
+
+  if ((fd.unifd = open((const char*)name, O_RDONLY | O_CLOEXEC)) == -1) {
+    l_loge_1("open %s", lserror(errno));
+    return fd;
+  }
+
+  if (size) {
+    if (fstat(fd.unifd, &st) != 0) {
+      l_loge_1("fstat %s", lserror(errno));
+      l_filedesc_close(&fd);
+      return fd;
+    }
+    *size = S_ISREG(st.st_mode) ? (l_long)st.st_size : -1;
+  }
+
+  return fd;
+}
+
 L_EXTERN void
 l_filedesc_close(l_filedesc* fd)
 {
@@ -3,10 +3,23 @@
 
 #define L_LIBRARY_IMPL
 #include "core/base.h"
+#include "core/hash.h"
 #include "core/socket.h"
 
+#if defined(l_plat_linux)
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/filter.h>
+#endif
+
 #define L_SOCKET_BACKLOG  (32)
 #define L_SOCKET_IPSTRLEN (48)
+#define L_SOCKET_MAX_IOV  (64) /* iovecs passed in one call, less than IOV_MAX */
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define L_SOCKET_ZEROCOPY_SUPPORTED
+#endif
 
 L_EXTERN int
 l_sockaddr_init(l_sockaddr* self, l_strt ip, l_ushort port)
@@ -68,10 +81,48 @@ errorlabel:
   return false;
 }
 
+L_EXTERN int
+l_sockaddr_initUnix(l_sockaddr* self, l_strt path)
+{
+  /** unix - sockets for local interprocess communication **
+  #include <sys/un.h>
+  struct sockaddr_un {
+    sa_family_t sun_family; // AF_UNIX
+    char sun_path[108];     // pathname
+  };
+  A pathname socket is bound to a null-terminated filesystem pathname using
+  bind(2), the socket file is created and it must not exist before (EADDRINUSE),
+  it is not removed when the socket is closed. The addrlen is
+  offsetof(struct sockaddr_un, sun_path) + strlen(sun_path) + 1.
+  An abstract socket address (linux) is distinguished by the fact that
+  sun_path[0] is a null byte. The name of the socket is the additional bytes
+  in sun_path that are covered by the specified length of the address, null
+  bytes in the name have no special significance. The name has no connection
+  with filesystem pathnames, and it disappears when all references to the
+  socket are closed. */
+  llsockaddr* sa = (llsockaddr*)self;
+  l_int len = (l_int)(path.end - path.start);
+  l_zero_n(sa, sizeof(llsockaddr));
+  if (len <= 0 || len >= (l_int)sizeof(sa->addr.un.sun_path)) {
+    l_loge_1("invalid unix path %strt", lstrt(&path));
+    return false;
+  }
+  sa->addr.un.sun_family = AF_UNIX;
+  l_copy_n(path.start, len, sa->addr.un.sun_path);
+  if (path.start[0] == '@') {
+    sa->addr.un.sun_path[0] = 0; /* abstract, the length excludes the terminating null */
+    sa->len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+  } else {
+    sa->len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len + 1);
+  }
+  return true;
+}
+
 L_EXTERN l_ushort
 l_sockaddr_port(l_sockaddr* self)
 {
   llsockaddr* sa = (llsockaddr*)self;
+  if (sa->addr.sa.sa_family == AF_UNIX) return 0;
   return ntohs(sa->addr.in.sin_port);
 }
 
@@ -83,6 +134,7 @@ l_sockaddr_family(l_sockaddr* self)
   fa = sa->addr.sa.sa_family;
   if (fa == AF_INET) return L_SOCKET_IPV4;
   if (fa == AF_INET6) return L_SOCKET_IPV6;
+  if (fa == AF_UNIX) return L_SOCKET_UNIX;
   return 0;
 }
 
@@ -90,6 +142,10 @@ L_EXTERN int
 l_sockaddr_ip(l_sockaddr* self, l_byte* out, l_int len)
 {
   llsockaddr* sa = (llsockaddr*)self;
+  if (l_sockaddr_family(self) == L_SOCKET_UNIX) {
+    l_loge_s("unix address has no ip");
+    return false;
+  }
   if (l_sockaddr_family(self) == L_SOCKET_IPV6) {
     l_byte* p = sa->addr.in6.sin6_addr.s6_addr;
     if (len < 16) {
@@ -151,11 +207,62 @@ l_sockaddr_ipstring(l_sockaddr* self, l_string* out)
     l_string_set(out, l_strt_c(ipv6strbuf));
     return true;
   }
+  if (sa->addr.sa.sa_family == AF_UNIX) {
+    l_byte path[sizeof(sa->addr.un.sun_path)+1];
+    l_int len = (l_int)sa->len - (l_int)offsetof(struct sockaddr_un, sun_path);
+    if (len <= 0) { /* unnamed, e.g. the peer of a socketpair or an unbound client */
+      l_string_clear(out);
+      return true;
+    }
+    l_copy_n(sa->addr.un.sun_path, len, path);
+    if (path[0] == 0) {
+      path[0] = '@';
+    } else if (path[len-1] == 0) {
+      len -= 1;
+    }
+    l_string_set(out, l_strt_n(path, len));
+    return true;
+  }
   l_loge_s("invalid address family");
   l_string_clear(out);
   return false;
 }
 
+static l_int /* the bytes that tell an address, the padding and the unused path are not included */
+llsockaddrkey(const llsockaddr* sa, l_byte* out)
+{
+  l_byte* p = out;
+  l_int len = 0;
+  p = l_copy_n(&sa->addr.sa.sa_family, sizeof(sa_family_t), p);
+  if (sa->addr.sa.sa_family == AF_INET) {
+    p = l_copy_n(&sa->addr.in.sin_port, sizeof(in_port_t), p);
+    p = l_copy_n(&sa->addr.in.sin_addr, sizeof(struct in_addr), p);
+  } else if (sa->addr.sa.sa_family == AF_INET6) {
+    p = l_copy_n(&sa->addr.in6.sin6_port, sizeof(in_port_t), p);
+    p = l_copy_n(&sa->addr.in6.sin6_addr, sizeof(struct in6_addr), p);
+    p = l_copy_n(&sa->addr.in6.sin6_scope_id, sizeof(uint32_t), p);
+  } else if (sa->addr.sa.sa_family == AF_UNIX) {
+    len = (l_int)sa->len - (l_int)offsetof(struct sockaddr_un, sun_path);
+    if (len > 0) p = l_copy_n(sa->addr.un.sun_path, len, p);
+  }
+  return (l_int)(p - out);
+}
+
+L_EXTERN int
+l_sockaddr_equal(const l_sockaddr* a, const l_sockaddr* b)
+{
+  l_byte ka[sizeof(llsockaddr)], kb[sizeof(llsockaddr)];
+  l_int n = llsockaddrkey((const llsockaddr*)a, ka);
+  return n == llsockaddrkey((const llsockaddr*)b, kb) && memcmp(ka, kb, (size_t)n) == 0;
+}
+
+L_EXTERN l_ulong
+l_sockaddr_hash(const l_sockaddr* self, l_ulong seed)
+{
+  l_byte key[sizeof(llsockaddr)];
+  return l_hash_bytes(key, llsockaddrkey((const llsockaddr*)self, key), seed);
+}
+
 static int
 llsetnonblock(int fd)
 {
@@ -489,19 +596,185 @@ llsocketlisten(int sock, int backlog)
   return true;
 }
 
+static int
+llsetreuseport(int sock)
+{
+  /** SO_REUSEPORT - bind many sockets to the same address and port **
+  Permits multiple AF_INET or AF_INET6 sockets to be bound to an identical
+  socket address. This option must be set on each socket (including the
+  first socket) prior to calling bind(2) on the socket. To prevent port
+  hijacking, all of the processes binding to the same address must have
+  the same effective UID. This option can be employed with both TCP and
+  UDP sockets (since Linux 3.9).
+  For TCP sockets, this option allows accept(2) load distribution in a
+  multi-threaded server to be improved by using a distinct listener socket
+  for each thread. This provides improved load distribution as compared
+  to traditional techniques such using a single accept(2)ing thread that
+  distributes connections, or having multiple threads that compete to
+  accept(2) from the same socket. The kernel picks the listener of a new
+  connection by the hash of the 4-tuple, unless a steering program is
+  attached to the group by SO_ATTACH_REUSEPORT_CBPF or _EBPF. */
+#if defined(SO_REUSEPORT)
+  int value = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(int)) != 0) {
+    l_loge_1("setsockopt SO_REUSEPORT %s", lserror(errno));
+    return false;
+  }
+  return true;
+#else
+  (void)sock;
+  l_loge_s("SO_REUSEPORT not supported");
+  return false;
+#endif
+}
+
+#if !defined(TCP_DEFER_ACCEPT)
+#define TCP_DEFER_ACCEPT -1
+#endif
+#if !defined(TCP_FASTOPEN)
+#define TCP_FASTOPEN -1
+#endif
+#if !defined(TCP_NOTSENT_LOWAT)
+#define TCP_NOTSENT_LOWAT -1
+#endif
+#if !defined(SO_BUSY_POLL)
+#define SO_BUSY_POLL -1
+#endif
+#if !defined(TCP_KEEPIDLE)
+#define TCP_KEEPIDLE -1
+#endif
+#if !defined(TCP_KEEPINTVL)
+#define TCP_KEEPINTVL -1
+#endif
+#if !defined(TCP_KEEPCNT)
+#define TCP_KEEPCNT -1
+#endif
+#if !defined(TCP_USER_TIMEOUT)
+#define TCP_USER_TIMEOUT -1
+#endif
+
+typedef struct {
+  const char* name;
+  int level;
+  int optname; /* -1 if not supported by the platform */
+  int min;
+  int max;
+  int listen; /* set on the listen socket, otherwise on the connection */
+} llsockopt;
+
+static const llsockopt llsockopt_table[L_SOCKOPT_COUNT] = {
+  {"nodelay", IPPROTO_TCP, TCP_NODELAY, 0, 1, false},
+  {"defer_accept", IPPROTO_TCP, TCP_DEFER_ACCEPT, 0, 3600, true},
+  {"fastopen", IPPROTO_TCP, TCP_FASTOPEN, 0, 65535, true},
+  {"rcvbuf", SOL_SOCKET, SO_RCVBUF, 1024, 1 << 30, true},
+  {"sndbuf", SOL_SOCKET, SO_SNDBUF, 1024, 1 << 30, true},
+  {"notsent_lowat", IPPROTO_TCP, TCP_NOTSENT_LOWAT, 1, 1 << 30, false},
+  {"busy_poll", SOL_SOCKET, SO_BUSY_POLL, 0, 1000000, false},
+  {"keepalive", SOL_SOCKET, SO_KEEPALIVE, 0, 1, false},
+  {"keepidle", IPPROTO_TCP, TCP_KEEPIDLE, 1, 32767, false},
+  {"keepintvl", IPPROTO_TCP, TCP_KEEPINTVL, 1, 32767, false},
+  {"keepcnt", IPPROTO_TCP, TCP_KEEPCNT, 1, 127, false},
+  {"user_timeout", IPPROTO_TCP, TCP_USER_TIMEOUT, 0, 86400000, false}
+};
+
+L_EXTERN void
+l_sockopts_init(l_sockopts* self)
+{
+  l_zero_n(self, sizeof(l_sockopts));
+}
+
+L_EXTERN int
+l_sockopts_set(l_sockopts* self, int opt, l_int value)
+{
+  const llsockopt* p = 0;
+  if (opt < 0 || opt >= L_SOCKOPT_COUNT) {
+    l_loge_1("invalid sockopt %d", ld(opt));
+    return false;
+  }
+  p = llsockopt_table + opt;
+  if (value < p->min || value > p->max) {
+    l_loge_4("sockopt %s %d out of range %d ~ %d", ls(p->name), ld(value), ld(p->min), ld(p->max));
+    return false;
+  }
+  if (p->optname == -1) {
+    l_logw_1("sockopt %s not supported", ls(p->name));
+    return false;
+  }
+  self->given |= (1 << opt);
+  self->value[opt] = (int)value;
+  return true;
+}
+
+L_EXTERN int
+l_sockopts_setByName(void* self, l_strn name, l_int value)
+{
+  int opt = 0;
+  for (; opt < L_SOCKOPT_COUNT; ++opt) {
+    if (l_strn_equal(name, l_strn_c(llsockopt_table[opt].name))) {
+      return l_sockopts_set((l_sockopts*)self, opt, value);
+    }
+  }
+  l_loge_1("unknown sockopt %strn", lstrn(&name));
+  return false;
+}
+
+static int
+llsetsockopts(int sock, const l_sockopts* opts, int listen)
+{
+  const llsockopt* p = 0;
+  int opt = 0, ok = true;
+
+  if (opts == 0 || opts->given == 0) {
+    return true;
+  }
+
+  for (; opt < L_SOCKOPT_COUNT; ++opt) {
+    p = llsockopt_table + opt;
+    if (!(opts->given & (1 << opt)) || p->listen != listen) {
+      continue;
+    }
+    if (setsockopt(sock, p->level, p->optname, opts->value + opt, sizeof(int)) != 0) {
+      l_loge_2("setsockopt %s %s", ls(p->name), lserror(errno));
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+L_EXTERN int
+l_socket_setConnOpts(l_filedesc sock, const l_sockopts* opts)
+{
+  return llsetsockopts(sock.unifd, opts, false);
+}
+
 L_EXTERN l_filedesc
 l_socket_listen(const l_sockaddr* addr, int backlog)
+{
+  return l_socket_listenEx(addr, backlog, 0, 0);
+}
+
+L_EXTERN l_filedesc
+l_socket_listenEx(const l_sockaddr* addr, int backlog, l_umedit flags, const l_sockopts* opts)
 {
   l_filedesc sock = l_filedesc_empty();
   const llsockaddr* sa = (const llsockaddr*)addr;
   int domain = (addr == 0 ? AF_INET : sa->addr.sa.sa_family);
-  if (domain != AF_INET && domain != AF_INET6) {
+  if (domain == AF_UNIX) {
+    if (!llsocketcreate(AF_UNIX, (flags & L_SOCKET_SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM, 0, &sock.unifd)) {
+      return l_filedesc_empty();
+    }
+  } else if (domain != AF_INET && domain != AF_INET6) {
     l_loge_s("invalid address family");
     return l_filedesc_empty();
+  } else if (!llsocketcreate(domain, SOCK_STREAM, IPPROTO_TCP, &sock.unifd)) {
+    return l_filedesc_empty();
   }
-  if (!llsocketcreate(domain, SOCK_STREAM, IPPROTO_TCP, &sock.unifd)) {
+  if ((flags & L_SOCKET_LISTEN_REUSEPORT) && !llsetreuseport(sock.unifd)) {
+    l_socket_close(&sock);
     return l_filedesc_empty();
   }
+  llsetsockopts(sock.unifd, opts, true); /* a failed option is logged and left default */
   /* 如果一个TCP客户或服务器未曾调用bind绑定一个端口，当使用connect或
   listen 时，内核会为相应的套接字选择一个临时端口 */
   if (addr && !llsocketbind(sock.unifd, addr)) {
@@ -515,6 +788,40 @@ l_socket_listen(const l_sockaddr* addr, int backlog)
   return sock;
 }
 
+L_EXTERN int
+l_socket_steerByCpu(l_filedesc sock, int nshard)
+{
+#if defined(l_plat_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  /** SO_ATTACH_REUSEPORT_CBPF - select the listener of a reuseport group **
+  The classic bpf program returns the index of the socket in the group, the
+  index is the order the sockets were bound. If the index is out of range
+  the kernel falls back to the hash. The program is attached to the group
+  through any one of its sockets. Here the index is the cpu that handles
+  the incoming packet modulo the number of shards, so the connection is
+  accepted by the shard serving that cpu and keeps its cache warm, and the
+  load follows the distribution of the nic queues on the cpus. */
+  struct sock_filter code[3];
+  struct sock_fprog prog;
+  if (nshard <= 0) {
+    return false;
+  }
+  code[0].code = BPF_LD | BPF_W | BPF_ABS; code[0].jt = 0; code[0].jf = 0; code[0].k = (__u32)(SKF_AD_OFF + SKF_AD_CPU);
+  code[1].code = BPF_ALU | BPF_MOD | BPF_K; code[1].jt = 0; code[1].jf = 0; code[1].k = (__u32)nshard;
+  code[2].code = BPF_RET | BPF_A; code[2].jt = 0; code[2].jf = 0; code[2].k = 0;
+  prog.len = 3;
+  prog.filter = code;
+  if (setsockopt(sock.unifd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0) {
+    l_loge_1("setsockopt SO_ATTACH_REUSEPORT_CBPF %s", lserror(errno));
+    return false;
+  }
+  return true;
+#else
+  (void)sock;
+  (void)nshard;
+  return false;
+#endif
+}
+
 /** POSIX signal interrupt process's execution **
 信号（signal）是告知某个进程发生了某个事件的通知，也称谓软中断
 （software interrupt）。信号通常是异步发生的，也就是说进程预先
@@ -758,62 +1065,94 @@ caused connection abort）。POSIX作出修正的理由在于，流子系统（s
 不把该错误传递给进程的做法所涉及的步骤在TCPv2中得到阐述，引发该错误的RST在第964
 页到达处理，导致tcp_close被调用。*/
 
+static int /* return 1 accepted, 0 no more connections, -1 skip this one, -2 error */
+llaccept(int sockfd, l_sockconn* conn)
+{
+  /* accept4 (since linux 2.6.28) is accept with the flags for the new fd,
+  SOCK_NONBLOCK and SOCK_CLOEXEC save the fcntl calls of each connection */
+  llsockaddr* sa = (llsockaddr*)&(conn->remote);
+  socklen_t providedlen = sizeof(ll_sock_addr);
+  int n = 0;
+
+  sa->len = providedlen;
+#if defined(l_plat_linux)
+  conn->sock.unifd = accept4(sockfd, &(sa->addr.sa), &(sa->len), SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  if ((conn->sock.unifd = accept(sockfd, &(sa->addr.sa), &(sa->len))) != -1) {
+    llsetnonblock(conn->sock.unifd);
+  }
+#endif
+
+  if (conn->sock.unifd != -1) {
+    if (sa->len > providedlen) {
+      l_loge_s("accept address truncated");
+      sa->len = providedlen;
+    }
+    return 1;
+  }
+
+  n = errno;
+  if (n == EAGAIN || n == EWOULDBLOCK) {
+    /* no more pending completed connections in the kernel */
+    return 0;
+  }
+
+  switch (n) {
+  case EINTR: /* system call was interrupted by a signal */
+  case ECONNABORTED: /* a connection has been aborted */
+  case EPROTO: /* protocol error */
+    /* current connection is interrupted, aborted or has protocol error,
+    so skip this connection and continue to accept next connections
+    in the kernel queue until it is empty */
+    l_logw_1("accept %s", lserror(n));
+    return -1;
+  case EBADF: /* sockfd is not an open fd */
+  case EFAULT: /* the addr is not in a writable part of the user address space */
+  case EINVAL: /* sockfd is not listening for connections, or addrlen is invalid */
+  case EMFILE: /* per-process limit on the number of open fds reached */
+  case ENFILE: /* system-wide limit on the total number of open files reached */
+  /* no enough free memory. this often means that the memory allocation is limited */
+  case ENOMEM: case ENOBUFS: /* by the socket buffer limits, not by the system memroy */
+  case ENOTSOCK: /* the sockfd does not refer to a socket */
+  case EOPNOTSUPP: /* the referenced socket is not of type SOCK_STREAM */
+  case EPERM: /* firewall rules forbid connection */
+    l_loge_1("accept %s", lserror(n));
+    return -2; /* unrecoverable error, return */
+  default:
+    /* in addition, network errors for the new socket and as defined for the protocol
+    may be returned. various linux kernels can return other errors such as ENOSR,
+    ESOCKTNOSUPPORT, EPROTONOSUPPORT, ETIMEOUT. the value ERESTARTSYS may be seen
+    during a trace. */
+    l_loge_1("accept %s", lserror(n));
+    return -2;
+  }
+}
+
 L_EXTERN void
 l_socket_accept(l_filedesc sock, void (*cb)(void*, l_sockconn*), void* ud)
 {
-  int n = 0;
   l_sockconn conn;
-  llsockaddr* sa = (llsockaddr*)&(conn.remote);
-  socklen_t providedlen = sizeof(ll_sock_addr);
+  int n = 0;
 
-  for (; ;) {
-    sa->len = providedlen;
-    if ((conn.sock.unifd = accept(sock.unifd, &(sa->addr.sa), &(sa->len))) != -1) {
-      if (sa->len > providedlen) {
-        l_loge_s("accept address truncated");
-        sa->len = providedlen;
-      }
-      llsetnonblock(conn.sock.unifd);
+  while ((n = llaccept(sock.unifd, &conn)) != 0 && n != -2) {
+    if (n == 1) {
       cb(ud, &conn);
-      continue;
     }
+  }
+}
 
-    n = errno;
-    if (n == EAGAIN || n == EWOULDBLOCK) {
-      /* no more pending completed connections in the kernel */
-      return;
-    }
+L_EXTERN int /* return the number of connections accepted, less than n if the queue is drained */
+l_socket_acceptBatch(l_filedesc sock, l_sockconn* conns, int n)
+{
+  int i = 0, rc = 0;
 
-    switch (n) {
-    case EINTR: /* system call was interrupted by a signal */
-    case ECONNABORTED: /* a connection has been aborted */
-    case EPROTO: /* protocol error */
-      /* current connection is interrupted, aborted or has protocol error,
-      so skip this connection and continue to accept next connections
-      in the kernel queue until it is empty */
-      l_logw_1("accept %s", lserror(n));
-      break;
-    case EBADF: /* sockfd is not an open fd */
-    case EFAULT: /* the addr is not in a writable part of the user address space */
-    case EINVAL: /* sockfd is not listening for connections, or addrlen is invalid */
-    case EMFILE: /* per-process limit on the number of open fds reached */
-    case ENFILE: /* system-wide limit on the total number of open files reached */
-    /* no enough free memory. this often means that the memory allocation is limited */
-    case ENOMEM: case ENOBUFS: /* by the socket buffer limits, not by the system memroy */
-    case ENOTSOCK: /* the sockfd does not refer to a socket */
-    case EOPNOTSUPP: /* the referenced socket is not of type SOCK_STREAM */
-    case EPERM: /* firewall rules forbid connection */
-      l_loge_1("accept %s", lserror(n));
-      return; /* unrecoverable error, return */
-    default:
-      /* in addition, network errors for the new socket and as defined for the protocol
-      may be returned. various linux kernels can return other errors such as ENOSR,
-      ESOCKTNOSUPPORT, EPROTONOSUPPORT, ETIMEOUT. the value ERESTARTSYS may be seen
-      during a trace. */
-      l_loge_1("accept %s", lserror(n));
-      return;
+  while (i < n && (rc = llaccept(sock.unifd, conns + i)) != 0 && rc != -2) {
+    if (rc == 1) {
+      ++i;
     }
   }
+
+  return i;
 }
 
 /** TCP连接的各种可能错误 **
@@ -978,30 +1317,221 @@ l_socketconn_init(l_sockconn* self, l_strt ip, l_ushort port)
 L_EXTERN int
 l_socket_connect(l_sockconn* conn)
 {
-  l_filedesc sock = conn->sock;
+  return l_socket_connectEx(conn, 0, 0);
+}
+
+L_EXTERN int
+l_socket_connectEx(l_sockconn* conn, l_umedit flags, const l_sockopts* opts)
+{
+  l_filedesc* sock = &(conn->sock);
   l_sockaddr* addr = &(conn->remote);
-  if (sock.unifd == -1) {
+  int err = 0;
+  if (sock->unifd == -1) {
     llsockaddr* sa = (llsockaddr*)addr;
     int domain = sa->addr.sa.sa_family;
-    if (domain != AF_INET && domain != AF_INET6) {
+    if (domain == AF_UNIX) {
+      if (!llsocketcreate(AF_UNIX, (flags & L_SOCKET_SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM, 0, &sock->unifd)) {
+        return false;
+      }
+    } else if (domain != AF_INET && domain != AF_INET6) {
       l_loge_s("connect invalid address");
       return false;
-    }
-    if (!llsocketcreate(domain, SOCK_STREAM, IPPROTO_TCP, &sock.unifd)) {
+    } else if (!llsocketcreate(domain, SOCK_STREAM, IPPROTO_TCP, &sock->unifd)) {
       return false;
     }
+    llsetsockopts(sock->unifd, opts, false); /* the buffer sizes only take effect before connect */
   } else {
     /* socket already opened, it should be called 2nd time after EINPROGRESS */
   }
-  if (llsocketconnect(sock.unifd, addr)) {
+  if (llsocketconnect(sock->unifd, addr)) {
     return true;
   }
-  if (errno != EINPROGRESS) {
-    l_socket_close(&sock);
+  if ((err = errno) != EINPROGRESS) {
+    l_socket_close(sock);
+    errno = err; /* the caller can tell why */
   }
   return false;
 }
 
+L_EXTERN int
+l_socket_connectError(l_filedesc sock)
+{
+  /** SO_ERROR - get and clear the pending socket error **
+  A nonblocking connect(2) fails with EINPROGRESS at once and completes in
+  the background, select(2) or poll(2) tells the completion by indicating the
+  socket writable. After that getsockopt(2) SOL_SOCKET SO_ERROR reports
+  whether connect() completed successfully (the value is 0) or unsuccessfully
+  (the value is one of the usual error codes listed in connect(2), such as
+  ECONNREFUSED, ETIMEDOUT or EHOSTUNREACH). The option is read only and the
+  error is cleared by reading it. */
+  int err = 0;
+  socklen_t len = sizeof(int);
+  if (getsockopt(sock.unifd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+    return errno;
+  }
+  return err;
+}
+
+L_EXTERN int
+l_socket_isAlive(l_filedesc sock)
+{
+  /* an idle connection has nothing to read, the peer closed it if the read
+  returns 0, and the data came when no request is sent is stale, either way
+  the connection cannot be reused */
+  l_byte b = 0;
+  ssize_t n = 0;
+  while ((n = recv(sock.unifd, &b, 1, MSG_PEEK | MSG_DONTWAIT)) < 0) {
+    if (errno == EINTR) {
+      continue;
+    }
+    return (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+  return false;
+}
+
+L_EXTERN int
+l_socket_pair(l_filedesc* pair, l_umedit flags)
+{
+  /** socketpair - create a pair of connected sockets **
+  #include <sys/socket.h>
+  int socketpair(int domain, int type, int protocol, int sv[2]);
+  It creates an unnamed pair of connected sockets in the specified domain, of
+  the specified type, and using the optionally specified protocol. On Linux,
+  the only supported domain for this call is AF_UNIX. The file descriptors
+  used in referencing the new sockets are returned in sv[0] and sv[1], the two
+  sockets are indistinguishable. On success, zero is returned. */
+  int fd[2];
+  int type = (flags & L_SOCKET_SEQPACKET) ? SOCK_SEQPACKET : SOCK_STREAM;
+  if (socketpair(AF_UNIX, type, 0, fd) != 0) {
+    l_loge_1("socketpair %s", lserror(errno));
+    pair[0] = pair[1] = l_filedesc_empty();
+    return false;
+  }
+  llsetnonblock(fd[0]);
+  llsetnonblock(fd[1]);
+  pair[0].unifd = fd[0];
+  pair[1].unifd = fd[1];
+  return true;
+}
+
+L_EXTERN l_int
+l_socket_sendFds(l_filedesc sock, const void* data, l_int len, const l_filedesc* fds, int nfd)
+{
+  /** SCM_RIGHTS - send or receive a set of open file descriptors **
+  The ancillary data of sendmsg(2) and recvmsg(2) with the level SOL_SOCKET
+  and the type SCM_RIGHTS is an integer array of the fds. The fds are passed
+  as though they had been created with dup(2), they refer to the same open
+  file descriptions as the fds of the sender. At least one byte of real data
+  should be sent with the ancillary data, and the receiver should receive
+  with a buffer large enough for the fds, otherwise MSG_CTRUNC is set and the
+  excess fds are closed. The ancillary data is received with the first byte
+  of the data it was sent with, the recvmsg flag MSG_CMSG_CLOEXEC (linux) sets
+  the close-on-exec flag for the received fds. */
+  union {
+    struct cmsghdr align;
+    l_byte buf[CMSG_SPACE(sizeof(int) * L_SOCKET_MAX_FDS)];
+  } ctrl;
+  struct msghdr mh;
+  struct iovec v;
+  struct cmsghdr* cm = 0;
+  ssize_t n = 0;
+  int i = 0, err = 0;
+
+  if (len <= 0 || nfd < 0 || nfd > L_SOCKET_MAX_FDS) {
+    l_loge_2("sendfds invalid len %d nfd %d", ld(len), ld(nfd));
+    return L_ERROR;
+  }
+
+  l_zero_n(&mh, sizeof(struct msghdr));
+  v.iov_base = (void*)data;
+  v.iov_len = (size_t)len;
+  mh.msg_iov = &v;
+  mh.msg_iovlen = 1;
+  if (nfd > 0) {
+    mh.msg_control = ctrl.buf;
+    mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfd);
+    cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * nfd);
+    for (; i < nfd; ++i) {
+      l_copy_n(&fds[i].unifd, sizeof(int), CMSG_DATA(cm) + sizeof(int) * i);
+    }
+  }
+
+  while ((n = sendmsg(sock.unifd, &mh, MSG_NOSIGNAL)) < 0) {
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+    l_loge_1("sendmsg %s", lserror(err));
+    return L_ERROR;
+  }
+
+  return (l_int)n;
+}
+
+L_EXTERN l_int
+l_socket_recvFds(l_filedesc sock, void* out, l_int len, l_filedesc* fds, int* nfd)
+{
+  union {
+    struct cmsghdr align;
+    l_byte buf[CMSG_SPACE(sizeof(int) * L_SOCKET_MAX_FDS)];
+  } ctrl;
+  struct msghdr mh;
+  struct iovec v;
+  struct cmsghdr* cm = 0;
+  ssize_t n = 0;
+  int cap = *nfd, i = 0, k = 0, fd = 0, err = 0, flags = 0;
+
+  *nfd = 0;
+  l_zero_n(&mh, sizeof(struct msghdr));
+  v.iov_base = out;
+  v.iov_len = (size_t)len;
+  mh.msg_iov = &v;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctrl.buf;
+  mh.msg_controllen = sizeof(ctrl.buf);
+
+#if defined(MSG_CMSG_CLOEXEC)
+  flags = MSG_CMSG_CLOEXEC;
+#endif
+
+  while ((n = recvmsg(sock.unifd, &mh, flags)) < 0) {
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+    l_loge_1("recvmsg %s", lserror(err));
+    return L_ERROR;
+  }
+
+  for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    k = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    for (i = 0; i < k; ++i) {
+      l_copy_n(CMSG_DATA(cm) + sizeof(int) * i, sizeof(int), &fd);
+      if (*nfd < cap) {
+        fds[(*nfd)++].unifd = fd;
+      } else {
+        close(fd); /* no room, do not leak it */
+      }
+    }
+  }
+
+  if (mh.msg_flags & MSG_CTRUNC) {
+    l_loge_s("recvmsg fds truncated");
+  }
+
+  return n == 0 ? L_ERROR : (l_int)n; /* 0 is the peer closed */
+}
+
 L_PRIVAT l_int
 ll_read(int fd, void* out, l_int count)
 {
@@ -1214,6 +1744,937 @@ l_socket_write(l_filedesc sock, const void* from, l_int count, l_int* status)
   return sum;
 }
 
+static int /* fill v with the non-empty bufs of iov, return the number of iovecs */
+ll_iov_fill(struct iovec* v, l_iobuf* iov, int n, l_int* total)
+{
+  l_int len = 0, sum = 0;
+  int i = 0, k = 0;
+
+  for (; i < n && k < L_SOCKET_MAX_IOV && sum < L_MAX_RWSIZE; ++i) {
+    if ((len = iov[i].len) <= 0) continue;
+    if (len > L_MAX_RWSIZE - sum) {
+      len = L_MAX_RWSIZE - sum;
+    }
+    v[k].iov_base = iov[i].base;
+    v[k].iov_len = (size_t)len;
+    sum += len;
+    ++k;
+  }
+
+  *total = sum;
+  return k;
+}
+
+static void /* advance iov past the transferred bytes, the partial buf keeps the rest */
+ll_iov_advance(l_iobuf* iov, int n, l_int bytes)
+{
+  int i = 0;
+
+  for (; i < n && bytes > 0; ++i) {
+    if (iov[i].len <= 0) continue;
+    if (iov[i].len <= bytes) {
+      bytes -= iov[i].len;
+      iov[i].base = (l_byte*)iov[i].base + iov[i].len;
+      iov[i].len = 0;
+    } else {
+      iov[i].base = (l_byte*)iov[i].base + bytes;
+      iov[i].len -= bytes;
+      bytes = 0;
+    }
+  }
+}
+
+static l_int
+ll_iov_left(l_iobuf* iov, int n)
+{
+  l_int sum = 0;
+  int i = 0;
+
+  for (; i < n; ++i) {
+    if (iov[i].len > 0) sum += iov[i].len;
+  }
+
+  return sum;
+}
+
+L_EXTERN l_int /* *status >=0 success, <0 L_ERROR */
+l_socket_readv(l_filedesc sock, l_iobuf* iov, int n, l_int* status)
+{
+  /** readv - read data into multiple buffers **
+  #include <sys/uio.h>
+  ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+  The readv() system call reads iovcnt buffers from the file associated with
+  the fd into the buffers described by iov ("scatter input"). The buffers are
+  filled in array order, a buffer is completely filled before proceeding to the
+  next. The data transfers performed by readv() and writev() are atomic: the
+  data read by readv() is a contiguous block from the file, and is not mixed
+  with the output of reads in another thread. readv() returns the number of
+  bytes read, 0 for end-of-file, or -1 with errno set, the errors are the same
+  as read(2). EINVAL - the sum of the iov_len values overflows an ssize_t value,
+  or the iovcnt is less than zero or greater than IOV_MAX. */
+  struct iovec v[L_SOCKET_MAX_IOV];
+  l_int total = 0, sum = 0;
+  ssize_t k = 0;
+  int cnt = 0, err = 0;
+
+  while ((cnt = ll_iov_fill(v, iov, n, &total)) > 0) {
+    if ((k = readv(sock.unifd, v, cnt)) > 0) {
+      ll_iov_advance(iov, n, (l_int)k);
+      sum += (l_int)k;
+      continue;
+    }
+
+    if (k == 0) {
+      break; /* end of file */
+    }
+
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+
+    if (err != EAGAIN && err != EWOULDBLOCK) {
+      l_loge_1("readv %s", lserror(err));
+    }
+    break;
+  }
+
+  if (status) {
+    total = ll_iov_left(iov, n);
+    *status = (total == 0 ? 0 : (k < 0 && err != EAGAIN && err != EWOULDBLOCK ? L_ERROR : total));
+  }
+  return sum;
+}
+
+L_EXTERN l_int /* *status >=0 success, <0 L_ERROR */
+l_socket_writevEx(l_filedesc sock, l_iobuf* iov, int n, l_umedit flags, l_umedit* sends, l_int* status)
+{
+  /** writev - write data from multiple buffers **
+  #include <sys/uio.h>
+  ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+  The writev() system call writes iovcnt buffers of data described by iov to
+  the fd ("gather output"). The buffers are used in array order, a buffer is
+  completely written before proceeding to the next. Like write(2) a partial
+  write can happen at any byte, including in the middle of a buffer.
+  ---
+  MSG_ZEROCOPY (since Linux 4.14) - the send flag for sendmsg(2) on a socket
+  with SO_ZEROCOPY set. The pages of the data are pinned and sent without
+  copying to the kernel, so the buffers cannot be modified until the kernel
+  notifies the completion. The notifications are queued on the socket error
+  queue and read by recvmsg(2) with MSG_ERRQUEUE. Each successful zerocopy
+  send is numbered by a 32-bit counter of the socket starting from 0. Copying
+  is cheaper for the small writes (about 10KB), and the kernel may fall back to
+  copy, it is marked by SO_EE_CODE_ZEROCOPY_COPIED in the notification. */
+  struct iovec v[L_SOCKET_MAX_IOV];
+  l_int total = 0, sum = 0;
+  ssize_t k = 0;
+  int cnt = 0, err = 0, zerocopy = 0;
+#if defined(L_SOCKET_ZEROCOPY_SUPPORTED)
+  struct msghdr mh;
+#endif
+
+  while ((cnt = ll_iov_fill(v, iov, n, &total)) > 0) {
+#if defined(L_SOCKET_ZEROCOPY_SUPPORTED)
+    zerocopy = (flags & L_SOCKET_ZEROCOPY) && total >= L_SOCKET_ZEROCOPY_MIN;
+    if (zerocopy) {
+      l_zero_n(&mh, sizeof(struct msghdr));
+      mh.msg_iov = v;
+      mh.msg_iovlen = (size_t)cnt;
+      k = sendmsg(sock.unifd, &mh, MSG_ZEROCOPY);
+    } else {
+      k = writev(sock.unifd, v, cnt);
+    }
+#else
+    (void)flags;
+    k = writev(sock.unifd, v, cnt);
+#endif
+
+    if (k > 0) {
+      if (zerocopy && sends) {
+        *sends += 1;
+      }
+      ll_iov_advance(iov, n, (l_int)k);
+      sum += (l_int)k;
+      continue;
+    }
+
+    if (k == 0) {
+      break; /* nothing can be written, avoid looping */
+    }
+
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+
+    if (err != EAGAIN && err != EWOULDBLOCK) {
+      l_loge_1("writev %s", lserror(err));
+    }
+    break;
+  }
+
+  if (status) {
+    total = ll_iov_left(iov, n);
+    *status = (total == 0 ? 0 : (k < 0 && err != EAGAIN && err != EWOULDBLOCK ? L_ERROR : total));
+  }
+  return sum;
+}
+
+L_EXTERN l_int /* *status >=0 success, <0 L_ERROR */
+l_socket_writev(l_filedesc sock, l_iobuf* iov, int n, l_int* status)
+{
+  return l_socket_writevEx(sock, iov, n, 0, 0, status);
+}
+
+L_EXTERN int
+l_socket_setZeroCopy(l_filedesc sock, int enable)
+{
+#if defined(L_SOCKET_ZEROCOPY_SUPPORTED)
+  int value = enable ? 1 : 0;
+  if (setsockopt(sock.unifd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(int)) != 0) {
+    l_loge_1("setsockopt SO_ZEROCOPY %s", lserror(errno));
+    return false;
+  }
+  return true;
+#else
+  (void)sock;
+  (void)enable;
+  return false;
+#endif
+}
+
+L_EXTERN int /* return the number of completions reaped */
+l_socket_zeroCopyDone(l_filedesc sock, l_umedit* upto)
+{
+#if defined(L_SOCKET_ZEROCOPY_SUPPORTED)
+  /** the zerocopy completion notification **
+  struct sock_extended_err {
+    __u32 ee_errno; // 0 for the zerocopy notification
+    __u8 ee_origin; // SO_EE_ORIGIN_ZEROCOPY
+    __u8 ee_type;
+    __u8 ee_code;   // SO_EE_CODE_ZEROCOPY_COPIED if the kernel copied
+    __u8 ee_pad;
+    __u32 ee_info;  // the first send completed
+    __u32 ee_data;  // the last send completed, the range is inclusive
+  };
+  It is the data of the control message IP_RECVERR (level SOL_IP) or
+  IPV6_RECVERR (level SOL_IPV6). The notifications of the consecutive sends
+  may be coalesced into one range. Reading the error queue never blocks, it
+  returns EAGAIN if there is no notification. */
+  struct msghdr mh;
+  struct cmsghdr* cm = 0;
+  struct sock_extended_err* ee = 0;
+  l_ulong control[16];
+  int count = 0, err = 0;
+
+  for (; ;) {
+    l_zero_n(&mh, sizeof(struct msghdr));
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock.unifd, &mh, MSG_ERRQUEUE) < 0) {
+      if ((err = errno) == EINTR) continue;
+      if (err != EAGAIN && err != EWOULDBLOCK) {
+        l_loge_1("recvmsg MSG_ERRQUEUE %s", lserror(err));
+      }
+      break;
+    }
+
+    for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      ee = (struct sock_extended_err*)CMSG_DATA(cm);
+      if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      count += 1;
+      if (upto && (l_umedit)(ee->ee_data + 1) > *upto) {
+        *upto = (l_umedit)(ee->ee_data + 1);
+      }
+    }
+  }
+
+  return count;
+#else
+  (void)sock;
+  (void)upto;
+  return 0;
+#endif
+}
+
+L_EXTERN l_filedesc
+l_socket_dgram(const l_sockaddr* addr, l_umedit flags)
+{
+  l_filedesc sock = l_filedesc_empty();
+  const llsockaddr* sa = (const llsockaddr*)addr;
+  int domain = (addr == 0 ? AF_INET : sa->addr.sa.sa_family);
+  if (domain != AF_INET && domain != AF_INET6) {
+    l_loge_s("invalid address family");
+    return l_filedesc_empty();
+  }
+  if (!llsocketcreate(domain, SOCK_DGRAM, IPPROTO_UDP, &sock.unifd)) {
+    return l_filedesc_empty();
+  }
+  if ((flags & L_SOCKET_LISTEN_REUSEPORT) && !llsetreuseport(sock.unifd)) {
+    l_socket_close(&sock);
+    return l_filedesc_empty();
+  }
+  if (addr && !llsocketbind(sock.unifd, addr)) {
+    l_socket_close(&sock);
+    return l_filedesc_empty();
+  }
+  return sock;
+}
+
+L_EXTERN int
+l_socket_setGro(l_filedesc sock, int enable)
+{
+#if defined(UDP_GRO)
+  int value = enable ? 1 : 0;
+  if (setsockopt(sock.unifd, IPPROTO_UDP, UDP_GRO, &value, sizeof(int)) != 0) {
+    l_loge_1("setsockopt UDP_GRO %s", lserror(errno));
+    return false;
+  }
+  return true;
+#else
+  (void)sock;
+  (void)enable;
+  return false;
+#endif
+}
+
+#if defined(l_plat_linux)
+#define L_SOCKET_MAX_DGRAM (64) /* datagrams passed in one call */
+#define L_SOCKET_DGRAM_CMSG CMSG_SPACE(sizeof(int))
+
+L_EXTERN int
+l_socket_recvBatch(l_filedesc sock, l_dgram* dgram, int n)
+{
+  /** recvmmsg - receive multiple messages on a socket **
+  #define _GNU_SOURCE
+  #include <sys/socket.h>
+  int recvmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags, struct timespec* timeout);
+  struct mmsghdr {
+    struct msghdr msg_hdr; // message header
+    unsigned int msg_len;  // number of received bytes for header
+  };
+  It is an extension of recvmsg(2) that allows the caller to receive multiple
+  messages from a socket using a single system call. This has performance
+  benefits for some applications. The msg_len field is the number of bytes
+  returned for the message in the entry, the msg_hdr fields are updated as
+  described in recvmsg(2), the msg_namelen is the size of the source address
+  and MSG_TRUNC in msg_flags tells the datagram was longer than the buffer.
+  With MSG_DONTWAIT the call returns the messages already queued, -1 with
+  errno EAGAIN if there is none. On success the number of messages received
+  in msgvec is returned.
+  With UDP_GRO (Linux 5.0) the datagrams of a flow with the same size can be
+  received as one buffer, a control message (SOL_UDP, UDP_GRO) of an int tells
+  the segment size then. */
+  struct mmsghdr mh[L_SOCKET_MAX_DGRAM];
+  struct iovec v[L_SOCKET_MAX_DGRAM];
+  l_byte ctrl[L_SOCKET_MAX_DGRAM][L_SOCKET_DGRAM_CMSG];
+  struct cmsghdr* cm = 0;
+  llsockaddr* sa = 0;
+  int i = 0, k = 0, err = 0;
+
+  if (n > L_SOCKET_MAX_DGRAM) n = L_SOCKET_MAX_DGRAM;
+
+  for (i = 0; i < n; ++i) {
+    sa = (llsockaddr*)&dgram[i].addr;
+    v[i].iov_base = dgram[i].data;
+    v[i].iov_len = (size_t)dgram[i].size;
+    mh[i].msg_hdr.msg_name = &sa->addr;
+    mh[i].msg_hdr.msg_namelen = sizeof(ll_sock_addr);
+    mh[i].msg_hdr.msg_iov = v + i;
+    mh[i].msg_hdr.msg_iovlen = 1;
+    mh[i].msg_hdr.msg_control = ctrl[i];
+    mh[i].msg_hdr.msg_controllen = L_SOCKET_DGRAM_CMSG;
+    mh[i].msg_hdr.msg_flags = 0;
+    mh[i].msg_len = 0;
+  }
+
+  while ((k = recvmmsg(sock.unifd, mh, (unsigned)n, MSG_DONTWAIT, 0)) < 0) {
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+    l_loge_1("recvmmsg %s", lserror(err));
+    return L_ERROR;
+  }
+
+  for (i = 0; i < k; ++i) {
+    sa = (llsockaddr*)&dgram[i].addr;
+    sa->len = mh[i].msg_hdr.msg_namelen;
+    dgram[i].len = (l_int)mh[i].msg_len;
+    dgram[i].flags = (mh[i].msg_hdr.msg_flags & MSG_TRUNC) ? L_DGRAM_TRUNC : 0;
+    dgram[i].segsize = 0;
+#if defined(UDP_GRO)
+    for (cm = CMSG_FIRSTHDR(&mh[i].msg_hdr); cm; cm = CMSG_NXTHDR(&mh[i].msg_hdr, cm)) {
+      if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+        l_copy_n(CMSG_DATA(cm), sizeof(int), &err);
+        dgram[i].segsize = (l_ushort)err;
+      }
+    }
+#else
+    (void)cm;
+#endif
+  }
+
+  return k;
+}
+
+L_EXTERN int
+l_socket_sendBatch(l_filedesc sock, l_dgram* dgram, int n)
+{
+  /** sendmmsg - send multiple messages on a socket **
+  int sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags);
+  It is an extension of sendmsg(2) that allows the caller to transmit multiple
+  messages on a socket using a single system call. The msg_len fields are set
+  to the bytes sent from msg_hdr. It returns the number of messages sent, if
+  this is less than vlen the caller can retry with a further sendmmsg call to
+  send the remaining messages. If the first message cannot be sent -1 is
+  returned with errno set, EAGAIN if the socket buffer is full.
+  With UDP_SEGMENT (Linux 4.18) a control message (SOL_UDP, UDP_SEGMENT) of an
+  uint16_t lets the kernel split the buffer into datagrams of that size (gso),
+  up to 64 segments and 64KB in one call. */
+  struct mmsghdr mh[L_SOCKET_MAX_DGRAM];
+  struct iovec v[L_SOCKET_MAX_DGRAM];
+  l_byte ctrl[L_SOCKET_MAX_DGRAM][L_SOCKET_DGRAM_CMSG];
+  struct cmsghdr* cm = 0;
+  llsockaddr* sa = 0;
+  uint16_t seg = 0;
+  int i = 0, k = 0, err = 0;
+
+  if (n <= 0) return 0;
+  if (n > L_SOCKET_MAX_DGRAM) n = L_SOCKET_MAX_DGRAM;
+
+  for (i = 0; i < n; ++i) {
+    sa = (llsockaddr*)&dgram[i].addr;
+    v[i].iov_base = dgram[i].data;
+    v[i].iov_len = (size_t)dgram[i].len;
+    l_zero_n(&mh[i], sizeof(struct mmsghdr));
+    mh[i].msg_hdr.msg_name = (sa->len ? &sa->addr : 0);
+    mh[i].msg_hdr.msg_namelen = sa->len;
+    mh[i].msg_hdr.msg_iov = v + i;
+    mh[i].msg_hdr.msg_iovlen = 1;
+    if (dgram[i].segsize) {
+#if defined(UDP_SEGMENT)
+      mh[i].msg_hdr.msg_control = ctrl[i];
+      mh[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+      cm = CMSG_FIRSTHDR(&mh[i].msg_hdr);
+      cm->cmsg_level = IPPROTO_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      seg = dgram[i].segsize;
+      l_copy_n(&seg, sizeof(uint16_t), CMSG_DATA(cm));
+#else
+      l_loge_s("UDP_SEGMENT not supported");
+      n = i; /* send the ones before */
+      break;
+#endif
+    }
+  }
+
+  if (n == 0) {
+    return L_ERROR; /* the first one needs gso */
+  }
+
+  while ((k = sendmmsg(sock.unifd, mh, (unsigned)n, MSG_DONTWAIT)) < 0) {
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+    l_loge_1("sendmmsg %s", lserror(err));
+    return L_ERROR;
+  }
+
+  return k;
+}
+
+#else /* receive and send one by one */
+
+L_EXTERN int
+l_socket_recvBatch(l_filedesc sock, l_dgram* dgram, int n)
+{
+  llsockaddr* sa = 0;
+  socklen_t len = 0;
+  ssize_t k = 0;
+  int i = 0, err = 0;
+
+  for (; i < n; ++i) {
+    sa = (llsockaddr*)&dgram[i].addr;
+    len = sizeof(ll_sock_addr);
+    if ((k = recvfrom(sock.unifd, dgram[i].data, (size_t)dgram[i].size, MSG_TRUNC, &sa->addr.sa, &len)) < 0) {
+      if ((err = errno) == EINTR) {
+        --i;
+        continue;
+      }
+      if (err == EAGAIN || err == EWOULDBLOCK) {
+        break;
+      }
+      l_loge_1("recvfrom %s", lserror(err));
+      return i > 0 ? i : L_ERROR;
+    }
+    sa->len = len;
+    dgram[i].flags = (k > dgram[i].size) ? L_DGRAM_TRUNC : 0;
+    dgram[i].len = (k > dgram[i].size) ? dgram[i].size : (l_int)k;
+    dgram[i].segsize = 0;
+  }
+
+  return i;
+}
+
+L_EXTERN int
+l_socket_sendBatch(l_filedesc sock, l_dgram* dgram, int n)
+{
+  llsockaddr* sa = 0;
+  int i = 0, err = 0;
+
+  for (; i < n; ++i) {
+    sa = (llsockaddr*)&dgram[i].addr;
+    if (dgram[i].segsize) {
+      l_loge_s("UDP_SEGMENT not supported");
+      return i > 0 ? i : L_ERROR;
+    }
+    if (sendto(sock.unifd, dgram[i].data, (size_t)dgram[i].len, 0, (sa->len ? &sa->addr.sa : 0), sa->len) < 0) {
+      if ((err = errno) == EINTR) {
+        --i;
+        continue;
+      }
+      if (err == EAGAIN || err == EWOULDBLOCK) {
+        break;
+      }
+      l_loge_1("sendto %s", lserror(err));
+      return i > 0 ? i : L_ERROR;
+    }
+  }
+
+  return i;
+}
+#endif
+
+L_EXTERN l_long /* *status >=0 success, <0 L_ERROR */
+l_socket_sendFile(l_filedesc sock, l_filedesc file, l_long* offset, l_long count, l_int* status)
+{
+  /** sendfile - transfer data between file descriptors **
+  #include <sys/sendfile.h>
+  ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+  sendfile() copies data between one fd and another. Because this copying is
+  done within the kernel, sendfile() is more efficient than the combination
+  of read(2) and write(2), which would require transferring data to and from
+  user space. If offset is not NULL, sendfile() starts reading data from
+  *offset of in_fd, and when it returns *offset is set to the byte following
+  the last byte that was read, the file offset of in_fd is not modified. The
+  in_fd must support mmap(2)-like operations (i.e., it cannot be a socket).
+  If the transfer was successful, the number of bytes written to out_fd is
+  returned. Note that a successful call may write fewer bytes than requested,
+  and 0 is returned at end of file. On error, -1 is returned, and errno is set.
+  EAGAIN - nonblocking I/O has been selected using O_NONBLOCK and the write
+  would block. EINVAL - descriptor is not valid or locked, or an mmap(2)-like
+  operation is not available for in_fd, or count is negative.
+  ---
+  ssize_t splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len, unsigned int flags);
+  splice() moves data between two fds without copying between kernel address
+  space and user address space. One of the fds must refer to a pipe, and the
+  offset of the pipe must be NULL. SPLICE_F_MOVE - attempt to move pages
+  instead of copying. SPLICE_F_NONBLOCK - do not block on the pipe, the fd_out
+  may still block if it is not marked nonblocking. 0 means no data to transfer
+  and it would not make sense to block, the write end of the pipe is closed.
+  EAGAIN is returned both for an empty pipe and a full socket, so the bytes in
+  the pipe are checked by FIONREAD first, an empty pipe is not the backpressure
+  of the socket and no write event would come for it. */
+  l_long left = count, sum = 0, n = 0;
+  size_t chunk = 0;
+  int err = 0;
+#if defined(l_plat_linux)
+  off_t off = 0;
+  int avail = 0;
+#else
+  l_byte buf[16*1024];
+#endif
+
+  while (left > 0) {
+    chunk = (size_t)(left > L_MAX_RWSIZE ? L_MAX_RWSIZE : left);
+#if defined(l_plat_linux)
+    if (offset) {
+      off = (off_t)*offset;
+      if ((n = sendfile(sock.unifd, file.unifd, &off, chunk)) > 0) {
+        *offset = (l_long)off;
+      }
+    } else if (ioctl(file.unifd, FIONREAD, &avail) == 0 && avail <= 0) {
+      n = 0; /* the pipe does not hold the count bytes */
+    } else {
+      n = splice(file.unifd, 0, sock.unifd, 0, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+#else
+    /* copy through a buffer, the bytes read but not written are read again */
+    if (!offset) {
+      l_loge_s("sendfile from pipe not supported");
+      err = EINVAL;
+      break;
+    }
+    if (chunk > sizeof(buf)) chunk = sizeof(buf);
+    if ((n = pread(file.unifd, buf, chunk, (off_t)*offset)) > 0) {
+      if ((n = write(sock.unifd, buf, (size_t)n)) > 0) {
+        *offset += n;
+      }
+    }
+#endif
+
+    if (n > 0) {
+      sum += n;
+      left -= n;
+      continue;
+    }
+
+    if (n == 0) {
+      l_loge_1("file ends %d bytes early", ld(left));
+      err = EIO;
+      break;
+    }
+
+    if ((err = errno) == EINTR) {
+      continue;
+    }
+
+    if (err != EAGAIN && err != EWOULDBLOCK) {
+      l_loge_1("sendfile %s", lserror(err));
+    }
+    break;
+  }
+
+  if (status) {
+    *status = (left == 0 ? 0 : (err != EAGAIN && err != EWOULDBLOCK ? L_ERROR : (l_int)(left > L_MAX_RWSIZE ? L_MAX_RWSIZE : left)));
+  }
+  return sum;
+}
+
+static void
+l_plat_sock_vectorTest()
+{
+  l_byte a[3000], b[60000], c[7], r[63007+1];
+  l_iobuf iov[4], rov[2];
+  l_filedesc pair[2];
+  int fd[2], sndbuf = 4096;
+  l_int n = 0, status = 0, sum = 0, got = 0, i = 0;
+
+  l_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+  pair[0].unifd = fd[0];
+  pair[1].unifd = fd[1];
+  l_assert(llsetnonblock(fd[0]) && llsetnonblock(fd[1]));
+  setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(int));
+
+  for (i = 0; i < 3000; ++i) a[i] = (l_byte)i;
+  for (i = 0; i < 60000; ++i) b[i] = (l_byte)(i * 7);
+  l_copy_n("abcdefg", 7, c);
+
+  iov[0].base = a; iov[0].len = 3000;
+  iov[1].base = 0; iov[1].len = 0; /* empty buf is skipped */
+  iov[2].base = b; iov[2].len = 60000;
+  iov[3].base = c; iov[3].len = 7;
+
+  /* the small send buffer makes partial writes, the rest is
+  written from the advanced iov after the reader drained */
+  for (; ;) {
+    sum += l_socket_writev(pair[0], iov, 4, &status);
+    l_assert(status >= 0 && status == 63007 - sum);
+    l_assert(status == iov[0].len + iov[2].len + iov[3].len);
+    if (status == 0) break;
+    rov[0].base = r + got;
+    rov[0].len = 100; /* scatter across the two bufs */
+    rov[1].base = r + got + 100;
+    rov[1].len = (l_int)sizeof(r) - got - 100;
+    got += l_socket_readv(pair[1], rov, 2, &status);
+    l_assert(status > 0); /* the last byte of r is never filled */
+  }
+
+  rov[0].base = r + got;
+  rov[0].len = (l_int)sizeof(r) - got;
+  got += l_socket_readv(pair[1], rov, 1, &status);
+  l_assert(got == 63007 && status == 1 && rov[0].len == 1);
+  l_assert(memcmp(r, a, 3000) == 0 && memcmp(r + 3000, b, 60000) == 0 && memcmp(r + 63000, c, 7) == 0);
+  l_assert((l_byte*)iov[3].base == c + 7);
+
+  n = l_socket_writev(pair[0], iov, 4, &status); /* nothing left to write */
+  l_assert(n == 0 && status == 0);
+
+  l_filedesc_close(pair + 0);
+  l_filedesc_close(pair + 1);
+}
+
+static void
+l_plat_sock_fileTest()
+{
+  l_byte data[100000], r[100000];
+  l_filedesc pair[2], file;
+  FILE* tmp = 0;
+  int fd[2], pfd[2], sndbuf = 4096;
+  l_long offset = 0, sum = 0, got = 0, n = 0;
+  l_int status = 0, i = 0;
+
+  for (i = 0; i < 100000; ++i) data[i] = (l_byte)(i * 13);
+  l_assert((tmp = tmpfile()) != 0);
+  l_assert(fwrite(data, 1, 100000, tmp) == 100000 && fflush(tmp) == 0);
+  file.unifd = fileno(tmp);
+
+  l_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);
+  pair[0].unifd = fd[0];
+  pair[1].unifd = fd[1];
+  l_assert(llsetnonblock(fd[0]) && llsetnonblock(fd[1]));
+  setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(int));
+
+  /* send the range [10, 100000) of the file, resume after EAGAIN */
+  offset = 10;
+  for (; ;) {
+    sum += l_socket_sendFile(pair[0], file, &offset, 100000 - offset, &status);
+    l_assert(status >= 0 && offset == 10 + sum);
+    if (status == 0) break;
+    got += l_socket_read(pair[1], r + got, 100000 - 10 - got, &status);
+  }
+  got += l_socket_read(pair[1], r + got, 100000 - 10 - got, &status);
+  l_assert(got == 100000 - 10 && memcmp(r, data + 10, 100000 - 10) == 0);
+
+  /* splice from a pipe */
+  l_assert(pipe(pfd) == 0);
+  l_assert(write(pfd[1], data, 1000) == 1000);
+  file.unifd = pfd[0];
+  n = l_socket_sendFile(pair[0], file, 0, 1000, &status);
+  l_assert(n == 1000 && status == 0);
+  l_assert(l_socket_read(pair[1], r, 1000, &status) == 1000 && memcmp(r, data, 1000) == 0);
+  n = l_socket_sendFile(pair[0], file, 0, 10, &status); /* empty, not the socket is full */
+  l_assert(n == 0 && status == L_ERROR);
+  close(pfd[1]);
+  n = l_socket_sendFile(pair[0], file, 0, 10, &status); /* the write end is closed */
+  l_assert(n == 0 && status == L_ERROR);
+  close(pfd[0]);
+
+  fclose(tmp);
+  l_filedesc_close(pair + 0);
+  l_filedesc_close(pair + 1);
+}
+
+static void
+l_plat_sock_reusePortTest()
+{
+  l_sockaddr sa;
+  l_filedesc a, b, c;
+
+  l_sockaddr_init(&sa, l_strt_literal("127.0.0.1"), 0);
+  a = l_socket_listenEx(&sa, 0, L_SOCKET_LISTEN_REUSEPORT, 0);
+  l_assert(!l_socket_isEmpty(a));
+  sa = l_socket_localaddr(a); /* the port the kernel picked */
+  b = l_socket_listenEx(&sa, 0, L_SOCKET_LISTEN_REUSEPORT, 0);
+  l_assert(!l_socket_isEmpty(b));
+#if defined(l_plat_linux) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  l_assert(l_socket_steerByCpu(b, 2));
+#endif
+  l_assert(!l_socket_steerByCpu(b, 0));
+  c = l_socket_listen(&sa, 0); /* not in the group */
+  l_assert(l_socket_isEmpty(c));
+  l_socket_close(&a);
+  l_socket_close(&b);
+}
+
+static void
+l_plat_sock_optsTest()
+{
+  l_sockopts opts;
+  l_sockaddr sa;
+  l_sockconn conn;
+  l_filedesc sock;
+  int cfd = 0, value = 0;
+  socklen_t len = sizeof(int);
+
+  l_sockopts_init(&opts);
+  l_assert(!l_sockopts_set(&opts, L_SOCKOPT_NODELAY, 2));
+  l_assert(!l_sockopts_set(&opts, L_SOCKOPT_COUNT, 1));
+  l_assert(!l_sockopts_setByName(&opts, l_strn_literal("nagle"), 1));
+  l_assert(opts.given == 0);
+  l_assert(l_sockopts_setByName(&opts, l_strn_literal("nodelay"), 1));
+  l_assert(l_sockopts_setByName(&opts, l_strn_literal("keepalive"), 1));
+  l_assert(l_sockopts_set(&opts, L_SOCKOPT_RCVBUF, 65536));
+  l_assert(l_sockopts_set(&opts, L_SOCKOPT_KEEPCNT, 5));
+
+  l_sockaddr_init(&sa, l_strt_literal("127.0.0.1"), 0);
+  sock = l_socket_listenEx(&sa, 0, 0, &opts);
+  l_assert(!l_socket_isEmpty(sock));
+  l_assert(getsockopt(sock.unifd, SOL_SOCKET, SO_RCVBUF, &value, &len) == 0 && value >= 65536);
+  l_assert(getsockopt(sock.unifd, IPPROTO_TCP, TCP_NODELAY, &value, &len) == 0 && value == 0);
+
+  sa = l_socket_localaddr(sock);
+  cfd = socket(AF_INET, SOCK_STREAM, 0);
+  l_assert(connect(cfd, &((llsockaddr*)&sa)->addr.sa, ((llsockaddr*)&sa)->len) == 0);
+  l_assert(l_socket_acceptBatch(sock, &conn, 1) == 1);
+  l_assert(l_socket_setConnOpts(conn.sock, &opts));
+  l_assert(getsockopt(conn.sock.unifd, IPPROTO_TCP, TCP_NODELAY, &value, &len) == 0 && value == 1);
+  l_assert(getsockopt(conn.sock.unifd, SOL_SOCKET, SO_KEEPALIVE, &value, &len) == 0 && value == 1);
+
+  close(cfd);
+  l_socket_close(&conn.sock);
+  l_socket_close(&sock);
+}
+
+static void
+l_plat_sock_dgramTest()
+{
+  l_byte data[40][100], r[64][64];
+  l_dgram dg[64];
+  l_sockaddr sa;
+  l_filedesc a, b;
+  int i = 0, j = 0, n = 0;
+
+  l_sockaddr_init(&sa, l_strt_literal("127.0.0.1"), 0);
+  a = l_socket_dgram(&sa, 0);
+  b = l_socket_dgram(&sa, 0);
+  l_assert(!l_socket_isEmpty(a) && !l_socket_isEmpty(b));
+  dg[0].data = r[0];
+  dg[0].size = 64;
+  l_assert(l_socket_recvBatch(b, dg, 1) == 0); /* nothing pending */
+
+  for (i = 0; i < 40; ++i) {
+    for (j = 0; j < 100; ++j) data[i][j] = (l_byte)(i + j);
+    dg[i].addr = l_socket_localaddr(b);
+    dg[i].data = data[i];
+    dg[i].len = (i == 39 ? 100 : i + 1); /* the last is truncated */
+    dg[i].segsize = 0;
+  }
+  l_assert(l_socket_sendBatch(a, dg, 40) == 40);
+
+  for (i = 0; i < 64; ++i) {
+    dg[i].data = r[i];
+    dg[i].size = 64;
+  }
+  l_assert((n = l_socket_recvBatch(b, dg, 64)) == 40);
+  for (i = 0; i < 39; ++i) {
+    l_assert(dg[i].len == i + 1 && dg[i].flags == 0 && r[i][i] == (l_byte)(i + i));
+  }
+  l_assert(dg[39].len == 64 && (dg[39].flags & L_DGRAM_TRUNC));
+  sa = l_socket_localaddr(a);
+  l_assert(l_sockaddr_port(&dg[0].addr) == l_sockaddr_port(&sa));
+
+#if defined(l_plat_linux) && defined(UDP_SEGMENT)
+  dg[0].addr = l_socket_localaddr(b); /* one buffer sent as 3 datagrams */
+  dg[0].data = data[0];
+  dg[0].len = 90;
+  dg[0].segsize = 30;
+  l_assert(l_socket_sendBatch(a, dg, 1) == 1);
+  for (i = 0; i < 64; ++i) {
+    dg[i].data = r[i];
+    dg[i].size = 64;
+  }
+  l_assert(l_socket_recvBatch(b, dg, 64) == 3);
+  l_assert(dg[0].len == 30 && dg[2].len == 30 && r[2][0] == data[0][60]);
+#endif
+
+  l_socket_close(&a);
+  l_socket_close(&b);
+}
+
+static void
+l_plat_sock_connectTest()
+{
+  l_sockopts opts;
+  l_sockaddr sa, sb;
+  l_sockconn conn, peer;
+  l_filedesc sock;
+  l_int status = 0;
+  int i = 0, value = 0;
+  socklen_t len = sizeof(int);
+
+  l_sockaddr_init(&sa, l_strt_literal("127.0.0.1"), 8080);
+  l_sockaddr_init(&sb, l_strt_literal("127.0.0.1"), 8080);
+  l_assert(l_sockaddr_equal(&sa, &sb) && l_sockaddr_hash(&sa, 1) == l_sockaddr_hash(&sb, 1));
+  l_sockaddr_init(&sb, l_strt_literal("127.0.0.1"), 8081);
+  l_assert(!l_sockaddr_equal(&sa, &sb));
+  l_sockaddr_init(&sb, l_strt_literal("::1"), 8080);
+  l_assert(!l_sockaddr_equal(&sa, &sb));
+
+  l_sockopts_init(&opts);
+  l_sockopts_set(&opts, L_SOCKOPT_NODELAY, 1);
+  l_sockaddr_init(&sa, l_strt_literal("127.0.0.1"), 0);
+  sock = l_socket_listen(&sa, 0);
+  l_assert(!l_socket_isEmpty(sock));
+  conn.sock = l_filedesc_empty();
+  conn.remote = l_socket_localaddr(sock);
+  l_socket_connectEx(&conn, 0, &opts); /* in progress or done */
+  l_assert(!l_socket_isEmpty(conn.sock));
+  l_assert(getsockopt(conn.sock.unifd, IPPROTO_TCP, TCP_NODELAY, &value, &len) == 0 && value == 1);
+  for (i = 0; i < 100 && l_socket_acceptBatch(sock, &peer, 1) == 0; ++i) {
+    usleep(1000);
+  }
+  l_assert(i < 100 && l_socket_connectError(conn.sock) == 0);
+  l_assert(l_socket_isAlive(conn.sock));
+  l_assert(l_socket_write(peer.sock, "x", 1, &status) == 1);
+  usleep(1000);
+  l_assert(!l_socket_isAlive(conn.sock)); /* unexpected data */
+  l_socket_close(&peer.sock);
+  l_socket_close(&conn.sock);
+
+  /* refused after the listener is gone */
+  conn.remote = l_socket_localaddr(sock);
+  l_socket_close(&sock);
+  conn.sock = l_filedesc_empty();
+  if (!l_socket_connectEx(&conn, 0, 0) && !l_socket_isEmpty(conn.sock)) {
+    usleep(10000);
+    l_assert(l_socket_connectError(conn.sock) == ECONNREFUSED);
+    l_socket_close(&conn.sock);
+  }
+}
+
+static void
+l_plat_sock_unixTest()
+{
+  l_byte name[64], buf[64];
+  l_sockaddr sa;
+  l_sockconn conn, peer;
+  l_filedesc sock, pair[2], fds[L_SOCKET_MAX_FDS];
+  l_string path = l_string_createFrom(l_strn_empty());
+  l_int status = 0;
+  int nfd = 0, len = 0;
+
+  len = snprintf((char*)name, sizeof(name), "@lucy-test-%d", (int)getpid());
+  l_assert(!l_sockaddr_initUnix(&sa, l_strt_literal("")));
+  l_assert(l_sockaddr_initUnix(&sa, l_strt_n(name, len)));
+  l_assert(l_sockaddr_family(&sa) == L_SOCKET_UNIX && l_sockaddr_port(&sa) == 0);
+  l_assert(l_sockaddr_ipstring(&sa, &path) && l_string_equal(&path, l_strt_n(name, len)));
+
+  sock = l_socket_listenEx(&sa, 0, L_SOCKET_SEQPACKET, 0);
+  l_assert(!l_socket_isEmpty(sock));
+  conn.sock = l_filedesc_empty();
+  conn.remote = sa;
+  l_assert(l_socket_connectEx(&conn, L_SOCKET_SEQPACKET, 0)); /* local connect completes at once */
+  l_assert(l_socket_acceptBatch(sock, &peer, 1) == 1);
+
+  /* seqpacket keeps the message boundaries */
+  l_assert(l_socket_write(conn.sock, "abc", 3, &status) == 3);
+  l_assert(l_socket_write(conn.sock, "defgh", 5, &status) == 5);
+  l_assert(l_socket_recvFds(peer.sock, buf, 64, fds, &nfd) == 3 && buf[2] == 'c');
+  l_assert(l_socket_recvFds(peer.sock, buf, 64, fds, &nfd) == 5 && buf[4] == 'h' && nfd == 0);
+
+  /* pass one end of a socketpair, then talk through the received copy */
+  l_assert(l_socket_pair(pair, 0));
+  l_assert(l_socket_recvFds(peer.sock, buf, 64, fds, &nfd) == 0);
+  l_assert(l_socket_sendFds(conn.sock, "x", 1, pair + 1, 1) == 1);
+  nfd = L_SOCKET_MAX_FDS;
+  l_assert(l_socket_recvFds(peer.sock, buf, 64, fds, &nfd) == 1 && buf[0] == 'x' && nfd == 1);
+  l_assert(fds[0].unifd != pair[1].unifd);
+  l_socket_close(pair + 1);
+  l_assert(l_socket_write(fds[0], "ping", 4, &status) == 4);
+  l_assert(l_socket_read(pair[0], buf, 4, &status) == 4 && buf[3] == 'g' && status == 0);
+
+  l_socket_close(fds);
+  l_socket_close(pair);
+  l_socket_close(&conn.sock);
+  l_assert(l_socket_recvFds(peer.sock, buf, 64, fds, &nfd) == L_ERROR); /* peer closed */
+  l_socket_close(&peer.sock);
+  l_socket_close(&sock);
+  l_string_free(&path, 0);
+}
+
 L_EXTERN void
 l_plat_sock_test()
 {
@@ -1252,5 +2713,13 @@ l_plat_sock_test()
   l_logd_1("IPPROTO_IPV6(41) is %d", ld(IPPROTO_IPV6));
   l_logd_1("IPPROTO_TCP(6) is %d", ld(IPPROTO_TCP));
   l_logd_1("IPPROTO_UDP(17) is %d", ld(IPPROTO_UDP));
+  /* vectored io */
+  l_plat_sock_vectorTest();
+  l_plat_sock_fileTest();
+  l_plat_sock_reusePortTest();
+  l_plat_sock_optsTest();
+  l_plat_sock_dgramTest();
+  l_plat_sock_unixTest();
+  l_plat_sock_connectTest();
 }
 
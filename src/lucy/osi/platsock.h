@@ -24,12 +24,17 @@ struct sockaddr_in6 {
     uint32_t        sin6_flowinfo; // IPv6 flow information
     struct in6_addr sin6_addr;     // IPv6 address: struct in6_addr { unsigned char s6_addr[16]; }
     uint32_t        sin6_scope_id; // Scope ID (new in 2.4)
+};
+struct sockaddr_un {
+    sa_family_t sun_family;    // AF_UNIX
+    char        sun_path[108]; // pathname, or abstract name after a leading null byte (linux)
 }; */
 
 typedef union {
   struct sockaddr sa;
   struct sockaddr_in in;
   struct sockaddr_in6 in6;
+  struct sockaddr_un un;
 } ll_sock_addr;
 
 typedef struct {
@@ -43,9 +43,14 @@ AUTOOBJ = autoconf$(O)
 COREOBJ = core/base$(O) \
           core/fileop$(O) \
           core/queue$(O) \
+          core/heap$(O) \
+          core/histo$(O) \
+          core/ring$(O) \
           core/table$(O) \
+          core/hash$(O) \
           core/string$(O) \
           core/match$(O) \
+          core/multimatch$(O) \
           core/master$(O) \
           core/state$(O) \
           osi/linuxcore$(O) \
@@ -98,6 +103,6 @@ core/state.o: core/state.c lucycore.h
 $(AUTOOBJ): autoconf.c core/prefix.h osi/plationf.h osi/platsock.h
 $(COREIND): autoconf.h lucycore.h core/prefix.h osi/plationf.h osi/platsock.h osi/linuxpref.h
 $(PLATSRC): osi/linuxcore.c osi/eventpoll.c osi/bsdkqueue.c osi/plainpoll.c osi/linuxsock.c
-$(COREOBJ): core/base.c core/string.c core/state.c core/master.c $(PLATSRC) $(COREIND)
+$(COREOBJ): core/base.c core/hash.c core/heap.c core/histo.c core/queue.c core/ring.c core/string.c core/multimatch.c core/state.c core/master.c $(PLATSRC) $(COREIND)
 $(HTTPOBJ): net/http.c net/http.h $(COREIND)
 